@@ -0,0 +1,201 @@
+#include "load.hh"
+#include "async_client.hh"
+#include "buffer_pool.hh"
+#include "connection_pool.hh"
+#include "h2_client.hh"
+#include "runtime.hh"
+#include "sync_client.hh"
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace bench {
+namespace {
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+using clock = std::chrono::steady_clock;
+
+// Spread the requests of a connection evenly, when there is a rate limit
+class pacer {
+public:
+    pacer(const load_options& options, clock::time_point start) :
+            interval_{options.rate > 0 ?
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(static_cast<double>(options.connections) / options.rate)) :
+                std::chrono::nanoseconds{0}},
+            next_{start} {
+    }
+
+    // when the next request should start
+    auto due() -> clock::time_point {
+        if (interval_.count() == 0) {
+            return clock::now();
+        }
+        const auto at{next_};
+        next_ += interval_;
+        return at;
+    }
+
+private:
+    std::chrono::nanoseconds interval_;
+    clock::time_point next_;
+};
+
+auto async_worker(const load_options& options, clock::time_point end, load_result& result,
+                  comm::h2_connection* h2 = nullptr) -> asio::awaitable<void> {
+    auto executor = co_await asio::this_coro::executor;
+    asio::steady_timer timer(executor);
+    std::optional<comm::connection_pool> pool;
+    if (options.mode == client_mode::pool) {
+        comm::pool_options po;
+        po.max_per_host = 1;
+        pool.emplace(executor, po);
+    }
+    tcp::socket socket(executor);
+    std::string message(std::max<std::size_t>(options.message_size, 1) - 1, 'x');
+    message.push_back('\n');
+
+    pacer p{options, clock::now()};
+    while (clock::now() < end) {
+        const auto due{p.due()};
+        if (due > clock::now()) {
+            timer.expires_at(due);
+            co_await timer.async_wait(asio::as_tuple(asio::use_awaitable));
+        }
+        std::string reply;
+        switch (options.mode) {
+        case client_mode::async:
+            reply = co_await comm::async_http_client(options.host, options.port, options.resource);
+            break;
+        case client_mode::pool:
+            reply = co_await comm::async_http_client(*pool, options.host, options.port, options.resource);
+            break;
+        case client_mode::h2:
+            reply = co_await comm::async_http_client(*h2, options.resource);
+            break;
+        case client_mode::tcp:
+            if (!socket.is_open()) {
+                socket = co_await comm::async_connect(options.host, options.port);
+            }
+            reply = co_await comm::async_tcp_read_write(socket, message, "\n");
+            break;
+        case client_mode::sync:
+            break;
+        }
+        result.record(clock::now() - due, reply.size());
+        comm::recycle_buffer(std::move(reply));
+    }
+}
+
+// One HTTP/2 connection for the clients of a context, each client sends its requests as streams of it
+auto h2_worker(const load_options& options, clock::time_point end, std::vector<load_result*> results) -> asio::awaitable<void> {
+    auto executor = co_await asio::this_coro::executor;
+    auto connection = co_await comm::async_h2_connect(options.host, options.port);
+    if (!connection) {
+        for (auto* r : results) {
+            r->record(std::chrono::nanoseconds{0}, 0);
+        }
+        co_return;
+    }
+    using client_op = decltype(asio::co_spawn(executor, async_worker(options, end, *results.front(), connection.get()), asio::deferred));
+    std::vector<client_op> clients;
+    for (auto* r : results) {
+        clients.push_back(asio::co_spawn(executor, async_worker(options, end, *r, connection.get()), asio::deferred));
+    }
+    co_await asio::experimental::make_parallel_group(std::move(clients)).async_wait(
+            asio::experimental::wait_for_all(), asio::use_awaitable);
+    co_await connection->close();
+}
+
+auto sync_worker(const load_options& options, clock::time_point end, load_result& result) -> void {
+    asio::io_context ctx;
+    pacer p{options, clock::now()};
+    while (clock::now() < end) {
+        const auto due{p.due()};
+        std::this_thread::sleep_until(due);
+        std::size_t received{0};
+        if (auto socket = comm::connect(options.host.c_str(), options.port.c_str(), ctx); socket) {
+            if (comm::http_send_request(*socket, options.host.c_str(), options.resource)) {
+                if (auto r = comm::http_handle_response(*socket); r) {
+                    received = r->size();
+                }
+            }
+        }
+        result.record(clock::now() - due, received);
+    }
+}
+
+}		// end of local namespace
+
+auto load_result::record(std::chrono::nanoseconds elapsed, std::size_t received) -> void {
+    if (received == 0) {
+        ++failed;
+        return;
+    }
+    ++ok;
+    bytes += received;
+    latency.record(elapsed);
+}
+
+auto load_result::merge(const load_result& other) -> void {
+    latency.merge(other.latency);
+    ok += other.ok;
+    failed += other.failed;
+    bytes += other.bytes;
+}
+
+auto run_load(const load_options& options) -> load_result {
+    // each connection has its own results, so recording does not need any synchronization
+    std::vector<std::unique_ptr<load_result>> results;
+    for (std::size_t i = 0; i < options.connections; ++i) {
+        results.push_back(std::make_unique<load_result>());
+    }
+    const auto end{clock::now() + options.duration};
+
+    if (options.mode == client_mode::sync) {
+        std::vector<std::thread> workers;
+        for (auto& r : results) {
+            workers.emplace_back([&options, end, &r]() {
+                sync_worker(options, end, *r);
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+    } else if (options.mode == client_mode::h2) {
+        comm::runtime_options ro;
+        ro.threads = options.threads;
+        comm::runtime clients{ro};
+        clients.start();
+        // the connections are spread over the contexts as the clients would have been
+        const auto contexts{std::min(clients.size(), results.size())};
+        for (std::size_t i = 0; i < contexts; ++i) {
+            std::vector<load_result*> shared;
+            for (std::size_t j = i; j < results.size(); j += contexts) {
+                shared.push_back(results[j].get());
+            }
+            clients.spawn(i, h2_worker(options, end, std::move(shared)), asio::detached);
+        }
+        clients.drain(options.duration + std::chrono::seconds{30});
+    } else {
+        comm::runtime_options ro;
+        ro.threads = options.threads;
+        comm::runtime clients{ro};
+        clients.start();
+        for (auto& r : results) {
+            clients.spawn(async_worker(options, end, *r), asio::detached);
+        }
+        // leave enough time for the requests that were sent just before the end
+        clients.drain(options.duration + std::chrono::seconds{30});
+    }
+
+    load_result total;
+    for (const auto& r : results) {
+        total.merge(*r);
+    }
+    return total;
+}
+
+}	// end of namespace bench
@@ -0,0 +1,49 @@
+#pragma once
+#include "histogram.hh"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bench {
+
+enum class client_mode {
+    sync,       // the blocking client, a thread and a new connection per request
+    async,      // async_http_client, a new connection per request
+    pool,       // async_http_client with keep alive connections from a pool
+    h2,         // async_http_client over HTTP/2, the clients of a thread share one connection
+    tcp         // async_tcp_read_write with newline terminated messages to the echo server
+};
+
+struct load_options {
+    client_mode mode{client_mode::async};
+    std::string host{"127.0.0.1"};
+    std::string port;
+    std::string resource{"/"};
+    // number of clients that are sending requests at the same time
+    std::size_t connections{16};
+    // io_context threads for the async clients, 0 means one per core
+    std::size_t threads{0};
+    // requests per second over all the connections, 0 means as fast as possible
+    double rate{0};
+    std::chrono::seconds duration{10};
+    // size of the messages that are sent in tcp mode
+    std::size_t message_size{64};
+};
+
+struct load_result {
+    comm::latency_histogram latency;
+    std::uint64_t ok{0};
+    std::uint64_t failed{0};
+    std::uint64_t bytes{0};
+
+    auto record(std::chrono::nanoseconds elapsed, std::size_t received) -> void;
+    auto merge(const load_result& other) -> void;
+};
+
+// Run the load for the duration, and return the results of all the connections.
+// With a fixed rate, the latency is measured from the time the request should have
+// started, so a slow response is also charged to the requests it delayed.
+auto run_load(const load_options& options) -> load_result;
+
+}	// end of namespace bench
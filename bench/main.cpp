@@ -0,0 +1,171 @@
+#include "load.hh"
+#include "server.hh"
+#include "buffer_pool.hh"
+#include "io_backend.hh"
+#include "metrics.hh"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+
+// Count all the allocations of the process, the results include the local server
+namespace {
+std::atomic<std::uint64_t> allocations{0};
+}
+
+auto operator new(std::size_t size) -> void* {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size == 0 ? 1 : size); p) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+auto operator delete(void* p) noexcept -> void {
+    std::free(p);
+}
+
+auto operator delete(void* p, std::size_t) noexcept -> void {
+    std::free(p);
+}
+
+namespace {
+
+struct cpu_time {
+    double user{0};
+    double system{0};
+    // voluntary and involuntary, a thread that blocks in the kernel waiting for IO counts as one
+    long context_switches{0};
+};
+
+auto process_cpu() -> cpu_time {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto seconds = [](const timeval& t) {
+        return static_cast<double>(t.tv_sec) + static_cast<double>(t.tv_usec) / 1'000'000.0;
+    };
+    return cpu_time{seconds(usage.ru_utime), seconds(usage.ru_stime), usage.ru_nvcsw + usage.ru_nivcsw};
+}
+
+auto parse_mode(std::string_view name) -> std::optional<bench::client_mode> {
+    if (name == "sync") {
+        return bench::client_mode::sync;
+    } else if (name == "async") {
+        return bench::client_mode::async;
+    } else if (name == "pool") {
+        return bench::client_mode::pool;
+    } else if (name == "tcp") {
+        return bench::client_mode::tcp;
+    } else if (name == "h2") {
+        return bench::client_mode::h2;
+    }
+    return std::nullopt;
+}
+
+auto usage(const char* name) -> int {
+    std::cout << "Usage: " << name << " [--mode sync|async|pool|h2|tcp] [--connections N] [--rate requests/sec]\n"
+        << "           [--duration seconds] [--threads N] [--size bytes] [--server-threads N]\n"
+        << "           [--host host --port port] [--resource path] [--metrics on|off]\n"
+        << "Without --host the requests are sent to a local server that is started by the benchmark,\n"
+        << "--size is the size of the response body (or of the message in tcp mode)\n"
+        << "in h2 mode the clients of each thread send their requests over a single HTTP/2 connection\n"
+        << "--metrics on prints the per stage metrics of the client in the Prometheus format at the end\n";
+    return 1;
+}
+
+}		// end of local namespace
+
+int main(int argc, char* argv[]) {
+    bench::load_options options;
+    std::size_t body_size{1'024};
+    std::size_t server_threads{2};
+
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            const std::string_view arg{argv[i]};
+            if (i + 1 >= argc) {
+                return usage(argv[0]);
+            }
+            const std::string value{argv[i + 1]};
+            if (arg == "--mode") {
+                const auto m = parse_mode(value);
+                if (!m) {
+                    return usage(argv[0]);
+                }
+                options.mode = *m;
+            } else if (arg == "--connections") {
+                options.connections = std::stoul(value);
+            } else if (arg == "--rate") {
+                options.rate = std::stod(value);
+            } else if (arg == "--duration") {
+                options.duration = std::chrono::seconds{std::stol(value)};
+            } else if (arg == "--threads") {
+                options.threads = std::stoul(value);
+            } else if (arg == "--size") {
+                body_size = std::stoul(value);
+            } else if (arg == "--server-threads") {
+                server_threads = std::stoul(value);
+            } else if (arg == "--host") {
+                options.host = value;
+            } else if (arg == "--port") {
+                options.port = value;
+            } else if (arg == "--resource") {
+                options.resource = value;
+            } else if (arg == "--metrics") {
+                comm::metrics::enable(value == "on");
+            } else {
+                return usage(argv[0]);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "invalid argument: " << e.what() << "\n";
+        return usage(argv[0]);
+    }
+    options.message_size = body_size;
+
+    std::optional<bench::local_server> server;
+    if (options.port.empty()) {
+        server.emplace(body_size, server_threads);
+        server->start();
+        options.host = "127.0.0.1";
+        options.port = std::to_string(options.mode == bench::client_mode::tcp ? server->echo_port() :
+                options.mode == bench::client_mode::h2 ? server->h2_port() : server->http_port());
+    }
+
+    const auto allocations_before{allocations.load()};
+    const auto cpu_before{process_cpu()};
+    const auto started{std::chrono::steady_clock::now()};
+    const auto result{bench::run_load(options)};
+    const std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - started};
+    const auto cpu_after{process_cpu()};
+    const auto allocated{allocations.load() - allocations_before};
+    if (server) {
+        server->stop();
+    }
+
+    const auto requests{result.ok + result.failed};
+    std::cout << std::fixed << std::setprecision(2)
+        << "io backend:  " << comm::io_backend_name() << "\n"
+        << "target:      " << options.host << ":" << options.port << options.resource << "\n"
+        << "connections: " << options.connections << ", rate: " << (options.rate > 0 ? std::to_string(options.rate) : std::string{"unlimited"})
+        << ", duration: " << elapsed.count() << "s\n"
+        << "requests:    " << result.ok << " ok, " << result.failed << " failed\n"
+        << "throughput:  " << static_cast<double>(result.ok) / elapsed.count() << " requests/s, "
+        << static_cast<double>(result.bytes) / elapsed.count() / (1'024.0 * 1'024.0) << " MiB/s\n"
+        << "latency:     " << result.latency << "\n"
+        << "cpu:         user " << cpu_after.user - cpu_before.user << "s, system " << cpu_after.system - cpu_before.system << "s, "
+        << cpu_after.context_switches - cpu_before.context_switches << " context switches\n"
+        << "allocations: " << allocated << ", per request: "
+        << (requests == 0 ? 0.0 : static_cast<double>(allocated) / static_cast<double>(requests)) << "\n"
+        << "buffer pool: " << comm::buffer_pool_statistics() << "\n";
+    if (comm::metrics::enabled()) {
+        comm::metrics::write_prometheus(std::cout);
+    }
+    return result.failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,288 @@
+#include "server.hh"
+#include "h2_frame.hh"
+#include "hpack.hh"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+namespace bench {
+namespace {
+
+auto workers(std::size_t threads) -> comm::runtime_options {
+    comm::runtime_options options;
+    options.threads = std::max<std::size_t>(threads, 1);
+    return options;
+}
+
+auto local_options() -> comm::server_options {
+    comm::server_options options;
+    options.address = "127.0.0.1";
+    return options;
+}
+
+auto listen_local(asio::io_context& context) -> tcp::acceptor {
+    return tcp::acceptor{context, tcp::endpoint{asio::ip::address_v4::loopback(), 0}};
+}
+
+namespace h2 = comm::h2;
+
+// The state of an h2c connection on the server side. Frames are handled as they arrive, and what
+// they call for is added to the output, that the session sends once it has handled all the frames
+// of a read. The responses are sent as far as the windows of the client allow, and the rest after
+// its WINDOW_UPDATE. The request headers are decoded, to keep the table in sync, but ignored.
+class h2_exchange {
+public:
+    explicit h2_exchange(const std::string& body) : body_{body} {
+        const std::array<std::pair<h2::setting, std::uint32_t>, 1> settings{{
+            {h2::setting::max_concurrent_streams, MAX_STREAMS}
+        }};
+        h2::append_settings(output_, settings);
+    }
+
+    // false once the connection should be closed
+    auto on_frame(const h2::frame& f) -> bool {
+        if (header_stream_ != 0 && (f.header.type != h2::frame_type::continuation || f.header.stream != header_stream_)) {
+            return false;
+        }
+        switch (f.header.type) {
+            case h2::frame_type::headers: {
+                const auto content{h2::frame_content(f)};
+                if (!content) {
+                    return false;
+                }
+                header_block_.assign(reinterpret_cast<const char*>(content->data()), content->size());
+                header_end_stream_ = f.header.has(h2::flags::END_STREAM);
+                header_stream_ = f.header.stream;
+                return !f.header.has(h2::flags::END_HEADERS) || headers_done();
+            }
+            case h2::frame_type::continuation:
+                header_block_.append(reinterpret_cast<const char*>(f.payload.data()), f.payload.size());
+                return !f.header.has(h2::flags::END_HEADERS) || headers_done();
+            case h2::frame_type::data:
+                return on_data(f);
+            case h2::frame_type::settings:
+                return f.header.has(h2::flags::ACK) || on_settings(f);
+            case h2::frame_type::window_update:
+                if (f.payload.size() != 4) {
+                    return false;
+                }
+                on_window_update(f.header.stream, h2::read_u32(f.payload) & h2::MAX_WINDOW);
+                return true;
+            case h2::frame_type::ping:
+                if (f.payload.size() != 8) {
+                    return false;
+                }
+                if (!f.header.has(h2::flags::ACK)) {
+                    h2::append_ping(output_, f.payload, true);
+                }
+                return true;
+            case h2::frame_type::rst_stream:
+                std::erase_if(responses_, [&](const response& r) {
+                    return r.stream == f.header.stream;
+                });
+                std::erase(requests_, f.header.stream);
+                return true;
+            case h2::frame_type::goaway:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    // add the frames of the responses that the windows allow to the output, and take the output
+    auto flush() -> std::string& {
+        for (auto& r : responses_) {
+            if (!r.headers_sent) {
+                std::string block;
+                encoder_.encode(":status", "200", block);
+                encoder_.encode("content-type", "text/plain", block);
+                encoder_.encode("content-length", std::to_string(body_.size()), block);
+                h2::append_headers(output_, r.stream, block, body_.empty(), max_frame_);
+                r.headers_sent = true;
+            }
+            while (r.sent < body_.size() && r.window > 0 && window_ > 0) {
+                const auto n{std::min<std::size_t>({body_.size() - r.sent, max_frame_,
+                        static_cast<std::size_t>(r.window), static_cast<std::size_t>(window_)})};
+                const auto last{r.sent + n == body_.size()};
+                h2::append_frame_header(output_, static_cast<std::uint32_t>(n), h2::frame_type::data, last ? h2::flags::END_STREAM : 0, r.stream);
+                output_.append(body_, r.sent, n);
+                r.sent += n;
+                r.window -= static_cast<std::int64_t>(n);
+                window_ -= static_cast<std::int64_t>(n);
+            }
+        }
+        std::erase_if(responses_, [&](const response& r) {
+            return r.headers_sent && r.sent == body_.size();
+        });
+        return output_;
+    }
+
+private:
+    static constexpr std::uint32_t MAX_STREAMS{256};
+
+    struct response {
+        std::uint32_t stream;
+        std::int64_t window;
+        std::size_t sent{0};
+        bool headers_sent{false};
+    };
+
+    auto headers_done() -> bool {
+        const auto stream{std::exchange(header_stream_, 0)};
+        if (!decoder_.decode(std::as_bytes(std::span{header_block_.data(), header_block_.size()}))) {
+            return false;
+        }
+        if (header_end_stream_) {
+            responses_.push_back(response{stream, initial_window_});
+        } else {
+            requests_.push_back(stream);
+        }
+        return true;
+    }
+
+    // the request body is dropped, and the credit for it is given back right away
+    auto on_data(const h2::frame& f) -> bool {
+        const auto length{static_cast<std::uint32_t>(f.payload.size())};
+        if (length > 0) {
+            h2::append_window_update(output_, 0, length);
+        }
+        if (!f.header.has(h2::flags::END_STREAM)) {
+            if (length > 0) {
+                h2::append_window_update(output_, f.header.stream, length);
+            }
+            return true;
+        }
+        if (const auto found{std::find(requests_.begin(), requests_.end(), f.header.stream)}; found != requests_.end()) {
+            requests_.erase(found);
+            responses_.push_back(response{f.header.stream, initial_window_});
+        }
+        return true;
+    }
+
+    auto on_settings(const h2::frame& f) -> bool {
+        if (f.payload.size() % 6 != 0) {
+            return false;
+        }
+        for (auto values = f.payload; !values.empty(); values = values.subspan(6)) {
+            const auto id{static_cast<h2::setting>((static_cast<std::uint16_t>(values[0]) << 8) | static_cast<std::uint16_t>(values[1]))};
+            const auto value{h2::read_u32(values.subspan(2))};
+            if (id == h2::setting::initial_window_size) {
+                for (auto& r : responses_) {
+                    r.window += static_cast<std::int64_t>(value) - initial_window_;
+                }
+                initial_window_ = value;
+            } else if (id == h2::setting::max_frame_size) {
+                max_frame_ = value;
+            }
+        }
+        h2::append_settings_ack(output_);
+        return true;
+    }
+
+    auto on_window_update(std::uint32_t stream, std::uint32_t increment) -> void {
+        if (stream == 0) {
+            window_ += increment;
+            return;
+        }
+        for (auto& r : responses_) {
+            if (r.stream == stream) {
+                r.window += increment;
+            }
+        }
+    }
+
+    const std::string& body_;
+    comm::hpack::encoder encoder_;
+    comm::hpack::decoder decoder_;
+    std::string output_;
+    std::vector<response> responses_;
+    std::vector<std::uint32_t> requests_;   // streams that are still sending their body
+    std::string header_block_;
+    std::uint32_t header_stream_{0};
+    bool header_end_stream_{false};
+    std::int64_t window_{h2::DEFAULT_WINDOW};
+    std::int64_t initial_window_{h2::DEFAULT_WINDOW};
+    std::uint32_t max_frame_{h2::DEFAULT_MAX_FRAME};
+};
+
+}		// end of local namespace
+
+local_server::local_server(std::size_t body_size, std::size_t threads) :
+        runtime_{workers(threads)}, http_{runtime_, local_options()}, echo_{runtime_, local_options()},
+        h2_{listen_local(runtime_.context(0))}, body_(body_size, 'x') {
+}
+
+local_server::~local_server() {
+    stop();
+}
+
+auto local_server::start() -> void {
+    const auto http_started{http_.start(comm::serve_http([this](const comm::server_request&) -> asio::awaitable<comm::http_reply> {
+        comm::http_reply reply;
+        reply.body = body_;
+        co_return reply;
+    }))};
+    const auto echo_started{echo_.start(comm::serve_messages("\n", [](std::string_view message) -> asio::awaitable<std::string> {
+        co_return std::string{message};
+    }))};
+    if (!(http_started && echo_started)) {
+        throw std::runtime_error{"failed to start the local server"};
+    }
+    runtime_.spawn(0, accept_h2(), asio::detached);
+    runtime_.start();
+}
+
+// the servers are stopped before the runtime, as their acceptors keep the contexts busy
+auto local_server::stop() -> void {
+    http_.stop();
+    echo_.stop();
+    runtime_.stop();
+    runtime_.join();
+}
+
+auto local_server::accept_h2() -> asio::awaitable<void> {
+    while (true) {
+        const auto target{runtime_.next()};
+        tcp::socket socket{runtime_.context(target)};
+        auto [e] = co_await h2_.async_accept(socket, asio::as_tuple(asio::use_awaitable));
+        if (e) {
+            co_return;
+        }
+        socket.set_option(tcp::no_delay{true});
+        runtime_.spawn(target, h2_session(std::move(socket)), asio::detached);
+    }
+}
+
+auto local_server::h2_session(tcp::socket socket) -> asio::awaitable<void> {
+    std::array<char, h2::PREFACE.size()> preface{};
+    auto [e, n] = co_await asio::async_read(socket, asio::buffer(preface), asio::as_tuple(asio::use_awaitable));
+    if (e || std::string_view{preface.data(), preface.size()} != h2::PREFACE) {
+        co_return;
+    }
+    h2::frame_reader reader{socket};
+    h2_exchange exchange{body_};
+    bool open{true};
+    while (open) {
+        // the output is sent when there are no more frames to handle without reading
+        if (reader.buffered() == 0) {
+            auto& output{exchange.flush()};
+            if (!output.empty()) {
+                auto [we, written] = co_await asio::async_write(socket, asio::buffer(output), asio::as_tuple(asio::use_awaitable));
+                if (we) {
+                    co_return;
+                }
+                output.clear();
+            }
+        }
+        auto f = co_await reader.next();
+        open = f && exchange.on_frame(*f);
+    }
+    if (auto& output{exchange.flush()}; !output.empty()) {
+        co_await asio::async_write(socket, asio::buffer(output), asio::as_tuple(asio::use_awaitable));
+    }
+    boost::system::error_code ignore;
+    socket.shutdown(tcp::socket::shutdown_send, ignore);
+}
+
+}	// end of namespace bench
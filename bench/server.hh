@@ -0,0 +1,53 @@
+#pragma once
+#include "network_fwd.hh"
+#include "runtime.hh"
+#include "tcp_server.hh"
+#include <cstddef>
+#include <string>
+
+namespace bench {
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+// A local server for the benchmark, so we do not depend on external services:
+// an HTTP/1.1 server that answers every request with a fixed body (keep alive is
+// supported), the same over HTTP/2 (h2c with prior knowledge), and a TCP echo server
+// for newline terminated messages. The HTTP/1.1 and echo servers are comm::tcp_server,
+// so the benchmark measures the server of the library as well, and all of them run on
+// the contexts of a comm::runtime of their own.
+// All of them listen on 127.0.0.1 on a port that the system picks.
+class local_server {
+public:
+    local_server(std::size_t body_size, std::size_t threads);
+    local_server(const local_server&) = delete;
+    auto operator = (const local_server&) -> local_server& = delete;
+    ~local_server();
+
+    auto start() -> void;
+    auto stop() -> void;
+
+    auto http_port() const -> unsigned short {
+        return http_.port();
+    }
+
+    auto echo_port() const -> unsigned short {
+        return echo_.port();
+    }
+
+    auto h2_port() const -> unsigned short {
+        return h2_.local_endpoint().port();
+    }
+
+private:
+    auto accept_h2() -> asio::awaitable<void>;
+    auto h2_session(tcp::socket socket) -> asio::awaitable<void>;
+
+    comm::runtime runtime_;
+    comm::tcp_server http_;
+    comm::tcp_server echo_;
+    tcp::acceptor h2_;
+    std::string body_;
+};
+
+}	// end of namespace bench
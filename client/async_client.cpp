@@ -1,12 +1,22 @@
 #include "async_client.hh"
+#include "buffer_pool.hh"
+#include "connection_pool.hh"
+#include "deadline.hh"
+#include "dns_cache.hh"
+#include "http_reader.hh"
+#include "io_backend.hh"
+#include "metrics.hh"
+#include "runtime.hh"
 #include "log/logging.hh"
+#include <array>
 #include <iostream>
 #include <vector>
 #include <optional>
 #include <sstream>
+#include <tuple>
+#include <type_traits>
 #include <boost/asio/experimental/awaitable_operators.hpp>
 #include <boost/asio/signal_set.hpp>
-#include <boost/algorithm/string.hpp>
 
 
 namespace comm {
@@ -18,25 +28,12 @@ using asio::detached;
 using default_token = asio::deferred_t;
 namespace this_coro = asio::this_coro;
 using boost::asio::use_awaitable;
+using clock = request_deadlines::clock;
 
 
 static std::atomic_int tid_gen = 0;
 thread_local int const tid     = ++tid_gen;
 
-static constexpr auto parse_len = [](const std::string& headers) {
-    std::string entry;
-    std::istringstream inputs(headers);
-    std::string line;
-    while (std::getline(inputs, line)) {      
-      if (auto i = line.find_first_of(':'); i != std::string::npos) {
-        if (boost::algorithm::icontains(line.substr(0, i), "Content-Length")) {
-          return std::stol(line.substr(i+1));
-        }
-      }
-    }
-    return 0l;
-};
-
 auto tcp_async_send(tcp::socket& with_socket, const auto& raw_out_msg) -> asio::awaitable<std::size_t> {
   assert(!raw_out_msg.empty());
 
@@ -58,164 +55,174 @@ auto tcp_async_send(tcp::socket& with_socket, const auto& raw_out_msg) -> asio::
     co_return s;
 }
 
-auto read_body(tcp::socket& socket, long len ) -> asio::awaitable<std::string> {
-  try {
-      // consume the headers as a all
-      std::string buffer(len, '\0');
-      std::size_t r{0};
-      while (r < len) {
-        auto [e, n] = co_await socket.async_read_some(
-              asio::buffer(buffer, buffer.size()),
-              boost::asio::as_tuple(boost::asio::use_awaitable)
-        );
-        r += n;
-        if (!e) {          
-          if (r >= len) {
-            buffer.resize(len);
-          }
-          co_return buffer;
-        } else {
-            if (e != boost::asio::error::eof) {
-                LOG(ERROR) << "error: got and error while trying to read headers " <<   e.message() << ENDL;                
-            } else {
-              if (n == len) {
-                co_return buffer;
-              }
-            }
-            socket.close();
-            co_return std::string{};
-        }
-      }
-    } catch (const std::exception& e) {
-      LOG(ERROR) << "critical error while reading from socket " << e.what() << ENDL;
-      socket.close();
-    }
-    co_return std::string{};
-}
-
-auto async_read_title(tcp::socket& socket, std::string& input) -> asio::awaitable<bool> {
-    
-    try {
-      // consume the headers as a all
-      auto [e, n] = co_await boost::asio::async_read_until(socket,
-            asio::dynamic_buffer(input), "\r\n\r\n",
-            boost::asio::as_tuple(boost::asio::use_awaitable)
-      );      
-      if (!e) {
-          if (!input.empty()) {
-            co_return true;
-          }
-      } else {
-          if (e != boost::asio::error::eof) {
-              LOG(ERROR) << "error: got and error while trying to read headers " <<   e.message() << ENDL;
-          } else {
-            LOG(ERROR) << "error: EOF while reading header" << ENDL;
-          }
-          socket.close();
-          co_return false;
-      }
-    } catch (const std::exception& e) {
-      LOG(ERROR) << "critical error while reading from socket " << e.what() << ENDL;
-      socket.close();
+// extra_headers are sent as is, each of them must end with \r\n
+auto send_get(tcp::socket& socket, const std::string& host, const std::string& resource, bool keep_alive,
+              body_encoding encoding = body_encoding::identity, std::string_view extra_headers = {}) -> asio::awaitable<bool> {
+    using namespace std::string_view_literals;
+
+    // the request is sent as is from its parts, with a single gather write
+    const std::array<asio::const_buffer, 8> message{
+        asio::buffer("GET "sv), asio::buffer(resource),
+        asio::buffer(" HTTP/1.1\r\nHost: "sv), asio::buffer(host),
+        asio::buffer("\r\nAccept: */*\r\n"sv),
+        asio::buffer(encoding == body_encoding::compressed ? "Accept-Encoding: gzip, deflate\r\n"sv : ""sv),
+        asio::buffer(extra_headers),
+        asio::buffer(keep_alive ? "Connection: keep-alive\r\n\r\n"sv : "Connection: close\r\n\r\n"sv)
+    };
+
+    metrics::stage_timer timer{metrics::stage::send};
+    auto s = co_await  boost::asio::async_write(socket, message, boost::asio::use_awaitable);
+    if (s != asio::buffer_size(message)) {
+        LOG(ERROR) << "error: failed to send request header for " << host << resource << ENDL;
+        timer.cancel();
+        socket.close();
+        co_return false;
     }
-    co_return false;
+    metrics::add(metrics::counter::bytes_sent, s);
+    co_return true;
 }
 
-auto async_send_read(tcp::socket& socket, const std::string& host, const std::string& resource) -> asio::awaitable<std::string> {
-    using namespace std::string_literals;
-
-    static constexpr std::size_t FRAME_SIZE{1'024 * 64};
-    auto executor = co_await this_coro::executor;
-
+// Send GET request and read the response body. On failure this returns nullopt, and if
+// the connection cannot be used any more, the socket is closed.
+// With keep alive, the socket is left open unless the server asked to close it.
+// The request must be done by started + deadlines.total, and it must be sent and the headers
+// must arrive within deadlines.first_byte, otherwise it is cancelled, and the socket is closed.
+// With a compressed encoding the body is returned decompressed.
+// When response is given, the status and the headers are stored in it as well.
+auto async_send_read(tcp::socket& socket, const std::string& host, const std::string& resource, bool keep_alive,
+                     const request_deadlines& deadlines, clock::time_point started, body_encoding encoding,
+                     std::string_view extra_headers = {}, http_response* response = nullptr) -> asio::awaitable<std::optional<std::string>> {
+    const auto end{started + deadlines.total};
+    metrics::add(metrics::counter::requests);
+    metrics::stage_timer whole{metrics::stage::request};
+    auto failed = [&whole]() {
+        whole.cancel();
+        metrics::add(metrics::counter::failures);
+        return std::nullopt;
+    };
+    auto expired = [&](const char* what) {
+        LOG(WARNING) << "timeout while " << what << " " << host << resource << ENDL;
+        boost::system::error_code ec;
+        socket.close(ec);
+        metrics::add(metrics::counter::timeouts);
+        return failed();
+    };
 
     try {
-        const std::string message{
-            "GET "s + resource + " HTTP/1.1\r\n"s +
-            "Host: "s +  host + "\r\n" +
-            "Accept: */*\r\n"s +
-            "Connection: close\r\n\r\n"s
-         };
-
-        auto s = co_await  boost::asio::async_write(socket, boost::asio::buffer(message, message.size()), boost::asio::use_awaitable);
-        if (s != message.size()) {
-            co_return "error: failed to send image header "s + message;
+        // sending the request and reading the headers share the first byte limit
+        const auto first_byte{std::min(clock::now() + deadlines.first_byte, end)};
+        const auto sent = co_await with_deadline(send_get(socket, host, resource, keep_alive, encoding, extra_headers), first_byte);
+        if (!sent) {
+          co_return expired("sending request to");
+        }
+        if (!*sent) {
+          co_return failed();
         }
 
         // read what the server sent
-        std::string headers;
-        const auto r = co_await async_read_title(socket, headers);
-        if (r) {
-          const auto len{parse_len(headers)};
-          if (len == 0) {
-            co_return "missing length in message"s;
-          }
-          // now we are ready to read the body
-          
-          auto body = co_await read_body(socket, len);
-          co_return body;
-        } else {
+        response_reader reader(socket);
+        metrics::stage_timer headers{metrics::stage::headers};
+        const auto head = co_await with_deadline(reader.read_head(), first_byte);
+        if (!head) {
+          headers.cancel();
+          co_return expired("waiting for the response headers from");
+        }
+        if (!*head) {
           LOG(ERROR) << "failed to read the headers!!" << ENDL;
-          co_return "error reading headers"s;
+          headers.cancel();
+          co_return failed();
         }
+        headers.stop();
+        if (response) {
+          // the offsets of the parser are from the start of the head, so they are valid for the copy as well
+          response->head.assign(reader.head());
+          response->parser = reader.parser();
+        }
+        metrics::stage_timer reading{metrics::stage::body};
+        auto body = co_await with_deadline(encoding == body_encoding::compressed ? reader.read_decoded_body() : reader.read_body(), end);
+        if (!body) {
+          reading.cancel();
+          co_return expired("reading the response body from");
+        }
+        if (!*body) {
+          reading.cancel();
+          co_return failed();
+        }
+        reading.stop();
+        metrics::add(metrics::counter::bytes_received, reader.head().size() + (*body)->size());
+        if (!(keep_alive && reader.reusable())) {
+          boost::system::error_code ec;
+          socket.close(ec);
+        }
+        co_return std::move(*body);
     } catch (const std::exception& e) {
-      socket.close();
-        co_return "error: while sending over by client "s 
-            + ":" + std::to_string(socket.local_endpoint().port()) + " - " + e.what();
-        
+        LOG(ERROR) << "error: while sending over by client " << e.what() << ENDL;
+        boost::system::error_code ec;
+        socket.close(ec);
     }
-    co_return "error"s;
+    co_return failed();
 }
 
-auto read_from_server(tcp::socket& socket, std::span<uint8_t>& payload) -> asio::awaitable<size_t> {
-  static const size_t MAX_BUFFER{1'024 * 64};
-  std::array<uint8_t, MAX_BUFFER> data;
-
-  auto size{payload.size()};
-
-  auto read_into = [&payload, &data] (auto leftover, auto n) {
-      if (n == 0) {
-          return leftover;
-      }
-      const auto s{std::min(n, leftover)};
-      const auto loc{(payload.size() - leftover)};
-      std::copy(data.begin(), data.begin() + s, payload.begin() + loc);
-      return leftover - s;
-  };
-
-  auto to_read = std::min(MAX_BUFFER, size);
-  size_t total{0};
-  while (socket.is_open() && size != 0) {        
-      auto [e, n] = co_await socket.async_read_some(boost::asio::buffer(data, to_read),
-                                  boost::asio::as_tuple(boost::asio::use_awaitable));
-      total += n;
-      if (e) {
-          if (e != boost::asio::error::eof) {
-              LOG(ERROR) << "error reading from socket: " << e.message() << ENDL;
-          }
-          socket.close();
-          co_return 0;                   
-      } else {
-          size = read_into(size, n);
-          to_read = std::min(MAX_BUFFER, size);
-      }
+// Read straight into the caller's memory until all the buffers are full, there is no
+// intermediate buffer in the coroutine frame and no copy. Return 0 on failure
+auto read_from_server(tcp::socket& socket, auto buffers) -> asio::awaitable<size_t> {
+  const auto size{asio::buffer_size(buffers)};
+  if (!socket.is_open() || size == 0) {
+    co_return 0;
   }
-  
-  co_return total;
+  metrics::stage_timer timer{metrics::stage::read};
+  boost::system::error_code e;
+  std::size_t n{0};
+  if constexpr (IO_URING && std::is_convertible_v<decltype(buffers), asio::mutable_buffer>) {
+    // one receive that the kernel completes when the buffer is full, it is
+    // only short if the connection was closed or a signal interrupted it
+    const asio::mutable_buffer into{buffers};
+    while (!e && n < size) {
+      auto [re, rn] = co_await socket.async_receive(into + n, WAIT_ALL, asio::as_tuple(asio::use_awaitable));
+      e = re;
+      n += rn;
+    }
+  } else {
+    std::tie(e, n) = co_await asio::async_read(socket, buffers, asio::transfer_exactly(size),
+                              asio::as_tuple(asio::use_awaitable));
+  }
+  if (e) {
+    if (e != asio::error::eof) {
+      LOG(ERROR) << "error reading from socket: " << e.message() << ENDL;
+    }
+    timer.cancel();
+    metrics::add(metrics::counter::failures);
+    socket.close();
+    co_return 0;
+  }
+  metrics::add(metrics::counter::bytes_received, n);
+  co_return n;
 }
 
+// Run a raw TCP operation, if it is not done by the timeout it is cancelled, the socket is closed and this returns 0
+auto timed_io(tcp::socket& socket, asio::awaitable<size_t> op, std::chrono::milliseconds timeout) -> asio::awaitable<size_t> {
+  const auto n = co_await with_deadline(std::move(op), clock::now() + timeout);
+  if (!n) {
+    LOG(WARNING) << "I/O operation did not finish after " << timeout.count() << "ms, closing the connection" << ENDL;
+    boost::system::error_code ec;
+    socket.close(ec);
+    co_return 0;
+  }
+  co_return *n;
+}
 
 }		// end of local namespace
 
-auto async_tcp_read_write(tcp::socket& with_socket, const std::span<uint8_t> raw_out_msg, std::span<uint8_t>& results) -> asio::awaitable<size_t> {
+auto async_tcp_read_write(tcp::socket& with_socket, const std::span<uint8_t> raw_out_msg, std::span<uint8_t>& results, std::chrono::milliseconds timeout) -> asio::awaitable<size_t> {
   assert(!results.empty());
 
   try {
-    auto s = co_await tcp_async_send(with_socket, raw_out_msg);
+    auto s = co_await timed_io(with_socket, tcp_async_send(with_socket, raw_out_msg), timeout);
     if (s == 0) {
       co_return 0;
     }
     // now try to read from the remote host the message, we "know" what should be the message, so we have a buffer ready for that
-    co_return co_await read_from_server(with_socket, results);
+    co_return co_await timed_io(with_socket, read_from_server(with_socket, asio::buffer(results.data(), results.size())), timeout);
   } catch (const std::exception& e) {
     LOG(ERROR) << "critical error while trying to send/receive from "
             << with_socket.remote_endpoint().address()
@@ -227,9 +234,45 @@ auto async_tcp_read_write(tcp::socket& with_socket, const std::span<uint8_t> raw
 
 }
 
-auto async_tcp_read(tcp::socket& with_socket, std::span<uint8_t>& results) -> asio::awaitable<size_t> {
+auto async_tcp_send(tcp::socket& with_socket, std::string_view raw_out_msg, std::chrono::milliseconds timeout) -> asio::awaitable<size_t> {
+  co_return co_await timed_io(with_socket, tcp_async_send(with_socket, raw_out_msg), timeout);
+}
+
+auto async_tcp_send(tcp::socket& with_socket, std::span<const asio::const_buffer> raw_out_msg, std::chrono::milliseconds timeout) -> asio::awaitable<size_t> {
+  if (!with_socket.is_open()) {
+    LOG(WARNING) << "trying to send to closed connection" << ENDL;
+    co_return 0;
+  }
+  auto write = [&]() -> asio::awaitable<size_t> {
+    const auto size{asio::buffer_size(raw_out_msg)};
+    auto [e, s] = co_await asio::async_write(with_socket, raw_out_msg, asio::as_tuple(asio::use_awaitable));
+    if (e || s != size) {
+      LOG(ERROR) << "failed to send message size " << size << ": " << e.message() << ENDL;
+      boost::system::error_code ec;
+      with_socket.close(ec);
+      co_return 0;
+    }
+    co_return s;
+  };
+  co_return co_await timed_io(with_socket, write(), timeout);
+}
+
+auto async_tcp_read(tcp::socket& with_socket, std::span<uint8_t>& results, std::chrono::milliseconds timeout) -> asio::awaitable<size_t> {
+  try  {
+    co_return co_await timed_io(with_socket, read_from_server(with_socket, asio::buffer(results.data(), results.size())), timeout);
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "critical error while trying to receive from "
+            << with_socket.remote_endpoint().address()
+            << ":" << with_socket.remote_endpoint().port()
+            << ": " << e.what() << ENDL;
+    with_socket.close();
+    co_return 0;
+  }
+}
+
+auto async_tcp_read(tcp::socket& with_socket, std::span<const asio::mutable_buffer> results, std::chrono::milliseconds timeout) -> asio::awaitable<size_t> {
   try  {
-    co_return co_await read_from_server(with_socket, results);
+    co_return co_await timed_io(with_socket, read_from_server(with_socket, results), timeout);
   } catch (const std::exception& e) {
     LOG(ERROR) << "critical error while trying to receive from "
             << with_socket.remote_endpoint().address()
@@ -240,76 +283,147 @@ auto async_tcp_read(tcp::socket& with_socket, std::span<uint8_t>& results) -> as
   }
 }
 
-auto async_http_client(tcp::socket& with_socket, const std::string& host, const std::string& resource) -> asio::awaitable<std::string> {
-  auto r = co_await async_send_read(with_socket, host, resource);
-  co_return r;
+auto async_http_client(tcp::socket& with_socket, const std::string& host, const std::string& resource, const request_deadlines& deadlines,
+                       body_encoding encoding) -> asio::awaitable<std::string> {
+  auto r = co_await async_send_read(with_socket, host, resource, false, deadlines, clock::now(), encoding);
+  co_return r.value_or(std::string{});
 }
 
-auto async_http_client(std::string host, std::string port, std::string resource) -> asio::awaitable<std::string> {
-  auto executor = co_await this_coro::executor;
-  LOG(INFO) << "trying to collect and read from client " << host << ":" << port <<std::endl;
-  auto make_connection = [executor](auto& host, auto& port) -> std::optional<tcp::socket>{
-    tcp::resolver resolver(executor);
-    tcp::resolver::query query(host, port);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-    tcp::socket socket(executor);
+auto async_http_stream(tcp::socket& with_socket, const std::string& host, const std::string& resource, body_handler on_body, bool keep_alive,
+                       const request_deadlines& deadlines, body_encoding encoding) -> asio::awaitable<unsigned int> {
+  const auto end{clock::now() + deadlines.total};
+  try {
+    const auto first_byte{std::min(clock::now() + deadlines.first_byte, end)};
+    const auto sent = co_await with_deadline(send_get(with_socket, host, resource, keep_alive, encoding), first_byte);
+    if (!sent.value_or(false)) {
+      with_socket.close();
+      co_return 0;
+    }
+    response_reader reader(with_socket);
+    const auto head = co_await with_deadline(reader.read_head(), first_byte);
+    if (!head.value_or(false)) {
+      LOG(WARNING) << "failed or timeout reading response headers from " << host << resource << ENDL;
+      with_socket.close();
+      co_return 0;
+    }
+    const auto ok = (co_await with_deadline(encoding == body_encoding::compressed ? reader.read_decoded_body(on_body) : reader.read_body(on_body), end)).value_or(false);
+    if (!(keep_alive && reader.reusable())) {
+      boost::system::error_code ec;
+      with_socket.close(ec);
+    }
+    co_return ok ? reader.status_code() : 0;
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "error: while streaming response from " << host << resource << ": " << e.what() << ENDL;
     boost::system::error_code ec;
-    boost::asio::connect(socket, endpoint_iterator, ec);
-    if (!ec) {
-      return std::optional<tcp::socket>(std::move(socket));
+    with_socket.close(ec);
+  }
+  co_return 0;
+}
+
+auto async_http_client(connection_pool& pool, std::string host, std::string port, std::string resource, request_deadlines deadlines,
+                       body_encoding encoding) -> asio::awaitable<std::string> {
+  const auto started{clock::now()};
+  // a reused connection may have been closed by the server after we did the health check,
+  // in this case we would try again with a new connection
+  for (auto attempt = 0; attempt < 2; ++attempt) {
+    auto connection = co_await pool.acquire(host, port, deadlines, started);
+    if (!connection) {
+      LOG(ERROR) << "failed to get connection to remote server " << host << ":" << port << ENDL;
+      co_return std::string{};
     }
-    return std::nullopt;
-  };
+    const auto reused{connection.reused()};
+    if (auto r = co_await async_send_read(connection.socket(), host, resource, true, deadlines, started, encoding); r) {
+      co_return std::move(*r);
+    }
+    connection.discard();
+    if (!reused) {
+      break;
+    }
+  }
+  co_return std::string{};
+}
 
-  if (auto socket = make_connection(host, port); socket) {
-    co_return co_await async_http_client(*socket, host, resource);
+auto async_http_client(std::string host, std::string port, std::string resource, request_deadlines deadlines,
+                       body_encoding encoding) -> asio::awaitable<std::string> {
+  LOG(INFO) << "trying to collect and read from client " << host << ":" << port <<std::endl;
+  const auto started{clock::now()};
+  connect_options options;
+  options.deadline = std::min(deadlines.connect, deadlines.total);
+  // the name is resolved with the shared cache, without blocking the io_context
+  if (auto socket = co_await async_connect(host, port, options); socket.is_open()) {
+    auto r = co_await async_send_read(socket, host, resource, false, deadlines, started, encoding);
+    co_return r.value_or(std::string{});
   } else {
     LOG(ERROR) << "failed to connect to remote server " << host << ":" << port << ENDL;
   }
   co_return std::string{};
 }
 
+auto async_http_get(std::string host, std::string port, std::string resource, std::string extra_headers,
+                    request_deadlines deadlines, body_encoding encoding) -> asio::awaitable<http_response> {
+  const auto started{clock::now()};
+  connect_options options;
+  options.deadline = std::min(deadlines.connect, deadlines.total);
+  if (auto socket = co_await async_connect(host, port, options); socket.is_open()) {
+    http_response response;
+    if (auto body = co_await async_send_read(socket, host, resource, false, deadlines, started, encoding, extra_headers, &response); body) {
+      response.body = std::move(*body);
+      co_return response;
+    }
+  } else {
+    LOG(ERROR) << "failed to connect to remote server " << host << ":" << port << ENDL;
+  }
+  co_return http_response{};
+}
+
 auto async_connect(const std::string& host, const std::string& service) -> asio::awaitable<tcp::socket> {
+  co_return co_await async_connect(host, service, connect_options{});
+}
+
+auto async_connect(const std::string& host, const std::string& service, const connect_options& options) -> asio::awaitable<tcp::socket> {
   auto executor = co_await this_coro::executor;
-  tcp::resolver r(executor);
-  tcp::resolver::query q(host, service);
-  tcp::socket s(executor);
-  auto [e, res] = co_await r.async_resolve(q, boost::asio::as_tuple(boost::asio::use_awaitable));
-  if (e) {
+  const auto deadline{clock::now() + options.deadline};
+  metrics::stage_timer resolving{metrics::stage::resolve};
+  auto res = co_await dns_cache::shared().async_resolve(host, service, deadline);
+  if (!res) {
     LOG(ERROR) << "failed to resolve " << host << ":" << service << ENDL;
-    s.close();
-    co_return s;
+    resolving.cancel();
+    co_return tcp::socket{executor};
   }
-  auto [err, rr] = co_await boost::asio::async_connect(s, res, boost::asio::as_tuple(boost::asio::use_awaitable));
-  if (e) {
-    LOG(ERROR) << "connection to " << host << ":" << service << "failed: " << err.message() << ENDL;
-    s.close();
+  resolving.stop();
+  // the connect gets what the lookup left of the deadline
+  auto racing{options};
+  racing.deadline = std::max(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()), std::chrono::milliseconds{0});
+  metrics::stage_timer connecting{metrics::stage::connect};
+  auto s = co_await async_race_connect(*res, racing);
+  if (!s.is_open()) {
+    connecting.cancel();
+    LOG(ERROR) << "connection to " << host << ":" << service << " failed" << ENDL;
+    // the addresses may be stale, next time we would resolve again
+    dns_cache::shared().forget(host, service);
+  } else {
+    tune_socket(s, options.tuning);
   }
   co_return s;
 }
 
 auto async_http_connect_client(std::string host, std::string port, std::string resource) -> asio::awaitable<std::string> {
-  auto executor = co_await this_coro::executor;
-  auto s = co_await async_connect(host, port);
-  if (s.is_open()) {
-    co_return co_await async_send_read(s, host, resource);
-  }
-  co_return std::string{};
+  co_return co_await async_http_client(std::move(host), std::move(port), std::move(resource), request_deadlines{});
 }
 
-auto async_tcp_read_write(tcp::socket& with_socket, const std::string_view raw_out_msg, const std::string_view delimiter) -> asio::awaitable<std::string> {
+auto async_tcp_read_write(tcp::socket& with_socket, const std::string_view raw_out_msg, const std::string_view delimiter, std::chrono::milliseconds timeout) -> asio::awaitable<std::string> {
   
     // now try to read from the remote host the message, we "know" what should be the message, so we have a buffer ready for that
   try {
-    auto s = co_await tcp_async_send(with_socket, raw_out_msg);
+    auto s = co_await timed_io(with_socket, tcp_async_send(with_socket, raw_out_msg), timeout);
     if (s == 0) {
       co_return std::string{};
     }
     std::string answer;
-    auto [e, n] = co_await boost::asio::async_read_until(with_socket,
+    auto [e, n] = (co_await with_deadline(boost::asio::async_read_until(with_socket,
             asio::dynamic_buffer(answer), delimiter,
             boost::asio::as_tuple(boost::asio::use_awaitable)
-      );      
+      ), clock::now() + timeout)).value_or(std::tuple{boost::system::error_code{asio::error::timed_out}, std::size_t{0}});
       if (!e) {
         co_return answer;
       } else {
@@ -331,32 +445,30 @@ auto async_tcp_read_write(tcp::socket& with_socket, const std::string_view raw_o
   }
 }
 
-auto async_clinets(std::string host, std::string port, std::string resource, asio::io_context& ctx) -> asio::awaitable<void> {
-  using namespace boost::asio::experimental::awaitable_operators;
-
-  auto executor = co_await this_coro::executor;
-  const auto [client1, client2] = co_await (
-        co_spawn(executor, async_http_client(host, port, resource), use_awaitable) &&
-        co_spawn(executor, async_http_client(host, port, resource), use_awaitable)
-  );
-  std::cout << "successfully finish waiting for the client to come with an answer:\n";
-  std::cout << "First client:\n" << client1 << "\n--------------------------\n";
-  std::cout << "Second client:\n" << client2 << "\n--------------------------\n";
-  ctx.stop();
-  co_return;
-
+auto async_clinets(std::string host, std::string port, std::string resource, std::size_t index, std::atomic<std::size_t>& failures) -> asio::awaitable<void> {
+  auto body = co_await async_http_client(host, port, resource);
+  if (body.empty()) {
+    LOG(ERROR) << "client " << index << " failed to read from " << host << ":" << port << resource << ENDL;
+    failures.fetch_add(1, std::memory_order_relaxed);
+    co_return;
+  }
+  std::ostringstream output;
+  output << "client " << index << " [thread " << tid << "]:\n" << body << "\n--------------------------\n";
+  std::cout << output.str();
+  recycle_buffer(std::move(body));
 }
 
 auto test_multi_connect(const std::string& host, const std::string& port, const std::string& resource, std::size_t count) -> int {
-
-  asio::io_context ctx;
-  static constexpr auto JOBS{2};
-  static constexpr auto EXECUTERS{3};
-  static constexpr auto WAITS_DEPTH{JOBS * EXECUTERS + 1};
-
-  auto work = boost::asio::make_work_guard(ctx);
-  co_spawn(ctx, async_clinets(host, port, resource, ctx), boost::asio::detached);
-  ctx.run();
-  return 1;
+  std::atomic<std::size_t> failures{0};
+  runtime clients;
+  clients.start();
+  for (std::size_t i = 0; i < count; ++i) {
+    clients.spawn(async_clinets(host, port, resource, i, failures), boost::asio::detached);
+  }
+  clients.drain();
+  std::cout << "successfully finish waiting for " << count - failures << " out of " << count << " clients\n";
+  std::cout << "buffer pool: " << buffer_pool_statistics() << "\n";
+  std::cout << "dns cache: " << dns_cache::shared().stats() << "\n";
+  return failures == 0 ? 0 : -1;
 }
 } // end of namespace async
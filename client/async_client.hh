@@ -1,29 +1,95 @@
 #pragma once
 #include "network_fwd.hh"
+#include "http_reader.hh"
+#include "connector.hh"
+#include "deadline.hh"
+#include <chrono>
+#include <optional>
 #include <span>
 #include <string>
+#include <string_view>
 
 namespace comm {
-    // This is a test function, we are not going to use this in production code    
+class connection_pool;
+
+// All the functions here give up once their deadlines or timeout passed, the operation in progress
+// is cancelled and the socket is closed, so a hung server does not hold resources forever.
+// They can also be cancelled by the caller, by binding a cancellation slot to the completion token
+// that is passed to co_spawn (asio::bind_cancellation_slot), in which case the socket is closed as well.
+
+    // This is a test function, we are not going to use this in production code
+    // it runs `count` clients spread over io_context per core
 auto test_multi_connect(const std::string& host, const std::string& port, const std::string& resource, std::size_t count) -> int;    
     // For this function we are opening the connection with the function from sync_client - connect
-auto async_http_client(tcp::socket& with_socket, const std::string& host, const std::string& resource) -> boost::asio::awaitable<std::string>;
+auto async_http_client(tcp::socket& with_socket, const std::string& host, const std::string& resource, const request_deadlines& deadlines = {},
+                       body_encoding encoding = body_encoding::identity) -> boost::asio::awaitable<std::string>;
     // This function will open a connection and send a GET HTTP request, then handle the response from the server
-auto async_http_client(std::string host, std::string port, std::string resource) -> boost::asio::awaitable<std::string>;
+auto async_http_client(std::string host, std::string port, std::string resource, request_deadlines deadlines = {},
+                       body_encoding encoding = body_encoding::identity) -> boost::asio::awaitable<std::string>;
+
+// Send a GET request and pass the response body to on_body as it arrives, in parts no larger
+// than the read buffer, so memory use does not depend on the size of the body. Both Content-Length
+// and chunked responses are supported. Returns the HTTP status code, or 0 on failure.
+// With body_encoding::compressed the server may send the body with gzip or deflate, and it is
+// decompressed on the way (this is true for the other functions that take the encoding as well)
+auto async_http_stream(tcp::socket& with_socket, const std::string& host, const std::string& resource, body_handler on_body, bool keep_alive = false,
+                       const request_deadlines& deadlines = {}, body_encoding encoding = body_encoding::identity) -> boost::asio::awaitable<unsigned int>;
+
+// Send the GET request over a keep alive connection borrowed from the pool, the connection
+// is returned to the pool once the response was read, unless the server closed it.
+// The time spent waiting for a connection from the pool is limited by the pool options
+auto async_http_client(connection_pool& pool, std::string host, std::string port, std::string resource, request_deadlines deadlines = {},
+                       body_encoding encoding = body_encoding::identity) -> boost::asio::awaitable<std::string>;
+
+// A response with its status line and headers
+struct http_response {
+    std::string head;
+    response_parser parser;
+    std::string body;
+
+    // 0 if the request failed
+    auto status() const -> unsigned int {
+        return parser.status_code();
+    }
+
+    auto header(std::string_view name) const -> std::optional<std::string_view> {
+        return parser.find(head, name);
+    }
+};
+
+// Send a GET request over a new connection, and return the whole response, not only its body.
+// extra_headers are added to the request as is, each of them must end with "\r\n"
+// (for example a conditional request with "If-None-Match: \"v1\"\r\n")
+auto async_http_get(std::string host, std::string port, std::string resource, std::string extra_headers = {},
+                    request_deadlines deadlines = {}, body_encoding encoding = body_encoding::identity) -> boost::asio::awaitable<http_response>;
 
 // This is a fully asynchronous connection as well as all other operations
 auto async_http_connect_client(std::string host, std::string port, std::string resource) -> boost::asio::awaitable<std::string>;
 
-// asynchronous connection is made to remote server
+// asynchronous connection is made to remote server, the name is resolved with dns_cache::shared()
+// and the addresses are tried in parallel (see async_race_connect). The connected socket is set up
+// with options.tuning, by default with TCP_NODELAY. On failure the socket is closed
 auto async_connect(const std::string& host, const std::string& service) -> boost::asio::awaitable<tcp::socket>;
+auto async_connect(const std::string& host, const std::string& service, const connect_options& options) -> boost::asio::awaitable<tcp::socket>;
     // Send TCP message that pass to the server the message in `raw_out_msg` and stores the results in `results`
     // it would also return number of bytes reads, if 0, it means that connection failed!
     // Make sure the connection using function from sync_client - connect.
     // Please note that the result span must points to a valid preallocated memory!!
-auto async_tcp_read_write(tcp::socket& with_socket, const std::span<uint8_t> raw_out_msg, std::span<uint8_t>& results) -> boost::asio::awaitable<size_t>;
+auto async_tcp_read_write(tcp::socket& with_socket, const std::span<uint8_t> raw_out_msg, std::span<uint8_t>& results, std::chrono::milliseconds timeout = DEFAULT_IO_TIMEOUT) -> boost::asio::awaitable<size_t>;
+
+// send the message as is, return the number of bytes sent, 0 on failure
+auto async_tcp_send(tcp::socket& with_socket, std::string_view raw_out_msg, std::chrono::milliseconds timeout = DEFAULT_IO_TIMEOUT) -> boost::asio::awaitable<size_t>;
+// send all the buffers with a single gather write, return the number of bytes sent, 0 on failure
+// to coalesce sends from concurrent coroutines on the same socket use write_queue
+auto async_tcp_send(tcp::socket& with_socket, std::span<const asio::const_buffer> raw_out_msg, std::chrono::milliseconds timeout = DEFAULT_IO_TIMEOUT) -> boost::asio::awaitable<size_t>;
 
-auto async_tcp_read(tcp::socket& with_socket, std::span<uint8_t>& results) -> boost::asio::awaitable<size_t>;
+// Read exactly results.size() bytes, directly into the memory of results.
+// Return the number of bytes read, 0 on failure
+auto async_tcp_read(tcp::socket& with_socket, std::span<uint8_t>& results, std::chrono::milliseconds timeout = DEFAULT_IO_TIMEOUT) -> boost::asio::awaitable<size_t>;
+// Read until all the buffers are full, for example the header and the payload of a message
+// into separate places. Return the number of bytes read, 0 on failure
+auto async_tcp_read(tcp::socket& with_socket, std::span<const asio::mutable_buffer> results, std::chrono::milliseconds timeout = DEFAULT_IO_TIMEOUT) -> boost::asio::awaitable<size_t>;
 
-auto async_tcp_read_write(tcp::socket& with_socket, const std::string_view raw_out_msg, const std::string_view delimiter) -> boost::asio::awaitable<std::string>;
+auto async_tcp_read_write(tcp::socket& with_socket, const std::string_view raw_out_msg, const std::string_view delimiter, std::chrono::milliseconds timeout = DEFAULT_IO_TIMEOUT) -> boost::asio::awaitable<std::string>;
 
 }       // end of namespace async
\ No newline at end of file
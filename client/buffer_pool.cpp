@@ -0,0 +1,83 @@
+#include "buffer_pool.hh"
+#include <atomic>
+#include <ostream>
+#include <vector>
+
+namespace comm {
+namespace {
+
+struct counters {
+    std::atomic<std::uint64_t> acquired{0};
+    std::atomic<std::uint64_t> reused{0};
+    std::atomic<std::uint64_t> allocated{0};
+    std::atomic<std::uint64_t> dropped{0};
+};
+
+counters totals;
+
+// the free buffers of this thread, most recently returned last
+auto free_buffers() -> std::vector<std::string>& {
+    thread_local std::vector<std::string> buffers = [] {
+        std::vector<std::string> b;
+        b.reserve(pooled_buffer::MAX_POOLED_BUFFERS);
+        return b;
+    }();
+    return buffers;
+}
+
+}		// end of local namespace
+
+auto buffer_pool_stats::allocations_per_acquire() const -> double {
+    return acquired == 0 ? 0.0 : static_cast<double>(allocated) / static_cast<double>(acquired);
+}
+
+auto operator << (std::ostream& os, const buffer_pool_stats& stats) -> std::ostream& {
+    return os << "acquired: " << stats.acquired << ", reused: " << stats.reused
+        << ", allocated: " << stats.allocated << ", dropped: " << stats.dropped
+        << ", allocations per acquire: " << stats.allocations_per_acquire();
+}
+
+auto buffer_pool_statistics() -> buffer_pool_stats {
+    return buffer_pool_stats{
+        totals.acquired.load(std::memory_order_relaxed),
+        totals.reused.load(std::memory_order_relaxed),
+        totals.allocated.load(std::memory_order_relaxed),
+        totals.dropped.load(std::memory_order_relaxed)
+    };
+}
+
+pooled_buffer::pooled_buffer(std::size_t capacity) {
+    totals.acquired.fetch_add(1, std::memory_order_relaxed);
+    auto& buffers{free_buffers()};
+    if (!buffers.empty()) {
+        data_ = std::move(buffers.back());
+        buffers.pop_back();
+    }
+    if (data_.capacity() < capacity) {
+        data_.reserve(capacity);
+        totals.allocated.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        totals.reused.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+pooled_buffer::~pooled_buffer() {
+    recycle_buffer(std::move(data_));
+}
+
+auto recycle_buffer(std::string&& buffer) -> void {
+    static const auto inline_capacity{std::string{}.capacity()};
+
+    if (buffer.capacity() <= inline_capacity) {
+        return;     // nothing to keep, this is the case for moved from buffers
+    }
+    auto& buffers{free_buffers()};
+    if (buffers.size() >= pooled_buffer::MAX_POOLED_BUFFERS || buffer.capacity() > pooled_buffer::MAX_POOLED_CAPACITY) {
+        totals.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.clear();
+    buffers.push_back(std::move(buffer));
+}
+
+}	// end of namespace comm
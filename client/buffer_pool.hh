@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace comm {
+
+// Buffers used while handling a request (the header, the read buffer and the body)
+// are taken from a pool of the current thread and returned to it once we are done,
+// so in the steady state handling a request does not call malloc for them.
+// Since each io_context is run by a single thread, a buffer is almost always
+// returned to the same pool it was taken from.
+struct buffer_pool_stats {
+    std::uint64_t acquired{0};      // buffers that were handed out
+    std::uint64_t reused{0};        // served from the pool, without allocating
+    std::uint64_t allocated{0};     // had to allocate (or grow) the memory
+    std::uint64_t dropped{0};       // not kept since the pool was full or the buffer was too large
+
+    auto allocations_per_acquire() const -> double;
+};
+
+auto operator << (std::ostream& os, const buffer_pool_stats& stats) -> std::ostream&;
+
+// counters for all the threads since the start of the process
+auto buffer_pool_statistics() -> buffer_pool_stats;
+
+// A string borrowed from the pool, with at least the capacity that was asked for.
+// When it goes out of scope the memory is returned to the pool, unless it was taken with release()
+class pooled_buffer {
+public:
+    static constexpr std::size_t MAX_POOLED_CAPACITY{1'024 * 1'024};
+    static constexpr std::size_t MAX_POOLED_BUFFERS{64};
+    // a size that the peer announced (like a Content-Length) is reserved only up to this,
+    // beyond it the buffer grows as the data arrives
+    static constexpr std::size_t MAX_RESERVE{64 * 1'024 * 1'024};
+
+    explicit pooled_buffer(std::size_t capacity);
+    pooled_buffer(pooled_buffer&& other) noexcept = default;
+    auto operator = (pooled_buffer&& other) noexcept -> pooled_buffer& = default;
+    pooled_buffer(const pooled_buffer&) = delete;
+    auto operator = (const pooled_buffer&) -> pooled_buffer& = delete;
+    ~pooled_buffer();
+
+    auto get() -> std::string& {
+        return data_;
+    }
+
+    auto get() const -> const std::string& {
+        return data_;
+    }
+
+    // take the memory out of the pool, for example to return it to the caller
+    auto release() -> std::string {
+        return std::move(data_);
+    }
+
+private:
+    std::string data_;
+};
+
+// Give back a string that was returned by one of the functions in comm (like a response body)
+// so that its memory would be used for the next request
+auto recycle_buffer(std::string&& buffer) -> void;
+
+}	// end of namespace comm
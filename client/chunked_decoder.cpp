@@ -0,0 +1,106 @@
+#include "chunked_decoder.hh"
+#include <algorithm>
+
+namespace comm {
+namespace {
+
+auto hex_value(char c) -> int {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+}		// end of local namespace
+
+// count the size of the current line (without the CR), we are tolerating bare LF as line end
+auto chunked_decoder::end_of_line(char c) -> bool {
+    if (c == '\n') {
+        return true;
+    }
+    if (c == '\r') {
+        return false;
+    }
+    if (++line_length_ > MAX_LINE) {
+        state_ = state::error;
+    }
+    return false;
+}
+
+auto chunked_decoder::decode(std::string_view input) -> step {
+    std::size_t i{0};
+    while (i < input.size()) {
+        switch (state_) {
+        case state::size: {
+            const auto c{input[i++]};
+            if (const auto v = hex_value(c); v >= 0) {
+                if (remaining_ > (UINT64_MAX >> 4)) {
+                    state_ = state::error;
+                    return {i, {}};
+                }
+                remaining_ = (remaining_ << 4) | static_cast<std::uint64_t>(v);
+                digits_ = true;
+            } else if (!digits_) {
+                state_ = state::error;
+                return {i, {}};
+            } else if (c == '\n') {
+                line_length_ = 0;
+                state_ = remaining_ == 0 ? state::trailer : state::data;
+            } else {
+                state_ = state::extension;
+            }
+            break;
+        }
+        case state::extension:
+            if (end_of_line(input[i++])) {
+                line_length_ = 0;
+                state_ = remaining_ == 0 ? state::trailer : state::data;
+            }
+            break;
+        case state::data: {
+            const auto n{static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, input.size() - i))};
+            remaining_ -= n;
+            if (remaining_ == 0) {
+                state_ = state::data_end;
+            }
+            return {i + n, input.substr(i, n)};
+        }
+        case state::data_end:
+            // the payload must be followed by CRLF
+            if (const auto c = input[i++]; c == '\n') {
+                digits_ = false;
+                line_length_ = 0;
+                state_ = state::size;
+            } else if (c != '\r' || line_length_++ > 0) {
+                state_ = state::error;
+                return {i, {}};
+            }
+            break;
+        case state::trailer:
+            // we are ignoring the trailer fields, an empty line ends the message
+            if (end_of_line(input[i++])) {
+                if (line_length_ == 0) {
+                    state_ = state::done;
+                    return {i, {}};
+                }
+                line_length_ = 0;
+            }
+            break;
+        case state::done:
+        case state::error:
+            return {i, {}};
+        }
+        if (state_ == state::error) {
+            return {i, {}};
+        }
+    }
+    return {i, {}};
+}
+
+}	// end of namespace comm
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+namespace comm {
+
+// Incremental decoder for "Transfer-Encoding: chunked" bodies.
+// Feed it with the data as it arrives from the socket, each call consumes
+// some of the input and may return a part of the body. The body data is a
+// view into the input, so nothing is copied.
+class chunked_decoder {
+public:
+    static constexpr std::size_t MAX_LINE{4 * 1'024};
+
+    struct step {
+        std::size_t consumed{0};    // number of bytes from the input that were processed
+        std::string_view data;      // body data found in the input (may be empty)
+    };
+
+    // Process input from the start, call it again with the rest of the
+    // input (input.substr(consumed)) until all of it was consumed
+    auto decode(std::string_view input) -> step;
+
+    auto done() const -> bool {
+        return state_ == state::done;
+    }
+
+    auto failed() const -> bool {
+        return state_ == state::error;
+    }
+
+    auto reset() -> void {
+        *this = chunked_decoder{};
+    }
+
+private:
+    enum class state {
+        size,           // hex digits of the chunk size
+        extension,      // chunk extension up to the end of the line
+        data,           // chunk payload
+        data_end,       // CRLF after the payload
+        trailer,        // trailer fields after the last chunk
+        done,
+        error
+    };
+
+    auto end_of_line(char c) -> bool;
+
+    state state_{state::size};
+    std::uint64_t remaining_{0};
+    std::size_t line_length_{0};
+    bool digits_{false};
+};
+
+}	// end of namespace comm
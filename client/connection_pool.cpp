@@ -0,0 +1,331 @@
+#include "connection_pool.hh"
+#include "async_client.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <list>
+#include <map>
+#include <ostream>
+#include <utility>
+
+namespace comm {
+
+auto pool_stats::hit_rate() const -> double {
+    return acquired == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(acquired);
+}
+
+auto operator << (std::ostream& os, const pool_stats& stats) -> std::ostream& {
+    return os << "acquired: " << stats.acquired << ", hits: " << stats.hits
+        << ", misses: " << stats.misses << ", hit rate: " << stats.hit_rate()
+        << ", reuses: " << stats.reuses << ", discarded: " << stats.discarded
+        << ", waits: " << stats.waits << ", timeouts: " << stats.timeouts
+        << ", connect failures: " << stats.connect_failures
+        << ", wait time: " << std::chrono::duration_cast<std::chrono::microseconds>(stats.wait_time).count() << "us";
+}
+
+// Everything the pool knows, shared with the borrowed connections and with the coroutines
+// that wait in acquire, so they can still use it after the pool itself is gone
+struct pool_state : std::enable_shared_from_this<pool_state> {
+    using clock = connection_pool::clock;
+
+    struct idle_connection {
+        tcp::socket socket;
+        clock::time_point since;
+        std::size_t uses{0};
+    };
+
+    struct host_entry {
+        std::list<idle_connection> idle;
+        std::size_t borrowed{0};
+        std::list<asio::steady_timer*> waiters;
+    };
+
+    pool_state(connection_pool::executor_type e, pool_options o) : executor{std::move(e)}, options{o} {
+    }
+
+    auto release(pooled_connection& connection) -> void;
+    auto take_idle(host_entry& entry, const std::string& key) -> std::optional<pooled_connection>;
+    auto evict_idle(host_entry& entry, clock::time_point now) -> std::size_t;
+    auto notify(host_entry& entry) -> void;
+    auto clear() -> void;
+    static auto healthy(tcp::socket& socket) -> bool;
+
+    connection_pool::executor_type executor;
+    pool_options options;
+    std::map<std::string, host_entry> hosts;
+    pool_stats stats;
+    bool closed{false};     // the pool was destroyed
+};
+
+namespace {
+
+// The slot that acquire reserved for a new connection. Unless the connection took it, it is given
+// back when acquire leaves, also when the connect throws or the frame is destroyed while it is
+// suspended - as the losing attempt of a hedged request is
+struct reserved_slot {
+    reserved_slot(pool_state& s, pool_state::host_entry& e) : state{s}, entry{e} {
+        ++entry.borrowed;
+    }
+    reserved_slot(const reserved_slot&) = delete;
+    ~reserved_slot() {
+        if (!taken) {
+            --entry.borrowed;
+            state.notify(entry);
+        }
+    }
+
+    pool_state& state;
+    pool_state::host_entry& entry;
+    bool taken{false};
+};
+
+// the timer of a coroutine waiting for a slot, it is removed from the waiters however the wait ends
+struct listed_waiter {
+    listed_waiter(pool_state::host_entry& e, asio::steady_timer& t) : entry{e}, timer{t} {
+        entry.waiters.push_back(&timer);
+    }
+    listed_waiter(const listed_waiter&) = delete;
+    ~listed_waiter() {
+        entry.waiters.remove(&timer);
+    }
+
+    pool_state::host_entry& entry;
+    asio::steady_timer& timer;
+};
+
+}		// end of local namespace
+
+pooled_connection::pooled_connection(std::shared_ptr<pool_state> pool, std::string key, tcp::socket socket, std::size_t uses) :
+        pool_{std::move(pool)}, key_{std::move(key)}, socket_{std::move(socket)}, uses_{uses} {
+}
+
+pooled_connection::pooled_connection(pooled_connection&& other) noexcept :
+        pool_{std::move(other.pool_)}, key_{std::move(other.key_)},
+        socket_{std::move(other.socket_)}, uses_{other.uses_}, keep_{other.keep_} {
+    other.socket_.reset();
+}
+
+auto pooled_connection::operator = (pooled_connection&& other) noexcept -> pooled_connection& {
+    if (this != &other) {
+        release();
+        pool_ = std::move(other.pool_);
+        key_ = std::move(other.key_);
+        socket_ = std::move(other.socket_);
+        other.socket_.reset();
+        uses_ = other.uses_;
+        keep_ = other.keep_;
+    }
+    return *this;
+}
+
+pooled_connection::~pooled_connection() {
+    release();
+}
+
+auto pooled_connection::release() -> void {
+    if (pool_) {
+        pool_->release(*this);
+        pool_.reset();
+    }
+    socket_.reset();
+}
+
+auto pool_state::healthy(tcp::socket& socket) -> bool {
+    if (!socket.is_open()) {
+        return false;
+    }
+    // An idle connection should have nothing to read. If the peek returns
+    // data or EOF, the server either closed the connection or sent us garbage
+    boost::system::error_code ec;
+    socket.non_blocking(true, ec);
+    if (ec) {
+        return false;
+    }
+    char c{0};
+    const auto n = socket.receive(asio::buffer(&c, 1), tcp::socket::message_peek, ec);
+    socket.non_blocking(false, ec);
+    return n == 0 && ec == asio::error::would_block;
+}
+
+auto pool_state::evict_idle(host_entry& entry, clock::time_point now) -> std::size_t {
+    std::size_t count{0};
+    for (auto i = entry.idle.begin(); i != entry.idle.end(); ) {
+        if (now - i->since >= options.idle_timeout) {
+            boost::system::error_code ec;
+            i->socket.close(ec);
+            i = entry.idle.erase(i);
+            ++count;
+        } else {
+            ++i;
+        }
+    }
+    stats.discarded += count;
+    return count;
+}
+
+auto pool_state::clear() -> void {
+    for (auto& [key, entry] : hosts) {
+        stats.discarded += entry.idle.size();
+        for (auto& c : entry.idle) {
+            boost::system::error_code ec;
+            c.socket.close(ec);
+        }
+        entry.idle.clear();
+        notify(entry);
+    }
+}
+
+auto pool_state::notify(host_entry& entry) -> void {
+    if (!entry.waiters.empty()) {
+        auto* waiter = entry.waiters.front();
+        entry.waiters.pop_front();
+        waiter->cancel();
+    }
+}
+
+auto pool_state::take_idle(host_entry& entry, const std::string& key) -> std::optional<pooled_connection> {
+    // most recently used first, it is the one least likely to be closed by the server
+    while (!entry.idle.empty()) {
+        auto c = std::move(entry.idle.front());
+        entry.idle.pop_front();
+        if (healthy(c.socket)) {
+            ++entry.borrowed;
+            return pooled_connection{shared_from_this(), key, std::move(c.socket), c.uses};
+        }
+        boost::system::error_code ec;
+        c.socket.close(ec);
+        ++stats.discarded;
+    }
+    return std::nullopt;
+}
+
+auto pool_state::release(pooled_connection& connection) -> void {
+    auto i = hosts.find(connection.key_);
+    if (i == hosts.end()) {
+        return;
+    }
+    auto& entry = i->second;
+    if (entry.borrowed > 0) {
+        --entry.borrowed;
+    }
+    auto& socket = connection.socket_;
+    const auto uses{connection.uses_ + 1};
+    const bool retired{options.max_uses != 0 && uses >= options.max_uses};
+    if (socket && socket->is_open() && connection.keep_ && !retired && !closed) {
+        entry.idle.push_front(idle_connection{std::move(*socket), clock::now(), uses});
+        ++stats.reuses;
+    } else {
+        if (socket) {
+            boost::system::error_code ec;
+            socket->close(ec);
+        }
+        ++stats.discarded;
+    }
+    notify(entry);
+}
+
+connection_pool::connection_pool(executor_type executor, pool_options options) :
+        state_{std::make_shared<pool_state>(std::move(executor), options)} {
+}
+
+connection_pool::~connection_pool() {
+    state_->closed = true;
+    state_->clear();
+    // the waiters hold the state, so they can still remove themselves from it once they resume
+    for (auto& [key, entry] : state_->hosts) {
+        for (auto* waiter : entry.waiters) {
+            waiter->cancel();
+        }
+        entry.waiters.clear();
+    }
+}
+
+auto connection_pool::evict_idle() -> std::size_t {
+    const auto now{clock::now()};
+    std::size_t count{0};
+    for (auto& [key, entry] : state_->hosts) {
+        if (const auto n = state_->evict_idle(entry, now); n > 0) {
+            count += n;
+            state_->notify(entry);
+        }
+    }
+    return count;
+}
+
+auto connection_pool::clear() -> void {
+    state_->clear();
+}
+
+auto connection_pool::idle_count() const -> std::size_t {
+    std::size_t count{0};
+    for (const auto& [key, entry] : state_->hosts) {
+        count += entry.idle.size();
+    }
+    return count;
+}
+
+auto connection_pool::stats() const -> const pool_stats& {
+    return state_->stats;
+}
+
+auto connection_pool::options() const -> const pool_options& {
+    return state_->options;
+}
+
+auto connection_pool::get_executor() const -> executor_type {
+    return state_->executor;
+}
+
+auto connection_pool::acquire(const std::string& host, const std::string& port, const request_deadlines& deadlines,
+                              clock::time_point started) -> asio::awaitable<pooled_connection> {
+    // keep the state alive while we are suspended, the pool may be destroyed in the mean time
+    auto state{state_};
+    auto key{host + ":" + port};
+    auto& entry = state->hosts[key];
+    const auto start{clock::now()};
+    const auto end{(started == clock::time_point{} ? start : started) + deadlines.total};
+    const auto give_up{std::min(start + state->options.max_wait, end)};
+    bool waited{false};
+
+    while (!state->closed) {
+        state->evict_idle(entry, clock::now());
+        if (auto c = state->take_idle(entry, key); c) {
+            ++state->stats.hits;
+            ++state->stats.acquired;
+            co_return std::move(*c);
+        }
+        const auto now{clock::now()};
+        if (entry.borrowed < state->options.max_per_host && now < end) {
+            // reserve the slot before we suspend on the connect
+            reserved_slot slot{*state, entry};
+            ++state->stats.misses;
+            connect_options connecting;
+            connecting.deadline = std::min<std::chrono::milliseconds>(deadlines.connect,
+                    std::chrono::duration_cast<std::chrono::milliseconds>(end - now));
+            auto s = co_await async_connect(host, port, connecting);
+            if (!s.is_open()) {
+                ++state->stats.connect_failures;
+                co_return pooled_connection{};
+            }
+            ++state->stats.acquired;
+            slot.taken = true;
+            co_return pooled_connection{state, key, std::move(s), 0};
+        }
+        // no free slot, wait until some other client release its connection
+        if (now >= give_up) {
+            ++state->stats.timeouts;
+            LOG(WARNING) << "timeout waiting for a free connection to " << key << ENDL;
+            co_return pooled_connection{};
+        }
+        if (!waited) {
+            waited = true;
+            ++state->stats.waits;
+        }
+        asio::steady_timer timer(state->executor, give_up);
+        listed_waiter listed{entry, timer};
+        co_await timer.async_wait(asio::as_tuple(asio::use_awaitable));
+        state->stats.wait_time += clock::now() - now;
+    }
+    co_return pooled_connection{};
+}
+
+}	// end of namespace comm
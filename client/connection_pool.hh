@@ -0,0 +1,136 @@
+#pragma once
+#include "network_fwd.hh"
+#include "deadline.hh"
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace comm {
+
+struct pool_options {
+    // maximum number of connections (idle + borrowed) for a single host:port
+    std::size_t max_per_host{8};
+    // idle connections that were not used for this long are closed
+    std::chrono::milliseconds idle_timeout{std::chrono::seconds{30}};
+    // how long acquire would wait for a free slot once max_per_host was reached
+    std::chrono::milliseconds max_wait{std::chrono::seconds{5}};
+    // a connection is retired after this many requests, 0 means no limit
+    std::size_t max_uses{0};
+};
+
+// Counters that are used to size the pool.
+// hit rate is the fraction of acquires that were served from an idle connection
+struct pool_stats {
+    std::uint64_t acquired{0};      // successful acquire calls
+    std::uint64_t hits{0};          // served from an idle connection
+    std::uint64_t misses{0};        // had to open a new connection
+    std::uint64_t reuses{0};        // connections returned to the idle list
+    std::uint64_t discarded{0};     // connections closed - unhealthy, expired or not reusable
+    std::uint64_t waits{0};         // acquire calls that had to wait for a free slot
+    std::uint64_t timeouts{0};      // acquire calls that gave up waiting
+    std::uint64_t connect_failures{0};
+    std::chrono::nanoseconds wait_time{0};  // total time spent waiting for a free slot
+
+    auto hit_rate() const -> double;
+};
+
+auto operator << (std::ostream& os, const pool_stats& stats) -> std::ostream&;
+
+struct pool_state;
+
+// A socket borrowed from the pool. When it goes out of scope it is returned
+// to the pool, unless it was closed or marked with discard()
+class pooled_connection {
+public:
+    pooled_connection() = default;
+    pooled_connection(pooled_connection&& other) noexcept;
+    auto operator = (pooled_connection&& other) noexcept -> pooled_connection&;
+    pooled_connection(const pooled_connection&) = delete;
+    auto operator = (const pooled_connection&) -> pooled_connection& = delete;
+    ~pooled_connection();
+
+    auto socket() -> tcp::socket& {
+        return *socket_;
+    }
+
+    auto valid() const -> bool {
+        return socket_.has_value() && socket_->is_open();
+    }
+
+    explicit operator bool () const {
+        return valid();
+    }
+
+    // true if this connection was already used for a previous request
+    auto reused() const -> bool {
+        return uses_ > 0;
+    }
+
+    // do not return this connection to the pool (for example the server sent "Connection: close")
+    auto discard() -> void {
+        keep_ = false;
+    }
+
+    // return the connection to the pool before the object goes out of scope
+    auto release() -> void;
+
+private:
+    friend class connection_pool;
+    friend struct pool_state;
+
+    pooled_connection(std::shared_ptr<pool_state> pool, std::string key, tcp::socket socket, std::size_t uses);
+
+    std::shared_ptr<pool_state> pool_;
+    std::string key_;
+    std::optional<tcp::socket> socket_;
+    std::size_t uses_{0};
+    bool keep_{true};
+};
+
+// Keep alive connections, per host:port.
+// Please note that the pool is not thread safe, it must be used from the
+// executor it was created with (i.e. one pool per io_context).
+// The connections and the coroutines waiting in acquire share the state of the pool,
+// so the pool can be destroyed before them: the waiters then give up, and the
+// connections are closed once they are returned.
+class connection_pool {
+public:
+    using executor_type = asio::any_io_executor;
+    using clock = std::chrono::steady_clock;
+
+    explicit connection_pool(executor_type executor, pool_options options = {});
+    connection_pool(const connection_pool&) = delete;
+    auto operator = (const connection_pool&) -> connection_pool& = delete;
+    // close the idle connections, and wake up the coroutines that wait for a free slot
+    ~connection_pool();
+
+    // Borrow a connection to host:port, either an idle one or a new connection.
+    // If the host already has max_per_host connections, wait for one to be released.
+    // The wait is limited by max_wait and by started + deadlines.total, and a new connection
+    // by deadlines.connect as well (started is now when it is not given).
+    // On failure the returned connection is not valid.
+    auto acquire(const std::string& host, const std::string& port, const request_deadlines& deadlines = {},
+                 clock::time_point started = {}) -> asio::awaitable<pooled_connection>;
+
+    // close idle connections that passed the idle timeout, return the number of connections closed
+    auto evict_idle() -> std::size_t;
+
+    // close all idle connections
+    auto clear() -> void;
+
+    auto idle_count() const -> std::size_t;
+
+    auto stats() const -> const pool_stats&;
+
+    auto options() const -> const pool_options&;
+
+    auto get_executor() const -> executor_type;
+
+private:
+    std::shared_ptr<pool_state> state_;
+};
+
+}	// end of namespace comm
@@ -0,0 +1,129 @@
+#include "connector.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+namespace comm {
+namespace {
+
+using clock = asio::steady_timer::clock_type;
+
+// interleave the address families, keeping the order of the resolver within each family
+auto interleave(const tcp::resolver::results_type& endpoints) -> std::vector<tcp::endpoint> {
+  std::vector<tcp::endpoint> first;
+  std::vector<tcp::endpoint> second;
+  for (const auto& e : endpoints) {
+    if (first.empty() || e.endpoint().protocol() == first.front().protocol()) {
+      first.push_back(e.endpoint());
+    } else {
+      second.push_back(e.endpoint());
+    }
+  }
+  std::vector<tcp::endpoint> ordered;
+  ordered.reserve(first.size() + second.size());
+  for (std::size_t i = 0; i < std::max(first.size(), second.size()); ++i) {
+    if (i < first.size()) {
+      ordered.push_back(first[i]);
+    }
+    if (i < second.size()) {
+      ordered.push_back(second[i]);
+    }
+  }
+  return ordered;
+}
+
+}		// end of local namespace
+
+auto async_race_connect(const tcp::resolver::results_type& endpoints, const connect_options& options) -> asio::awaitable<tcp::socket> {
+  auto executor = co_await asio::this_coro::executor;
+  const auto addresses{interleave(endpoints)};
+  const auto deadline{clock::now() + options.deadline};
+  if (addresses.empty()) {
+    co_return tcp::socket{executor};
+  }
+
+  // turns[i] expires when attempt i should start, attempt i sets the time for attempt i + 1
+  // once it started, and moves it to now if it failed
+  std::vector<asio::steady_timer> turns;
+  turns.reserve(addresses.size());
+  turns.emplace_back(executor, clock::now());
+  for (std::size_t i = 1; i < addresses.size(); ++i) {
+    turns.emplace_back(executor, clock::time_point::max());
+  }
+  std::optional<tcp::socket> winner;
+
+  auto attempt = [&](std::size_t i) -> asio::awaitable<void> {
+    auto& turn{turns[i]};
+    while (turn.expiry() > clock::now()) {
+      co_await turn.async_wait(asio::as_tuple(asio::use_awaitable));
+      // the wait is also cut short when the time for our turn was changed
+      if ((co_await asio::this_coro::cancellation_state).cancelled() != asio::cancellation_type::none) {
+        throw boost::system::system_error{asio::error::operation_aborted};
+      }
+    }
+    const auto now{clock::now()};
+    const auto next{i + 1 < turns.size() ? &turns[i + 1] : nullptr};
+    if (next) {
+      next->expires_at(std::min(now + options.attempt_delay, deadline));
+    }
+    if (now >= deadline) {
+      throw boost::system::system_error{asio::error::timed_out};
+    }
+
+    tcp::socket s(executor);
+    // the buffer sizes decide the window scale that the SYN offers, so they are set before connecting
+    boost::system::error_code open_error;
+    s.open(addresses[i].protocol(), open_error);
+    if (open_error) {
+      VLOG(1) << "failed to open a socket for " << addresses[i] << ": " << open_error.message() << ENDL;
+      if (next) {
+        next->expires_at(clock::now());
+      }
+      throw boost::system::system_error{open_error};
+    }
+    size_socket_buffers(s, options.tuning);
+    asio::steady_timer timeout(executor, std::min(now + options.attempt_timeout, deadline));
+    auto [order, connect_error, timer_error] = co_await asio::experimental::make_parallel_group(
+            s.async_connect(addresses[i], asio::deferred),
+            timeout.async_wait(asio::deferred)
+    ).async_wait(asio::experimental::wait_for_one(), asio::use_awaitable);
+
+    if (order[0] == 0 && !connect_error && !winner) {
+      winner.emplace(std::move(s));
+      co_return;
+    }
+    // connected after another attempt won, or cancelled by the winner, neither is a failure
+    const bool lost{order[0] == 0 ? !connect_error || connect_error == asio::error::operation_aborted
+                                  : timer_error == asio::error::operation_aborted};
+    const auto e{lost ? boost::system::error_code{asio::error::operation_aborted}
+                      : order[0] == 1 ? boost::system::error_code{asio::error::timed_out} : connect_error};
+    if (!lost) {
+      // the other addresses may still connect, this is only a failure once they all did
+      VLOG(1) << "connection attempt to " << addresses[i] << " failed: " << e.message() << ENDL;
+    }
+    boost::system::error_code ignore;
+    s.close(ignore);
+    if (next) {
+      next->expires_at(clock::now());     // do not wait for the delay, try the next address now
+    }
+    throw boost::system::system_error{e};
+  };
+
+  using operation = decltype(asio::co_spawn(executor, attempt(0), asio::deferred));
+  std::vector<operation> operations;
+  operations.reserve(addresses.size());
+  for (std::size_t i = 0; i < addresses.size(); ++i) {
+    operations.push_back(asio::co_spawn(executor, attempt(i), asio::deferred));
+  }
+  // the first attempt to connect cancels the others
+  co_await asio::experimental::make_parallel_group(std::move(operations)).async_wait(
+          asio::experimental::wait_for_one_success(), asio::use_awaitable
+  );
+  if (winner) {
+    co_return std::move(*winner);
+  }
+  co_return tcp::socket{executor};
+}
+
+}	// end of namespace comm
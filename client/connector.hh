@@ -0,0 +1,27 @@
+#pragma once
+#include "network_fwd.hh"
+#include "socket_tuning.hh"
+#include <chrono>
+
+namespace comm {
+
+struct connect_options {
+    // time to wait for an attempt before starting the next one in parallel (RFC 8305 recommends 250ms)
+    std::chrono::milliseconds attempt_delay{250};
+    // a single address that did not answer by then is given up
+    std::chrono::milliseconds attempt_timeout{std::chrono::seconds{3}};
+    // the whole connect, over all addresses, async_connect includes the name lookup in it
+    std::chrono::milliseconds deadline{std::chrono::seconds{10}};
+    // the buffer sizes are set on each attempt before it connects, async_connect sets the rest once connected
+    socket_tuning tuning;
+};
+
+// Connect to the first address that answers, "happy eyeballs" style (RFC 8305):
+// the addresses are ordered so the families alternate, starting with the family
+// of the first address. Attempts are started one after another, with attempt_delay
+// between them, or right away when the attempt before failed, and they then race -
+// the first one to connect wins and the rest are cancelled.
+// On failure the returned socket is closed.
+auto async_race_connect(const tcp::resolver::results_type& endpoints, const connect_options& options = {}) -> asio::awaitable<tcp::socket>;
+
+}	// end of namespace comm
@@ -0,0 +1,61 @@
+#pragma once
+#include "network_fwd.hh"
+#include <chrono>
+#include <exception>
+#include <optional>
+
+namespace comm {
+
+// Limits for a single HTTP request, so a slow or hung server would not hold
+// the socket and the coroutine frame forever
+struct request_deadlines {
+    using clock = asio::steady_timer::clock_type;
+
+    // resolve and connect
+    std::chrono::milliseconds connect{std::chrono::seconds{5}};
+    // from sending the request until we have the status line and all the headers
+    std::chrono::milliseconds first_byte{std::chrono::seconds{10}};
+    // the whole request, including the connect, and reading the body
+    std::chrono::milliseconds total{std::chrono::seconds{30}};
+};
+
+// default limit for each send or read of the raw TCP functions
+inline constexpr std::chrono::milliseconds DEFAULT_IO_TIMEOUT{std::chrono::seconds{30}};
+
+// Run op until it is done or the deadline passed, whichever comes first. In the later
+// case op is cancelled (through its cancellation slot) and this returns nullopt.
+template<typename T>
+auto with_deadline(asio::awaitable<T> op, request_deadlines::clock::time_point deadline) -> asio::awaitable<std::optional<T>> {
+    auto executor = co_await asio::this_coro::executor;
+    asio::steady_timer timer(executor, deadline);
+    auto [order, e, result, timer_error] = co_await asio::experimental::make_parallel_group(
+            asio::co_spawn(executor, std::move(op), asio::deferred),
+            timer.async_wait(asio::deferred)
+    ).async_wait(asio::experimental::wait_for_one(), asio::use_awaitable);
+    if (order[0] == 1) {
+        co_return std::nullopt;
+    }
+    if (e) {
+        std::rethrow_exception(e);
+    }
+    co_return std::optional<T>{std::move(result)};
+}
+
+// same as above for operations without a result, return false if the deadline passed
+inline auto with_deadline(asio::awaitable<void> op, request_deadlines::clock::time_point deadline) -> asio::awaitable<bool> {
+    auto executor = co_await asio::this_coro::executor;
+    asio::steady_timer timer(executor, deadline);
+    auto [order, e, timer_error] = co_await asio::experimental::make_parallel_group(
+            asio::co_spawn(executor, std::move(op), asio::deferred),
+            timer.async_wait(asio::deferred)
+    ).async_wait(asio::experimental::wait_for_one(), asio::use_awaitable);
+    if (order[0] == 1) {
+        co_return false;
+    }
+    if (e) {
+        std::rethrow_exception(e);
+    }
+    co_return true;
+}
+
+}	// end of namespace comm
@@ -0,0 +1,185 @@
+#include "dns_cache.hh"
+#include "log/logging.hh"
+#include <ostream>
+
+namespace comm {
+namespace {
+
+auto make_key(const std::string& host, const std::string& service) -> std::string {
+    std::string key;
+    key.reserve(host.size() + service.size() + 1);
+    key.append(host).append(1, ':').append(service);
+    return key;
+}
+
+}		// end of local namespace
+
+auto operator << (std::ostream& os, const dns_stats& stats) -> std::ostream& {
+    return os << "hits: " << stats.hits << ", negative hits: " << stats.negative_hits
+        << ", misses: " << stats.misses << ", shared: " << stats.shared
+        << ", failures: " << stats.failures;
+}
+
+dns_cache::dns_cache(dns_options options) : options_{options} {
+}
+
+auto dns_cache::shared() -> dns_cache& {
+    static dns_cache cache;
+    return cache;
+}
+
+auto dns_cache::evict_expired(clock::time_point now) -> void {
+    std::erase_if(entries_, [now](const auto& e) {
+        return !e.second.in_flight && e.second.expires <= now;
+    });
+}
+
+auto dns_cache::begin_lookup(const std::string& key, std::optional<results_type>& results, std::shared_ptr<flight>& f) -> lookup {
+    const auto now{clock::now()};
+    std::lock_guard guard{lock_};
+    if (entries_.size() >= options_.max_entries && !entries_.contains(key)) {
+        evict_expired(now);
+    }
+    auto& e{entries_[key]};
+    if (!e.in_flight && e.expires > now) {
+        if (e.results) {
+            ++stats_.hits;
+        } else {
+            ++stats_.negative_hits;
+        }
+        results = e.results;
+        return lookup::cached;
+    }
+    if (e.in_flight) {
+        ++stats_.shared;
+        f = e.in_flight;
+        return lookup::wait;
+    }
+    ++stats_.misses;
+    f = e.in_flight = std::make_shared<flight>();
+    return lookup::resolve;
+}
+
+auto dns_cache::finish_lookup(const std::string& key, const boost::system::error_code& ec, const results_type& results) -> void {
+    std::optional<results_type> answer;
+    if (!ec) {
+        answer = results;
+    }
+    std::shared_ptr<flight> f;
+    {
+        const auto now{clock::now()};
+        std::lock_guard guard{lock_};
+        auto& e{entries_[key]};
+        f.swap(e.in_flight);
+        e.results = answer;
+        if (ec == asio::error::operation_aborted) {
+            e.expires = now;        // we did not get an answer, the next lookup would try again
+        } else {
+            e.expires = now + (answer ? options_.ttl : options_.negative_ttl);
+        }
+        if (ec) {
+            ++stats_.failures;
+        }
+    }
+    if (f) {
+        f->complete(answer);
+    }
+}
+
+// the lookup is not run by any of the coroutines that want its result, so none of them can abort it
+// by leaving early, only the destruction of the executor it runs on can
+auto dns_cache::run_lookup(std::string host, std::string service, std::string key) -> asio::awaitable<void> {
+    bool finished{false};
+    on_exit done{[this, &key, &finished]() {
+        if (!finished) {
+            finish_lookup(key, asio::error::operation_aborted, results_type{});
+        }
+    }};
+    tcp::resolver resolver(co_await asio::this_coro::executor);
+    auto [ec, r] = co_await resolver.async_resolve(host, service, asio::as_tuple(asio::use_awaitable));
+    finished = true;
+    if (ec) {
+        LOG(ERROR) << "failed to resolve " << key << ": " << ec.message() << ENDL;
+    }
+    finish_lookup(key, ec, r);
+}
+
+auto dns_cache::async_resolve(const std::string& host, const std::string& service,
+                              clock::time_point deadline) -> asio::awaitable<std::optional<results_type>> {
+    auto executor = co_await asio::this_coro::executor;
+    const auto key{make_key(host, service)};
+    std::optional<results_type> results;
+    std::shared_ptr<flight> f;
+
+    switch (begin_lookup(key, results, f)) {
+    case lookup::cached:
+        co_return results;
+    case lookup::resolve:
+        asio::co_spawn(executor, run_lookup(host, service, key), asio::detached);
+        break;
+    case lookup::wait:
+        break;
+    }
+    auto answer = co_await f->wait(deadline);
+    if (!answer) {
+        LOG(WARNING) << "resolving " << key << " did not finish before the deadline" << ENDL;
+        co_return std::nullopt;
+    }
+    co_return std::move(*answer);
+}
+
+auto dns_cache::resolve(const std::string& host, const std::string& service, asio::io_context& ctx) -> std::optional<results_type> {
+    const auto key{make_key(host, service)};
+    {
+        std::lock_guard guard{lock_};
+        if (auto i = entries_.find(key); i != entries_.end() && !i->second.in_flight && i->second.expires > clock::now()) {
+            if (i->second.results) {
+                ++stats_.hits;
+            } else {
+                ++stats_.negative_hits;
+            }
+            return i->second.results;
+        }
+        ++stats_.misses;
+    }
+    tcp::resolver resolver(ctx);
+    boost::system::error_code ec;
+    auto r = resolver.resolve(host, service, ec);
+    const auto now{clock::now()};
+    std::lock_guard guard{lock_};
+    auto& e{entries_[key]};
+    if (ec) {
+        ++stats_.failures;
+        LOG(ERROR) << "failed to resolve " << key << ": " << ec.message() << ENDL;
+    }
+    // if an async lookup is in flight, it would store its own result
+    if (!e.in_flight) {
+        e.results = ec ? std::nullopt : std::optional<results_type>{r};
+        e.expires = now + (ec ? options_.negative_ttl : options_.ttl);
+    }
+    if (ec) {
+        return std::nullopt;
+    }
+    return r;
+}
+
+auto dns_cache::forget(const std::string& host, const std::string& service) -> void {
+    std::lock_guard guard{lock_};
+    if (auto i = entries_.find(make_key(host, service)); i != entries_.end() && !i->second.in_flight) {
+        entries_.erase(i);
+    }
+}
+
+auto dns_cache::clear() -> void {
+    std::lock_guard guard{lock_};
+    std::erase_if(entries_, [](const auto& e) {
+        return !e.second.in_flight;
+    });
+}
+
+auto dns_cache::stats() const -> dns_stats {
+    std::lock_guard guard{lock_};
+    return stats_;
+}
+
+}	// end of namespace comm
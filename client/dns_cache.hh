@@ -0,0 +1,93 @@
+#pragma once
+#include "network_fwd.hh"
+#include "single_flight.hh"
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace comm {
+
+struct dns_options {
+    // how long a successful lookup is used before we ask again
+    std::chrono::milliseconds ttl{std::chrono::seconds{60}};
+    // how long a failed lookup is remembered, so a bad host name would not cost a lookup per request
+    std::chrono::milliseconds negative_ttl{std::chrono::seconds{5}};
+    // once we have this many entries, the expired ones are removed
+    std::size_t max_entries{1'024};
+};
+
+struct dns_stats {
+    std::uint64_t hits{0};          // answered from the cache
+    std::uint64_t negative_hits{0}; // answered from the cache with a failure
+    std::uint64_t misses{0};        // had to resolve
+    std::uint64_t shared{0};        // waited for a lookup that was already in flight
+    std::uint64_t failures{0};      // lookups that failed
+};
+
+auto operator << (std::ostream& os, const dns_stats& stats) -> std::ostream&;
+
+// Name resolution results, per host:service, that are shared by all the clients.
+// Concurrent lookups for the same host:service share a single async_resolve, that the cache
+// runs on the executor of the first of them, and they all wait for its result (so the cache
+// must outlive its lookups, as the shared one does). Unlike the rest of comm, this can be used from any thread,
+// so a single cache can serve all the io_contexts of a runtime.
+class dns_cache {
+public:
+    using results_type = tcp::resolver::results_type;
+    using clock = std::chrono::steady_clock;
+
+    explicit dns_cache(dns_options options = {});
+    dns_cache(const dns_cache&) = delete;
+    auto operator = (const dns_cache&) -> dns_cache& = delete;
+
+    // the cache that is used by async_connect, connect and the connection pool
+    static auto shared() -> dns_cache&;
+
+    // resolve without blocking the executor of the calling coroutine, nullopt on failure, or if the
+    // deadline passed first - then only this caller stops waiting, the lookup goes on for the others
+    auto async_resolve(const std::string& host, const std::string& service,
+                       clock::time_point deadline = clock::time_point::max()) -> asio::awaitable<std::optional<results_type>>;
+
+    // blocking lookup for the sync client, the result is cached as well
+    auto resolve(const std::string& host, const std::string& service, asio::io_context& ctx) -> std::optional<results_type>;
+
+    // drop the entry, for example after none of the addresses could be reached
+    auto forget(const std::string& host, const std::string& service) -> void;
+
+    auto clear() -> void;
+
+    auto stats() const -> dns_stats;
+
+private:
+    using flight = single_flight<std::optional<results_type>>;
+
+    struct entry {
+        std::optional<results_type> results;
+        clock::time_point expires{};
+        std::shared_ptr<flight> in_flight;  // the lookup in progress
+    };
+
+    // what a lookup should do, given the current entry
+    enum class lookup {
+        cached,
+        wait,
+        resolve
+    };
+
+    auto begin_lookup(const std::string& key, std::optional<results_type>& results, std::shared_ptr<flight>& f) -> lookup;
+    auto finish_lookup(const std::string& key, const boost::system::error_code& ec, const results_type& results) -> void;
+    auto run_lookup(std::string host, std::string service, std::string key) -> asio::awaitable<void>;
+    auto evict_expired(clock::time_point now) -> void;
+
+    dns_options options_;
+    mutable std::mutex lock_;
+    std::unordered_map<std::string, entry> entries_;
+    dns_stats stats_;
+};
+
+}	// end of namespace comm
@@ -0,0 +1,330 @@
+#include "download.hh"
+#include "http_reader.hh"
+#include "metrics.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#if !defined(BOOST_ASIO_HAS_FILE)
+#   include <cerrno>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+namespace comm {
+namespace {
+
+using namespace std::string_view_literals;
+using clock = request_deadlines::clock;
+
+// Where the body goes. When asio has async files (with io_uring on Linux, or on Windows)
+// the writes are asynchronous, otherwise they are blocking, which is fine for a local disk
+class file_sink {
+public:
+    explicit file_sink([[maybe_unused]] const asio::any_io_executor& executor)
+#if defined(BOOST_ASIO_HAS_FILE)
+        : file_{executor}
+#endif
+    {
+    }
+
+    file_sink(const file_sink&) = delete;
+    auto operator = (const file_sink&) -> file_sink& = delete;
+
+#if !defined(BOOST_ASIO_HAS_FILE)
+    ~file_sink() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+#endif
+
+    // write from offset on, at 0 the file is truncated
+    auto open(const std::string& path, std::uint64_t offset) -> bool {
+        offset_ = offset;
+#if defined(BOOST_ASIO_HAS_FILE)
+        boost::system::error_code ec;
+        auto flags{asio::file_base::write_only | asio::file_base::create};
+        if (offset == 0) {
+            flags = flags | asio::file_base::truncate;
+        }
+        file_.open(path, flags, ec);
+        if (!ec && offset > 0) {
+            file_.seek(static_cast<std::int64_t>(offset), asio::file_base::seek_set, ec);
+        }
+        if (ec) {
+            LOG(ERROR) << "error: failed to open " << path << " for download: " << ec.message() << ENDL;
+            return false;
+        }
+#else
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (offset == 0 ? O_TRUNC : 0), 0644);
+        if (fd_ < 0) {
+            LOG(ERROR) << "error: failed to open " << path << " for download: " << std::strerror(errno) << ENDL;
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    auto write(std::span<const std::byte> data) -> asio::awaitable<bool> {
+#if defined(BOOST_ASIO_HAS_FILE)
+        auto [e, n] = co_await asio::async_write(file_, asio::buffer(data.data(), data.size()), asio::as_tuple(asio::use_awaitable));
+        offset_ += n;
+        if (e) {
+            LOG(ERROR) << "error: failed to write the download to the file: " << e.message() << ENDL;
+            co_return false;
+        }
+#else
+        while (!data.empty()) {
+            const auto n{::pwrite(fd_, data.data(), data.size(), static_cast<off_t>(offset_))};
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG(ERROR) << "error: failed to write the download to the file: " << std::strerror(errno) << ENDL;
+                co_return false;
+            }
+            offset_ += static_cast<std::uint64_t>(n);
+            data = data.subspan(static_cast<std::size_t>(n));
+        }
+#endif
+        co_return true;
+    }
+
+#if defined(__linux__) && !defined(BOOST_ASIO_HAS_FILE)
+    // move size bytes that are waiting in the pipe into the file
+    auto splice_from(int pipe, std::size_t size) -> bool {
+        loff_t at{static_cast<loff_t>(offset_)};
+        while (size > 0) {
+            const auto n{::splice(pipe, nullptr, fd_, &at, size, SPLICE_F_MOVE)};
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                LOG(ERROR) << "error: failed to write the download to the file: " << std::strerror(errno) << ENDL;
+                return false;
+            }
+            size -= static_cast<std::size_t>(n);
+        }
+        offset_ = static_cast<std::uint64_t>(at);
+        return true;
+    }
+#endif
+
+    // where the next write goes
+    auto offset() const -> std::uint64_t {
+        return offset_;
+    }
+
+private:
+#if defined(BOOST_ASIO_HAS_FILE)
+    asio::stream_file file_;
+#else
+    int fd_{-1};
+#endif
+    std::uint64_t offset_{0};
+};
+
+#if defined(__linux__) && !defined(BOOST_ASIO_HAS_FILE)
+struct pipe_pair {
+    int read{-1};
+    int write{-1};
+
+    pipe_pair() = default;
+    pipe_pair(const pipe_pair&) = delete;
+    auto operator = (const pipe_pair&) -> pipe_pair& = delete;
+
+    ~pipe_pair() {
+        if (read >= 0) {
+            ::close(read);
+            ::close(write);
+        }
+    }
+};
+
+// Move a Content-Length body from the socket to the file through a pipe, the data goes from the
+// socket buffers to the page cache without being copied to user space. Only the part of the body
+// that was read together with the headers is written from memory
+auto splice_body(tcp::socket& socket, response_reader& reader, file_sink& file, std::size_t slice, clock::time_point end) -> asio::awaitable<bool> {
+    auto remaining{reader.parser().content_length()};
+    const auto buffered{reader.buffered_body().substr(0, static_cast<std::size_t>(std::min<std::uint64_t>(remaining, reader.buffered_body().size())))};
+    if (!co_await file.write(std::as_bytes(std::span{buffered}))) {
+        co_return false;
+    }
+    remaining -= buffered.size();
+
+    if (remaining > 0) {
+        pipe_pair pipe;
+        int fds[2];
+        if (::pipe2(fds, O_CLOEXEC) != 0) {
+            LOG(ERROR) << "error: failed to create a pipe for the download: " << std::strerror(errno) << ENDL;
+            co_return false;
+        }
+        pipe.read = fds[0];
+        pipe.write = fds[1];
+        // a larger pipe means fewer trips, if this fails we keep the default size
+        if (const auto size = ::fcntl(pipe.write, F_SETPIPE_SZ, static_cast<int>(slice)); size > 0) {
+            slice = static_cast<std::size_t>(size);
+        } else {
+            slice = std::min<std::size_t>(slice, 64 * 1'024);
+        }
+        boost::system::error_code ec;
+        socket.native_non_blocking(true, ec);
+
+        while (remaining > 0) {
+            const auto want{static_cast<std::size_t>(std::min<std::uint64_t>(remaining, slice))};
+            const auto n{::splice(socket.native_handle(), nullptr, pipe.write, nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK)};
+            if (n == 0) {
+                LOG(ERROR) << "error: EOF while reading the download body, " << remaining << " bytes are missing" << ENDL;
+                co_return false;
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN) {
+                    LOG(ERROR) << "error: failed to read the download body: " << std::strerror(errno) << ENDL;
+                    co_return false;
+                }
+                // the pipe is always empty here, so the socket has nothing for us yet
+                if (!(co_await with_deadline(wait_readable(socket), std::min(clock::now() + DEFAULT_IO_TIMEOUT, end))).value_or(false)) {
+                    LOG(WARNING) << "timeout while reading the download body" << ENDL;
+                    co_return false;
+                }
+                continue;
+            }
+            if (!file.splice_from(pipe.read, static_cast<std::size_t>(n))) {
+                co_return false;
+            }
+            remaining -= static_cast<std::uint64_t>(n);
+        }
+    }
+    reader.body_done();
+    co_return true;
+}
+#endif
+
+// the first byte in "Content-Range: bytes 100-199/200"
+auto range_start(std::string_view value) -> std::optional<std::uint64_t> {
+    if (!value.starts_with("bytes "sv)) {
+        return std::nullopt;
+    }
+    value.remove_prefix(6);
+    std::uint64_t start{0};
+    const auto [end, e] = std::from_chars(value.data(), value.data() + value.size(), start);
+    if (e != std::errc{} || end == value.data() + value.size() || *end != '-') {
+        return std::nullopt;
+    }
+    return start;
+}
+
+}		// end of local namespace
+
+auto async_http_download(tcp::socket& with_socket, const std::string& host, const std::string& resource,
+                         const std::string& path, download_options options) -> asio::awaitable<download_result> {
+    const auto end{clock::now() + options.deadlines.total};
+    metrics::add(metrics::counter::requests);
+    download_result result;
+    auto failed = [&](const char* what) {
+        LOG(WARNING) << "download of " << host << resource << " failed while " << what << ENDL;
+        boost::system::error_code ec;
+        with_socket.close(ec);
+        metrics::add(metrics::counter::failures);
+        return result;
+    };
+
+    try {
+        std::uint64_t existing{0};
+        if (options.resume) {
+            std::error_code ec;
+            if (const auto size = std::filesystem::file_size(path, ec); !ec) {
+                existing = size;
+            }
+        }
+        std::array<char, 24> from{};
+        const auto from_end{existing > 0 ? std::to_chars(from.data(), from.data() + from.size(), existing).ptr : from.data()};
+        const std::array<asio::const_buffer, 9> request{
+            asio::buffer("GET "sv), asio::buffer(resource),
+            asio::buffer(" HTTP/1.1\r\nHost: "sv), asio::buffer(host),
+            asio::buffer("\r\nAccept: */*\r\n"sv),
+            asio::buffer(existing > 0 ? "Range: bytes="sv : ""sv),
+            asio::buffer(from.data(), static_cast<std::size_t>(from_end - from.data())),
+            asio::buffer(existing > 0 ? "-\r\n"sv : ""sv),
+            asio::buffer(options.keep_alive ? "Connection: keep-alive\r\n\r\n"sv : "Connection: close\r\n\r\n"sv)
+        };
+        auto send = [&]() -> asio::awaitable<bool> {
+            auto [e, n] = co_await asio::async_write(with_socket, request, asio::as_tuple(asio::use_awaitable));
+            metrics::add(metrics::counter::bytes_sent, n);
+            co_return !e;
+        };
+        if (!(co_await with_deadline(send(), std::min(clock::now() + DEFAULT_IO_TIMEOUT, end))).value_or(false)) {
+            co_return failed("sending the request");
+        }
+
+        response_reader reader(with_socket, options.buffer_size);
+        if (!(co_await with_deadline(reader.read_head(), std::min(clock::now() + options.deadlines.first_byte, end))).value_or(false)) {
+            co_return failed("waiting for the response headers");
+        }
+        result.status = reader.status_code();
+
+        std::uint64_t offset{0};
+        if (result.status == 206 && existing > 0) {
+            if (range_start(reader.header("Content-Range").value_or(""sv)) != existing) {
+                result.status = 0;
+                co_return failed("checking the range that the server sent");
+            }
+            offset = existing;
+        } else if (result.status != 200) {
+            // 416 when we asked for the bytes after the end of a complete file
+            if (result.status == 416 && existing > 0) {
+                result.size = existing;
+            } else {
+                LOG(WARNING) << "download of " << host << resource << " failed with status " << result.status << ENDL;
+            }
+            boost::system::error_code ec;
+            with_socket.close(ec);
+            co_return result;
+        }
+
+        file_sink file{with_socket.get_executor()};
+        if (!file.open(path, offset)) {
+            result.status = 0;
+            co_return failed("opening the file");
+        }
+        bool ok{false};
+#if defined(__linux__) && !defined(BOOST_ASIO_HAS_FILE)
+        if (options.splice && reader.parser().framing() == body_framing::content_length) {
+            ok = co_await splice_body(with_socket, reader, file, options.buffer_size, end);
+        } else
+#endif
+        {
+            ok = (co_await with_deadline(reader.read_body([&file](body_chunk chunk) -> asio::awaitable<bool> {
+                co_return co_await file.write(chunk);
+            }), end)).value_or(false);
+        }
+        result.written = file.offset() - offset;
+        result.size = file.offset();
+        metrics::add(metrics::counter::bytes_received, result.written);
+        if (!ok) {
+            // what was written is kept, so the download can be resumed
+            result.status = 0;
+            co_return failed("reading the body");
+        }
+        if (!(options.keep_alive && reader.reusable())) {
+            boost::system::error_code ec;
+            with_socket.close(ec);
+        }
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "error: while downloading " << host << resource << ": " << e.what() << ENDL;
+        result.status = 0;
+        co_return failed("downloading");
+    }
+    co_return result;
+}
+
+}	// end of namespace comm
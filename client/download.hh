@@ -0,0 +1,38 @@
+#pragma once
+#include "network_fwd.hh"
+#include "deadline.hh"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace comm {
+
+struct download_options {
+    // total is the limit for the whole download
+    request_deadlines deadlines{.total = std::chrono::hours{1}};
+    // if the file already exists, only ask for the rest of it with a range request
+    bool resume{true};
+    // on Linux, move a Content-Length body from the socket to the file with splice, so it never gets to user space
+    bool splice{true};
+    // the size of the slices that are read from the socket and written to the file
+    std::size_t buffer_size{256 * 1'024};
+    bool keep_alive{false};
+};
+
+struct download_result {
+    // the status of the response, 0 on failure. The body is only written for 200, and for 206
+    // when the download was resumed, 416 means that the file was already complete
+    unsigned int status{0};
+    std::uint64_t written{0};       // bytes written to the file by this download
+    std::uint64_t size{0};          // size of the file at the end
+};
+
+// Send a GET request and write the response body to the file at path, slice by slice as it arrives,
+// so memory use does not depend on the size of the body. With resume, a partial file is continued
+// where it stopped, unless the server ignores the range, in which case the file is written from the
+// start. The file is not touched if the server answered with an error
+auto async_http_download(tcp::socket& with_socket, const std::string& host, const std::string& resource,
+                         const std::string& path, download_options options = {}) -> asio::awaitable<download_result>;
+
+}	// end of namespace comm
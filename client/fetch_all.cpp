@@ -0,0 +1,66 @@
+#include "fetch_all.hh"
+#include "async_client.hh"
+#include "connection_pool.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace comm {
+namespace {
+
+// We are limiting the number of requests in flight by starting max_in_flight workers,
+// each one takes the next request that was not handled yet, until there are none left.
+// This works as a semaphore with max_in_flight permits, without the need to wake waiters.
+template<typename Fetch>
+auto fetch_bounded(asio::any_io_executor executor, std::span<const http_request> requests, std::size_t max_in_flight, Fetch fetch) -> asio::awaitable<std::vector<std::string>> {
+  std::vector<std::string> results(requests.size());
+  if (requests.empty()) {
+    co_return results;
+  }
+  std::atomic<std::size_t> next{0};
+
+  auto worker = [&]() -> asio::awaitable<void> {
+    for (auto i = next++; i < requests.size(); i = next++) {
+      const auto& r = requests[i];
+      try {
+        results[i] = co_await fetch(r);
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "failed to fetch " << r.host << ":" << r.port << r.resource << ": " << e.what() << ENDL;
+      }
+    }
+  };
+
+  const auto workers{std::clamp<std::size_t>(max_in_flight, 1, requests.size())};
+  using operation = decltype(asio::co_spawn(executor, worker(), asio::deferred));
+  std::vector<operation> operations;
+  operations.reserve(workers);
+  for (std::size_t i = 0; i < workers; ++i) {
+    operations.push_back(asio::co_spawn(executor, worker(), asio::deferred));
+  }
+  auto [order, exceptions] = co_await asio::experimental::make_parallel_group(std::move(operations)).async_wait(
+          asio::experimental::wait_for_all(), asio::use_awaitable
+  );
+  for (const auto& e : exceptions) {
+    if (e) {
+      std::rethrow_exception(e);
+    }
+  }
+  co_return results;
+}
+
+}		// end of local namespace
+
+auto fetch_all(asio::any_io_executor executor, std::span<const http_request> requests, std::size_t max_in_flight) -> asio::awaitable<std::vector<std::string>> {
+  co_return co_await fetch_bounded(executor, requests, max_in_flight, [](const http_request& r) {
+    return async_http_client(r.host, r.port, r.resource);
+  });
+}
+
+auto fetch_all(connection_pool& pool, std::span<const http_request> requests, std::size_t max_in_flight) -> asio::awaitable<std::vector<std::string>> {
+  co_return co_await fetch_bounded(pool.get_executor(), requests, max_in_flight, [&pool](const http_request& r) {
+    return async_http_client(pool, r.host, r.port, r.resource);
+  });
+}
+
+}	// end of namespace comm
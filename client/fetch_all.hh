@@ -0,0 +1,25 @@
+#pragma once
+#include "network_fwd.hh"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace comm {
+class connection_pool;
+
+struct http_request {
+    std::string host;
+    std::string port;
+    std::string resource;
+};
+
+// Fetch all the requests with at most max_in_flight of them running at the same time.
+// The results are in the same order as the requests, a failed request has an empty result.
+// The requests must stay valid until this completes.
+auto fetch_all(asio::any_io_executor executor, std::span<const http_request> requests, std::size_t max_in_flight) -> asio::awaitable<std::vector<std::string>>;
+
+// Same as above, but the connections are borrowed from the pool, and kept alive between requests
+auto fetch_all(connection_pool& pool, std::span<const http_request> requests, std::size_t max_in_flight) -> asio::awaitable<std::vector<std::string>>;
+
+}	// end of namespace comm
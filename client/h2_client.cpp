@@ -0,0 +1,715 @@
+#include "h2_client.hh"
+#include "async_client.hh"
+#include "buffer_pool.hh"
+#include "http_parser.hh"
+#include "metrics.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <array>
+#include <ostream>
+#include <vector>
+
+namespace comm {
+namespace {
+using clock = request_deadlines::clock;
+
+// DATA frames of a request body that are sent with one write
+constexpr std::size_t MAX_BATCH_FRAMES{16};
+
+auto as_bytes(std::string_view from) -> std::span<const std::byte> {
+    return std::as_bytes(std::span{from.data(), from.size()});
+}
+
+auto as_view(std::span<const std::byte> from) -> std::string_view {
+    return std::string_view{reinterpret_cast<const char*>(from.data()), from.size()};
+}
+
+// HTTP/2 has no connection specific headers (RFC 9113 section 8.2.2), and the host is the :authority
+auto forbidden_header(std::string_view name) -> bool {
+    static constexpr std::array<std::string_view, 7> FORBIDDEN{
+        "connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade", "host", "te"
+    };
+    return std::find(FORBIDDEN.begin(), FORBIDDEN.end(), name) != FORBIDDEN.end();
+}
+
+}		// end of local namespace
+
+// Everything that the reader hands to a request. The request waits on signal, with its deadline
+// as the expiry, and the reader wakes it up by cancelling the wait
+struct h2_connection::stream {
+    explicit stream(const asio::any_io_executor& executor) : signal{executor, clock::time_point::max()} {
+    }
+
+    std::uint32_t id{0};
+    asio::steady_timer signal;
+    h2_response response;
+    std::int64_t send_window{0};
+    std::uint32_t received_unacked{0};  // data that we did not give back with WINDOW_UPDATE yet
+    bool slot{false};       // a waiting request was given a slot
+    bool sending{false};    // waiting for the server to open the send window
+    bool sent_end{false};   // we sent END_STREAM
+    bool closed{false};     // the server sent END_STREAM, the response is complete
+    bool failed{false};
+};
+
+auto operator << (std::ostream& os, const h2_stats& stats) -> std::ostream& {
+    return os << "streams: " << stats.streams << ", failed: " << stats.failed << ", cancelled: " << stats.cancelled
+        << ", window updates: " << stats.window_updates << ", writes: " << stats.writes
+        << ", frames sent: " << stats.frames_sent << ", max active streams: " << stats.max_active;
+}
+
+h2_connection::h2_connection(tcp::socket socket, std::string authority, h2_options options) :
+        socket_{std::move(socket)}, authority_{std::move(authority)}, options_{options},
+        writer_{socket_}, reader_{socket_, options.max_frame},
+        settings_signal_{socket_.get_executor(), clock::time_point::max()} {
+    options_.max_frame = std::clamp(options_.max_frame, h2::DEFAULT_MAX_FRAME, h2::MAX_FRAME_LIMIT);
+    options_.stream_window = std::clamp(options_.stream_window, h2::DEFAULT_WINDOW, h2::MAX_WINDOW);
+    options_.connection_window = std::clamp(options_.connection_window, h2::DEFAULT_WINDOW, h2::MAX_WINDOW);
+    reader_.max_frame(options_.max_frame);
+}
+
+h2_connection::~h2_connection() {
+    boost::system::error_code ec;
+    socket_.close(ec);
+}
+
+auto h2_connection::stats() const -> h2_stats {
+    auto result{stats_};
+    result.writes = writer_.writes();
+    result.frames_sent = writer_.messages();
+    return result;
+}
+
+auto h2_connection::start() -> asio::awaitable<bool> {
+    auto self{shared_from_this()};
+    std::string frames{h2::PREFACE};
+    const std::array<std::pair<h2::setting, std::uint32_t>, 4> settings{{
+        {h2::setting::enable_push, 0},
+        {h2::setting::initial_window_size, options_.stream_window},
+        {h2::setting::max_frame_size, options_.max_frame},
+        {h2::setting::max_header_list_size, options_.max_header_list}
+    }};
+    h2::append_settings(frames, settings);
+    // the connection window can only be changed with a WINDOW_UPDATE
+    if (options_.connection_window > h2::DEFAULT_WINDOW) {
+        h2::append_window_update(frames, 0, options_.connection_window - h2::DEFAULT_WINDOW);
+    }
+    asio::co_spawn(socket_.get_executor(), read_loop(self), asio::detached);
+    if (co_await writer_.send(frames) == 0) {
+        LOG(ERROR) << "failed to send the http/2 preface to " << authority_ << ENDL;
+        shutdown();
+        co_return false;
+    }
+
+    settings_signal_.expires_after(options_.handshake_timeout);
+    while (!settings_received_ && !closed_) {
+        auto [ec] = co_await settings_signal_.async_wait(asio::as_tuple(asio::use_awaitable));
+        if (!ec || (co_await asio::this_coro::cancellation_state).cancelled() != asio::cancellation_type::none) {
+            break;
+        }
+    }
+    if (!settings_received_) {
+        LOG(ERROR) << "error: no http/2 settings from " << authority_ << ", the server may not support h2c" << ENDL;
+        shutdown();
+        co_return false;
+    }
+    co_return true;
+}
+
+auto h2_connection::close() -> asio::awaitable<void> {
+    if (closed_) {
+        co_return;
+    }
+    auto self{shared_from_this()};
+    if (!going_away_) {
+        going_away_ = true;
+        std::string frames;
+        // we never accept streams from the server, so the last one that we handled is 0
+        h2::append_goaway(frames, 0, h2::error_code::no_error);
+        co_await writer_.send(frames);
+        grant_slots();
+    }
+    if (streams_.empty()) {
+        shutdown();
+    }
+}
+
+auto h2_connection::wait(stream& s, clock::time_point deadline) -> asio::awaitable<bool> {
+    s.signal.expires_at(deadline);
+    co_await s.signal.async_wait(asio::as_tuple(asio::use_awaitable));
+    if ((co_await asio::this_coro::cancellation_state).cancelled() != asio::cancellation_type::none) {
+        co_return false;
+    }
+    co_return clock::now() < deadline;
+}
+
+auto h2_connection::request(h2_request req, request_deadlines deadlines) -> asio::awaitable<h2_response> {
+    auto self{shared_from_this()};
+    const auto deadline{clock::now() + deadlines.total};
+    metrics::add(metrics::counter::requests);
+    metrics::stage_timer whole{metrics::stage::request};
+    stream s{socket_.get_executor()};
+
+    auto failed = [&](bool expired) {
+        whole.cancel();
+        metrics::add(expired ? metrics::counter::timeouts : metrics::counter::failures);
+        if (expired) {
+            LOG(WARNING) << "timeout while waiting for " << authority_ << req.resource << ENDL;
+        }
+        return h2_response{.refused = s.response.refused || (!s.id && !is_open())};
+    };
+
+    if (!is_open()) {
+        co_return failed(false);
+    }
+    // wait for a slot, in the order that the requests arrived
+    if (streams_.size() + reserved_ >= max_streams_ || !waiting_.empty()) {
+        waiting_.push_back(&s);
+        while (!s.slot && is_open() && co_await wait(s, deadline)) {
+        }
+        std::erase(waiting_, &s);
+        if (s.slot) {
+            --reserved_;
+        }
+        if (!s.slot || !is_open() || clock::now() >= deadline) {
+            grant_slots();
+            co_return failed(is_open());
+        }
+    }
+    if (next_stream_ > h2::MAX_WINDOW) {
+        // out of stream ids, a new connection is needed
+        going_away_ = true;
+        co_return failed(false);
+    }
+
+    // from here the stream is registered, and it is removed when we leave
+    s.id = next_stream_;
+    next_stream_ += 2;
+    s.send_window = initial_send_window_;
+    streams_.emplace(s.id, &s);
+    struct registration {
+        h2_connection& connection;
+        stream& s;
+        ~registration() {
+            connection.release(s);
+        }
+    } registered{*this, s};
+    ++stats_.streams;
+    stats_.max_active = std::max(stats_.max_active, streams_.size());
+
+    std::string block;
+    encoder_.encode(":method", req.method, block);
+    encoder_.encode(":scheme", "http", block);
+    encoder_.encode(":authority", authority_, block);
+    encoder_.encode(":path", req.resource, block);
+    bool has_length{false};
+    for (const auto& [name, value] : req.headers) {
+        const auto lower{comm::lower(name)};
+        if (!forbidden_header(lower)) {
+            has_length = has_length || lower == "content-length";
+            encoder_.encode(lower, value, block);
+        }
+    }
+    if (!req.body.empty() && !has_length) {
+        encoder_.encode("content-length", std::to_string(req.body.size()), block);
+    }
+    std::string frames;
+    h2::append_headers(frames, s.id, block, req.body.empty(), max_send_frame_);
+    s.sent_end = req.body.empty();
+
+    // the frames are queued before we suspend, so the streams are sent in the order of their ids
+    metrics::stage_timer sending{metrics::stage::send};
+    if (co_await writer_.send(frames) == 0) {
+        sending.cancel();
+        co_return failed(false);
+    }
+    if (!req.body.empty() && !co_await send_body(s, req.body, deadline)) {
+        sending.cancel();
+        co_return failed(clock::now() >= deadline);
+    }
+    sending.stop();
+    metrics::add(metrics::counter::bytes_sent, frames.size() + req.body.size());
+
+    metrics::stage_timer headers{metrics::stage::headers};
+    const auto first_byte{std::min(clock::now() + deadlines.first_byte, deadline)};
+    while (s.response.status == 0 && !s.closed && !s.failed) {
+        if (!co_await wait(s, first_byte)) {
+            headers.cancel();
+            co_return failed(clock::now() >= first_byte);
+        }
+    }
+    headers.stop();
+    metrics::stage_timer reading{metrics::stage::body};
+    while (!s.closed && !s.failed) {
+        if (!co_await wait(s, deadline)) {
+            reading.cancel();
+            co_return failed(clock::now() >= deadline);
+        }
+    }
+    if (s.failed || s.response.status == 0) {
+        reading.cancel();
+        co_return failed(false);
+    }
+    reading.stop();
+    metrics::add(metrics::counter::bytes_received, s.response.body.size());
+    co_return std::move(s.response);
+}
+
+// The body is sent as DATA frames as far as both the connection and the stream windows allow,
+// up to MAX_BATCH_FRAMES of them with one write, then we wait for the server to open the windows
+auto h2_connection::send_body(stream& s, std::string_view body, clock::time_point deadline) -> asio::awaitable<bool> {
+    std::string heads;
+    heads.reserve(MAX_BATCH_FRAMES * h2::FRAME_HEADER_SIZE);
+    std::vector<std::string_view> parts;
+    std::vector<asio::const_buffer> buffers;
+    while (!body.empty()) {
+        if (s.closed || s.failed || closed_) {
+            // the server answered before it read all of the body, this is not an error
+            co_return s.closed;
+        }
+        auto window{std::min(send_window_, s.send_window)};
+        if (window <= 0) {
+            s.sending = true;
+            const auto woken{co_await wait(s, deadline)};
+            s.sending = false;
+            if (!woken) {
+                co_return false;
+            }
+            continue;
+        }
+        heads.clear();
+        parts.clear();
+        while (!body.empty() && window > 0 && parts.size() < MAX_BATCH_FRAMES) {
+            const auto n{std::min<std::size_t>({body.size(), static_cast<std::size_t>(window), max_send_frame_})};
+            window -= static_cast<std::int64_t>(n);
+            send_window_ -= static_cast<std::int64_t>(n);
+            s.send_window -= static_cast<std::int64_t>(n);
+            const auto last{n == body.size()};
+            h2::append_frame_header(heads, static_cast<std::uint32_t>(n), h2::frame_type::data, last ? h2::flags::END_STREAM : 0, s.id);
+            parts.push_back(body.substr(0, n));
+            body.remove_prefix(n);
+            s.sent_end = last;
+        }
+        buffers.clear();
+        for (std::size_t i = 0; i < parts.size(); ++i) {
+            buffers.push_back(asio::buffer(heads.data() + i * h2::FRAME_HEADER_SIZE, h2::FRAME_HEADER_SIZE));
+            buffers.push_back(asio::buffer(parts[i].data(), parts[i].size()));
+        }
+        if (co_await writer_.send(buffers) == 0) {
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+// A stream that we leave before it was done on both sides is reset,
+// so the server stops sending it and its flow control credit is not lost
+auto h2_connection::release(stream& s) -> void {
+    streams_.erase(s.id);
+    if (!closed_ && !s.failed && !(s.closed && s.sent_end)) {
+        std::string frames;
+        h2::append_rst_stream(frames, s.id, s.closed ? h2::error_code::no_error : h2::error_code::cancel);
+        send_control(std::move(frames));
+        if (!s.closed) {
+            ++stats_.cancelled;
+        }
+    }
+    if (going_away_ && streams_.empty() && !closed_) {
+        shutdown();
+        return;
+    }
+    grant_slots();
+}
+
+auto h2_connection::grant_slots() -> void {
+    while (!waiting_.empty() && (!is_open() || streams_.size() + reserved_ < max_streams_)) {
+        auto* next{waiting_.front()};
+        waiting_.pop_front();
+        if (is_open()) {
+            next->slot = true;
+            ++reserved_;
+        }
+        next->signal.cancel();
+    }
+}
+
+auto h2_connection::wake_writers() -> void {
+    for (auto& [id, s] : streams_) {
+        if (s->sending) {
+            s->signal.cancel();
+        }
+    }
+}
+
+auto h2_connection::send_control(std::string frames) -> void {
+    if (!closed_) {
+        asio::co_spawn(socket_.get_executor(), flush_control(shared_from_this(), std::move(frames)), asio::detached);
+    }
+}
+
+auto h2_connection::flush_control(std::shared_ptr<h2_connection> self, std::string frames) -> asio::awaitable<void> {
+    co_await self->writer_.send(frames);
+}
+
+auto h2_connection::connection_error(h2::error_code error, const char* what) -> bool {
+    LOG(ERROR) << "error: http/2 connection to " << authority_ << " failed: " << what << ENDL;
+    error_ = error;
+    return false;
+}
+
+auto h2_connection::shutdown() -> void {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    boost::system::error_code ec;
+    socket_.close(ec);
+    for (auto& [id, s] : streams_) {
+        if (!s->closed && !s->failed) {
+            s->failed = true;
+            ++stats_.failed;
+        }
+        s->signal.cancel();
+    }
+    grant_slots();
+    settings_signal_.cancel();
+}
+
+auto h2_connection::read_loop(std::shared_ptr<h2_connection> self) -> asio::awaitable<void> {
+    while (auto f = co_await reader_.next()) {
+        if (!on_frame(*f)) {
+            break;
+        }
+    }
+    if (reader_.oversized() && error_ == h2::error_code::no_error) {
+        connection_error(h2::error_code::frame_size_error, "frame larger than SETTINGS_MAX_FRAME_SIZE");
+    }
+    if (error_ != h2::error_code::no_error && !closed_) {
+        std::string frames;
+        h2::append_goaway(frames, 0, error_);
+        co_await writer_.send(frames);
+    }
+    shutdown();
+}
+
+auto h2_connection::on_frame(const h2::frame& f) -> bool {
+    using h2::frame_type;
+    // a header block must not be interleaved with any other frame
+    if (header_stream_ != 0 && (f.header.type != frame_type::continuation || f.header.stream != header_stream_)) {
+        return connection_error(h2::error_code::protocol_error, "expected a CONTINUATION frame");
+    }
+    switch (f.header.type) {
+        case frame_type::data:
+            return on_data(f);
+        case frame_type::headers:
+            return on_headers(f);
+        case frame_type::continuation:
+            if (header_stream_ == 0) {
+                return connection_error(h2::error_code::protocol_error, "unexpected CONTINUATION frame");
+            }
+            return add_header_fragment(f.payload) && (!f.header.has(h2::flags::END_HEADERS) || header_block_done(f.header.stream, header_end_stream_));
+        case frame_type::settings:
+            return on_settings(f);
+        case frame_type::ping:
+            if (f.payload.size() != 8) {
+                return connection_error(h2::error_code::frame_size_error, "invalid PING frame");
+            }
+            if (!f.header.has(h2::flags::ACK)) {
+                std::string frames;
+                h2::append_ping(frames, f.payload, true);
+                send_control(std::move(frames));
+            }
+            return true;
+        case frame_type::window_update:
+            return on_window_update(f);
+        case frame_type::rst_stream:
+            if (f.payload.size() != 4 || f.header.stream == 0) {
+                return connection_error(h2::error_code::protocol_error, "invalid RST_STREAM frame");
+            }
+            on_rst_stream(f);
+            return true;
+        case frame_type::goaway:
+            if (f.payload.size() < 8) {
+                return connection_error(h2::error_code::frame_size_error, "invalid GOAWAY frame");
+            }
+            on_goaway(f);
+            return true;
+        case frame_type::push_promise:
+            return connection_error(h2::error_code::protocol_error, "PUSH_PROMISE while push is disabled");
+        default:
+            // PRIORITY and unknown frame types are ignored
+            return true;
+    }
+}
+
+auto h2_connection::on_settings(const h2::frame& f) -> bool {
+    if (f.header.stream != 0) {
+        return connection_error(h2::error_code::protocol_error, "SETTINGS on a stream");
+    }
+    if (f.header.has(h2::flags::ACK)) {
+        return f.payload.empty() || connection_error(h2::error_code::frame_size_error, "SETTINGS ack with a payload");
+    }
+    if (f.payload.size() % 6 != 0) {
+        return connection_error(h2::error_code::frame_size_error, "invalid SETTINGS frame");
+    }
+    for (auto values = f.payload; !values.empty(); values = values.subspan(6)) {
+        const auto id{static_cast<h2::setting>((static_cast<std::uint16_t>(values[0]) << 8) | static_cast<std::uint16_t>(values[1]))};
+        const auto value{h2::read_u32(values.subspan(2))};
+        switch (id) {
+            case h2::setting::max_concurrent_streams:
+                max_streams_ = value;
+                break;
+            case h2::setting::initial_window_size: {
+                if (value > h2::MAX_WINDOW) {
+                    return connection_error(h2::error_code::flow_control_error, "initial window size too large");
+                }
+                // the change applies to the streams that are already open as well
+                const auto delta{static_cast<std::int64_t>(value) - initial_send_window_};
+                for (auto& [stream_id, s] : streams_) {
+                    s->send_window += delta;
+                }
+                initial_send_window_ = value;
+                break;
+            }
+            case h2::setting::max_frame_size:
+                if (value < h2::DEFAULT_MAX_FRAME || value > h2::MAX_FRAME_LIMIT) {
+                    return connection_error(h2::error_code::protocol_error, "invalid max frame size");
+                }
+                max_send_frame_ = value;
+                break;
+            default:
+                // our encoder does not use the dynamic table, so the table size does not matter to us
+                break;
+        }
+    }
+    std::string frames;
+    h2::append_settings_ack(frames);
+    send_control(std::move(frames));
+    settings_received_ = true;
+    settings_signal_.cancel();
+    grant_slots();
+    wake_writers();
+    return true;
+}
+
+auto h2_connection::on_headers(const h2::frame& f) -> bool {
+    if (f.header.stream == 0 || f.header.stream % 2 == 0) {
+        return connection_error(h2::error_code::protocol_error, "HEADERS on a stream that we did not open");
+    }
+    const auto content{h2::frame_content(f)};
+    if (!content) {
+        return connection_error(h2::error_code::protocol_error, "invalid HEADERS frame");
+    }
+    header_block_.clear();
+    if (!add_header_fragment(*content)) {
+        return false;
+    }
+    header_end_stream_ = f.header.has(h2::flags::END_STREAM);
+    if (!f.header.has(h2::flags::END_HEADERS)) {
+        header_stream_ = f.header.stream;
+        return true;
+    }
+    return header_block_done(f.header.stream, header_end_stream_);
+}
+
+// A compressed block is smaller than the list it decodes to, with the 32 bytes that each field
+// counts for, so a block above the limit is never buffered
+auto h2_connection::add_header_fragment(std::span<const std::byte> fragment) -> bool {
+    if (header_block_.size() + fragment.size() > options_.max_header_list) {
+        return connection_error(h2::error_code::enhance_your_calm, "header block larger than SETTINGS_MAX_HEADER_LIST_SIZE");
+    }
+    header_block_.append(as_view(fragment));
+    return true;
+}
+
+// The block is decoded even when the stream is gone, the table of the decoder must follow the server
+auto h2_connection::header_block_done(std::uint32_t id, bool end_stream) -> bool {
+    header_stream_ = 0;
+    auto headers{decoder_.decode(as_bytes(header_block_))};
+    if (!headers) {
+        return connection_error(h2::error_code::compression_error, "invalid header block");
+    }
+    // the size of the list as RFC 9113 section 6.5.2 counts it
+    std::size_t list_size{0};
+    for (const auto& h : *headers) {
+        list_size += h.name.size() + h.value.size() + 32;
+    }
+    if (list_size > options_.max_header_list) {
+        return connection_error(h2::error_code::enhance_your_calm, "header list larger than SETTINGS_MAX_HEADER_LIST_SIZE");
+    }
+    const auto found{streams_.find(id)};
+    if (found == streams_.end()) {
+        return true;
+    }
+    auto& s{*found->second};
+    auto& response{s.response};
+    if (response.status == 0) {
+        const auto status{!headers->empty() && headers->front().name == ":status" ?
+                parse_content_length(headers->front().value) : std::nullopt};
+        if (!status || *status < 100 || *status > 999) {
+            LOG(ERROR) << "error: response without a valid status on stream " << id << " from " << authority_ << ENDL;
+            s.failed = true;
+            ++stats_.failed;
+            s.signal.cancel();
+            return true;
+        }
+        if (*status < 200) {
+            // an interim response, the real one follows it
+            if (end_stream) {
+                s.failed = true;
+                s.signal.cancel();
+            }
+            return true;
+        }
+        response.status = static_cast<unsigned int>(*status);
+    }
+    for (auto& h : *headers) {
+        if (h.name.starts_with(':')) {
+            continue;
+        }
+        if (h.name == "content-length" && response.body.empty()) {
+            if (const auto length{parse_content_length(h.value)}; length) {
+                response.body = pooled_buffer{static_cast<std::size_t>(std::min<std::uint64_t>(*length, pooled_buffer::MAX_RESERVE))}.release();
+            }
+        }
+        response.headers.push_back(std::move(h));
+    }
+    s.closed = end_stream;
+    s.signal.cancel();
+    return true;
+}
+
+// We give the credit back once half of a window was used, so the server does not stall
+// waiting for it. The windows of the server are not enforced, we only track what it sent.
+auto h2_connection::on_data(const h2::frame& f) -> bool {
+    if (f.header.stream == 0) {
+        return connection_error(h2::error_code::protocol_error, "DATA on stream 0");
+    }
+    const auto content{h2::frame_content(f)};
+    if (!content) {
+        return connection_error(h2::error_code::protocol_error, "invalid DATA frame");
+    }
+    // the padding counts for flow control
+    const auto length{static_cast<std::uint32_t>(f.payload.size())};
+    received_unacked_ += length;
+    if (received_unacked_ >= options_.connection_window / 2) {
+        std::string frames;
+        h2::append_window_update(frames, 0, received_unacked_);
+        send_control(std::move(frames));
+        ++stats_.window_updates;
+        received_unacked_ = 0;
+    }
+
+    const auto found{streams_.find(f.header.stream)};
+    if (found == streams_.end()) {
+        return true;
+    }
+    auto& s{*found->second};
+    if (s.response.status == 0) {
+        LOG(ERROR) << "error: DATA before the response headers on stream " << s.id << " from " << authority_ << ENDL;
+        s.failed = true;
+        ++stats_.failed;
+        s.signal.cancel();
+        return true;
+    }
+    s.response.body.append(as_view(*content));
+    if (f.header.has(h2::flags::END_STREAM)) {
+        s.closed = true;
+        s.signal.cancel();
+        return true;
+    }
+    s.received_unacked += length;
+    if (s.received_unacked >= options_.stream_window / 2) {
+        std::string frames;
+        h2::append_window_update(frames, s.id, s.received_unacked);
+        send_control(std::move(frames));
+        ++stats_.window_updates;
+        s.received_unacked = 0;
+    }
+    return true;
+}
+
+auto h2_connection::on_window_update(const h2::frame& f) -> bool {
+    if (f.payload.size() != 4) {
+        return connection_error(h2::error_code::frame_size_error, "invalid WINDOW_UPDATE frame");
+    }
+    const auto increment{h2::read_u32(f.payload) & h2::MAX_WINDOW};
+    if (f.header.stream == 0) {
+        if (increment == 0) {
+            return connection_error(h2::error_code::protocol_error, "WINDOW_UPDATE of 0");
+        }
+        send_window_ += increment;
+        if (send_window_ > h2::MAX_WINDOW) {
+            return connection_error(h2::error_code::flow_control_error, "connection window too large");
+        }
+        wake_writers();
+        return true;
+    }
+    if (const auto found{streams_.find(f.header.stream)}; found != streams_.end()) {
+        found->second->send_window += increment;
+        if (found->second->sending) {
+            found->second->signal.cancel();
+        }
+    }
+    return true;
+}
+
+auto h2_connection::on_rst_stream(const h2::frame& f) -> void {
+    const auto found{streams_.find(f.header.stream)};
+    if (found == streams_.end()) {
+        return;
+    }
+    auto& s{*found->second};
+    const auto error{static_cast<h2::error_code>(h2::read_u32(f.payload))};
+    if (s.closed && error == h2::error_code::no_error) {
+        // the server has the whole response and does not need the rest of the request body
+        return;
+    }
+    LOG(WARNING) << "stream " << s.id << " to " << authority_ << " was reset with error " << static_cast<std::uint32_t>(error) << ENDL;
+    s.failed = true;
+    s.response.refused = error == h2::error_code::refused_stream;
+    ++stats_.failed;
+    s.signal.cancel();
+}
+
+// The streams after the last one that the server handled were not processed, they can be sent again
+auto h2_connection::on_goaway(const h2::frame& f) -> void {
+    const auto last{h2::read_u32(f.payload) & h2::MAX_WINDOW};
+    const auto error{static_cast<h2::error_code>(h2::read_u32(f.payload.subspan(4)))};
+    if (error != h2::error_code::no_error) {
+        LOG(WARNING) << "http/2 server " << authority_ << " is closing the connection with error " << static_cast<std::uint32_t>(error) << ENDL;
+    }
+    going_away_ = true;
+    for (auto& [id, s] : streams_) {
+        if (id > last && !s->closed) {
+            s->failed = true;
+            s->response.refused = true;
+            ++stats_.failed;
+            s->signal.cancel();
+        }
+    }
+    grant_slots();
+}
+
+auto async_h2_connect(std::string host, std::string port, h2_options options, request_deadlines deadlines) -> asio::awaitable<std::shared_ptr<h2_connection>> {
+    connect_options connecting;
+    connecting.deadline = std::min(deadlines.connect, deadlines.total);
+    auto socket = co_await async_connect(host, port, connecting);
+    if (!socket.is_open()) {
+        co_return nullptr;
+    }
+    auto connection = std::make_shared<h2_connection>(std::move(socket), port == "80" ? host : host + ":" + port, options);
+    if (!co_await connection->start()) {
+        co_return nullptr;
+    }
+    co_return connection;
+}
+
+auto async_http_client(h2_connection& connection, std::string resource, request_deadlines deadlines) -> asio::awaitable<std::string> {
+    h2_request req;
+    req.resource = std::move(resource);
+    auto response = co_await connection.request(std::move(req), deadlines);
+    co_return std::move(response.body);
+}
+
+}	// end of namespace comm
@@ -0,0 +1,174 @@
+#pragma once
+#include "network_fwd.hh"
+#include "deadline.hh"
+#include "h2_frame.hh"
+#include "hpack.hh"
+#include "write_queue.hh"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace comm {
+
+// An HTTP/2 client over clear text TCP (h2c), for servers that are known to speak HTTP/2
+// ("prior knowledge", RFC 9113 section 3.3). All the requests to a server share one connection,
+// each of them is a stream of its own, so a slow response does not hold the ones behind it,
+// and there is no connection per concurrent request as with the HTTP/1.1 pool.
+
+struct h2_options {
+    // the receive windows that we give the server, large windows let a single stream
+    // use the whole bandwidth of the connection without waiting for our WINDOW_UPDATE
+    std::uint32_t stream_window{16 * 1'024 * 1'024};
+    std::uint32_t connection_window{64 * 1'024 * 1'024};
+    // the largest frame that we accept
+    std::uint32_t max_frame{h2::DEFAULT_MAX_FRAME};
+    // the largest header list that we accept (SETTINGS_MAX_HEADER_LIST_SIZE), a response
+    // with more is a connection error, so a server cannot make us buffer headers without end
+    std::uint32_t max_header_list{64 * 1'024};
+    // the preface and the settings exchange
+    std::chrono::milliseconds handshake_timeout{std::chrono::seconds{5}};
+};
+
+struct h2_request {
+    std::string method{"GET"};
+    std::string resource{"/"};
+    // more headers, names are sent in lower case, connection specific headers are dropped
+    hpack::header_list headers;
+    // not copied, it must stay valid until request() returns
+    std::string_view body;
+};
+
+struct h2_response {
+    unsigned int status{0};     // 0 if the request failed
+    hpack::header_list headers; // the trailers, if there were any, are added at the end
+    std::string body;
+    // the server did not handle the request (GOAWAY or REFUSED_STREAM), so it is safe to send it again
+    bool refused{false};
+
+    auto ok() const -> bool {
+        return status != 0;
+    }
+};
+
+struct h2_stats {
+    std::uint64_t streams{0};           // requests that were sent
+    std::uint64_t failed{0};            // reset by the server, or lost with the connection
+    std::uint64_t cancelled{0};         // reset by us, after their deadline passed or they were cancelled
+    std::uint64_t window_updates{0};    // WINDOW_UPDATE frames that we sent
+    std::uint64_t writes{0};            // gather writes to the socket, a write carries the frames of many streams
+    std::uint64_t frames_sent{0};       // messages queued for these writes
+    std::size_t max_active{0};          // the largest number of streams that were open at the same time
+};
+
+auto operator << (std::ostream& os, const h2_stats& stats) -> std::ostream&;
+
+// One HTTP/2 connection. The state of each stream lives in the coroutine of its request,
+// and a single reader coroutine hands the frames that arrive to them. The frames that we send
+// go through a write_queue, so the requests that are sent together leave in one write.
+// Like the socket, the connection must only be used from the executor of the socket.
+// Create it with async_h2_connect, it is kept alive by the reader and by the requests in progress.
+class h2_connection : public std::enable_shared_from_this<h2_connection> {
+public:
+    h2_connection(tcp::socket socket, std::string authority, h2_options options);
+    h2_connection(const h2_connection&) = delete;
+    auto operator = (const h2_connection&) -> h2_connection& = delete;
+    ~h2_connection();
+
+    // send the preface and our settings, start reading, and wait for the settings of the server
+    auto start() -> asio::awaitable<bool>;
+
+    // Send the request as a new stream and wait for the whole response. When there are as many
+    // streams open as the server allows, this waits for one of them to finish first. The request
+    // is reset once deadlines.total passed or it was cancelled, the connection stays open.
+    auto request(h2_request req, request_deadlines deadlines = {}) -> asio::awaitable<h2_response>;
+
+    // tell the server that we are done (GOAWAY), and close once the requests in progress are done
+    auto close() -> asio::awaitable<void>;
+
+    // false once the connection failed, or either side started to close it
+    auto is_open() const -> bool {
+        return !closed_ && !going_away_;
+    }
+
+    auto active_streams() const -> std::size_t {
+        return streams_.size();
+    }
+
+    auto stats() const -> h2_stats;
+
+    auto get_executor() -> asio::any_io_executor {
+        return socket_.get_executor();
+    }
+
+private:
+    struct stream;
+
+    // the reader holds self, so the connection lives until the socket is closed
+    auto read_loop(std::shared_ptr<h2_connection> self) -> asio::awaitable<void>;
+    auto on_frame(const h2::frame& f) -> bool;
+    auto on_settings(const h2::frame& f) -> bool;
+    auto on_headers(const h2::frame& f) -> bool;
+    auto on_data(const h2::frame& f) -> bool;
+    auto on_window_update(const h2::frame& f) -> bool;
+    auto on_rst_stream(const h2::frame& f) -> void;
+    auto on_goaway(const h2::frame& f) -> void;
+    auto add_header_fragment(std::span<const std::byte> fragment) -> bool;
+    auto header_block_done(std::uint32_t id, bool end_stream) -> bool;
+
+    auto wait(stream& s, request_deadlines::clock::time_point deadline) -> asio::awaitable<bool>;
+    auto send_body(stream& s, std::string_view body, request_deadlines::clock::time_point deadline) -> asio::awaitable<bool>;
+    auto send_control(std::string frames) -> void;
+    static auto flush_control(std::shared_ptr<h2_connection> self, std::string frames) -> asio::awaitable<void>;
+    auto connection_error(h2::error_code error, const char* what) -> bool;
+    auto shutdown() -> void;
+    auto grant_slots() -> void;
+    auto wake_writers() -> void;
+    auto release(stream& s) -> void;
+
+    tcp::socket socket_;
+    std::string authority_;
+    h2_options options_;
+    write_queue writer_;
+    h2::frame_reader reader_;
+    hpack::encoder encoder_;
+    hpack::decoder decoder_;
+
+    std::unordered_map<std::uint32_t, stream*> streams_;
+    std::deque<stream*> waiting_;           // requests waiting for a stream slot, in order
+    std::size_t reserved_{0};               // slots given to waiting requests that did not open their stream yet
+    asio::steady_timer settings_signal_;    // the start waits here for the settings of the server
+
+    // the settings of the server
+    std::size_t max_streams_{100};          // until we know better
+    std::int64_t initial_send_window_{h2::DEFAULT_WINDOW};
+    std::uint32_t max_send_frame_{h2::DEFAULT_MAX_FRAME};
+
+    std::int64_t send_window_{h2::DEFAULT_WINDOW};      // connection level
+    std::uint32_t received_unacked_{0};                 // connection level data that we did not give back yet
+    std::uint32_t next_stream_{1};
+    std::string header_block_;                          // HEADERS and the CONTINUATION frames that follow it
+    std::uint32_t header_stream_{0};                    // the stream of the header block that is not complete yet
+    bool header_end_stream_{false};
+    h2::error_code error_{h2::error_code::no_error};
+    bool settings_received_{false};
+    bool going_away_{false};
+    bool closed_{false};
+    h2_stats stats_;
+};
+
+// Connect to host:port and start an HTTP/2 connection, nullptr on failure
+auto async_h2_connect(std::string host, std::string port, h2_options options = {},
+                      request_deadlines deadlines = {}) -> asio::awaitable<std::shared_ptr<h2_connection>>;
+
+// Send a GET request as a stream of the connection, as with the other async_http_client
+// functions the body is returned, and it is empty if the request failed
+auto async_http_client(h2_connection& connection, std::string resource, request_deadlines deadlines = {}) -> asio::awaitable<std::string>;
+
+}	// end of namespace comm
@@ -0,0 +1,180 @@
+#include "h2_frame.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <cstring>
+
+namespace comm {
+namespace h2 {
+namespace {
+
+constexpr std::size_t READ_BUFFER_SIZE{64 * 1'024};
+
+auto append_u16(std::string& out, std::uint16_t value) -> void {
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+auto append_u32(std::string& out, std::uint32_t value) -> void {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+auto parse_header(std::span<const std::byte> from) -> frame_header {
+    const auto byte = [&](std::size_t i) {
+        return static_cast<std::uint32_t>(from[i]);
+    };
+    return frame_header{
+        (byte(0) << 16) | (byte(1) << 8) | byte(2),
+        static_cast<frame_type>(from[3]),
+        static_cast<std::uint8_t>(from[4]),
+        read_u32(from.subspan(5)) & MAX_WINDOW      // the reserved bit is ignored
+    };
+}
+
+}		// end of local namespace
+
+auto read_u32(std::span<const std::byte> from) -> std::uint32_t {
+    return (static_cast<std::uint32_t>(from[0]) << 24) | (static_cast<std::uint32_t>(from[1]) << 16) |
+        (static_cast<std::uint32_t>(from[2]) << 8) | static_cast<std::uint32_t>(from[3]);
+}
+
+auto frame_content(const frame& f) -> std::optional<std::span<const std::byte>> {
+    auto payload{f.payload};
+    std::size_t padding{0};
+    if (f.header.has(flags::PADDED)) {
+        if (payload.empty()) {
+            return std::nullopt;
+        }
+        padding = static_cast<std::size_t>(payload[0]);
+        payload = payload.subspan(1);
+    }
+    if (f.header.type == frame_type::headers && f.header.has(flags::PRIORITY)) {
+        // the stream dependency and the weight, that we ignore
+        if (payload.size() < 5) {
+            return std::nullopt;
+        }
+        payload = payload.subspan(5);
+    }
+    if (padding > payload.size()) {
+        return std::nullopt;
+    }
+    return payload.first(payload.size() - padding);
+}
+
+auto append_frame_header(std::string& out, std::uint32_t length, frame_type type, std::uint8_t flags, std::uint32_t stream) -> void {
+    out.push_back(static_cast<char>(length >> 16));
+    out.push_back(static_cast<char>(length >> 8));
+    out.push_back(static_cast<char>(length));
+    out.push_back(static_cast<char>(type));
+    out.push_back(static_cast<char>(flags));
+    append_u32(out, stream & MAX_WINDOW);
+}
+
+auto append_settings(std::string& out, std::span<const std::pair<setting, std::uint32_t>> values) -> void {
+    append_frame_header(out, static_cast<std::uint32_t>(values.size() * 6), frame_type::settings, 0, 0);
+    for (const auto& [id, value] : values) {
+        append_u16(out, static_cast<std::uint16_t>(id));
+        append_u32(out, value);
+    }
+}
+
+auto append_settings_ack(std::string& out) -> void {
+    append_frame_header(out, 0, frame_type::settings, flags::ACK, 0);
+}
+
+auto append_ping(std::string& out, std::span<const std::byte> opaque, bool ack) -> void {
+    append_frame_header(out, 8, frame_type::ping, ack ? flags::ACK : 0, 0);
+    const auto size{std::min<std::size_t>(opaque.size(), 8)};
+    out.append(reinterpret_cast<const char*>(opaque.data()), size);
+    out.append(8 - size, '\0');
+}
+
+auto append_window_update(std::string& out, std::uint32_t stream, std::uint32_t increment) -> void {
+    append_frame_header(out, 4, frame_type::window_update, 0, stream);
+    append_u32(out, increment & MAX_WINDOW);
+}
+
+auto append_rst_stream(std::string& out, std::uint32_t stream, error_code error) -> void {
+    append_frame_header(out, 4, frame_type::rst_stream, 0, stream);
+    append_u32(out, static_cast<std::uint32_t>(error));
+}
+
+auto append_goaway(std::string& out, std::uint32_t last_stream, error_code error) -> void {
+    append_frame_header(out, 8, frame_type::goaway, 0, 0);
+    append_u32(out, last_stream & MAX_WINDOW);
+    append_u32(out, static_cast<std::uint32_t>(error));
+}
+
+auto append_headers(std::string& out, std::uint32_t stream, std::string_view block, bool end_stream, std::uint32_t max_frame) -> void {
+    auto type{frame_type::headers};
+    std::uint8_t first_flags{end_stream ? flags::END_STREAM : std::uint8_t{0}};
+    do {
+        const auto size{std::min<std::size_t>(block.size(), max_frame)};
+        const auto last{size == block.size()};
+        append_frame_header(out, static_cast<std::uint32_t>(size), type, first_flags | (last ? flags::END_HEADERS : 0), stream);
+        out.append(block.substr(0, size));
+        block.remove_prefix(size);
+        type = frame_type::continuation;
+        first_flags = 0;
+    } while (!block.empty());
+}
+
+frame_reader::frame_reader(tcp::socket& socket, std::uint32_t max_frame) :
+        socket_{socket}, max_frame_{max_frame},
+        buffer_{std::max<std::size_t>(READ_BUFFER_SIZE, max_frame + FRAME_HEADER_SIZE)} {
+    buffer_.get().resize(std::max<std::size_t>(READ_BUFFER_SIZE, max_frame + FRAME_HEADER_SIZE));
+}
+
+auto frame_reader::fill(std::size_t needed) -> asio::awaitable<bool> {
+    auto& memory{buffer_.get()};
+    if (available() >= needed) {
+        co_return true;
+    }
+    // move what is left of the last read to the start, so the rest of the frame fits after it
+    if (begin_ + needed > memory.size()) {
+        std::memmove(memory.data(), memory.data() + begin_, available());
+        end_ -= begin_;
+        begin_ = 0;
+        if (needed > memory.size()) {
+            memory.resize(needed);
+        }
+    }
+    while (available() < needed) {
+        auto [ec, n] = co_await socket_.async_read_some(asio::buffer(memory.data() + end_, memory.size() - end_),
+                asio::as_tuple(asio::use_awaitable));
+        if (ec) {
+            if (ec != asio::error::eof && ec != asio::error::operation_aborted) {
+                LOG(WARNING) << "failed to read from the http/2 connection: " << ec.message() << ENDL;
+            }
+            co_return false;
+        }
+        end_ += n;
+    }
+    co_return true;
+}
+
+auto frame_reader::next() -> asio::awaitable<std::optional<frame>> {
+    if (!co_await fill(FRAME_HEADER_SIZE)) {
+        co_return std::nullopt;
+    }
+    const auto header{parse_header(std::as_bytes(std::span{buffer_.get().data() + begin_, FRAME_HEADER_SIZE}))};
+    if (header.length > max_frame_) {
+        LOG(ERROR) << "error: http/2 frame of " << header.length << " bytes is larger than the limit of " << max_frame_ << ENDL;
+        oversized_ = true;
+        co_return std::nullopt;
+    }
+    if (!co_await fill(FRAME_HEADER_SIZE + header.length)) {
+        co_return std::nullopt;
+    }
+    const auto payload{std::as_bytes(std::span{buffer_.get().data() + begin_ + FRAME_HEADER_SIZE, header.length})};
+    begin_ += FRAME_HEADER_SIZE + header.length;
+    if (begin_ == end_) {
+        begin_ = end_ = 0;
+    }
+    co_return frame{header, payload};
+}
+
+}	// end of namespace h2
+}	// end of namespace comm
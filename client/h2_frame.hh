@@ -0,0 +1,148 @@
+#pragma once
+#include "network_fwd.hh"
+#include "buffer_pool.hh"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace comm {
+namespace h2 {
+
+// The framing layer of HTTP/2 (RFC 9113 section 4 and 6), shared by the client and the test server
+
+enum class frame_type : std::uint8_t {
+    data = 0x0,
+    headers = 0x1,
+    priority = 0x2,
+    rst_stream = 0x3,
+    settings = 0x4,
+    push_promise = 0x5,
+    ping = 0x6,
+    goaway = 0x7,
+    window_update = 0x8,
+    continuation = 0x9
+};
+
+namespace flags {
+inline constexpr std::uint8_t END_STREAM{0x1};
+inline constexpr std::uint8_t ACK{0x1};         // on SETTINGS and PING
+inline constexpr std::uint8_t END_HEADERS{0x4};
+inline constexpr std::uint8_t PADDED{0x8};
+inline constexpr std::uint8_t PRIORITY{0x20};
+}	// end of namespace flags
+
+enum class setting : std::uint16_t {
+    header_table_size = 0x1,
+    enable_push = 0x2,
+    max_concurrent_streams = 0x3,
+    initial_window_size = 0x4,
+    max_frame_size = 0x5,
+    max_header_list_size = 0x6
+};
+
+enum class error_code : std::uint32_t {
+    no_error = 0x0,
+    protocol_error = 0x1,
+    internal_error = 0x2,
+    flow_control_error = 0x3,
+    settings_timeout = 0x4,
+    stream_closed = 0x5,
+    frame_size_error = 0x6,
+    refused_stream = 0x7,
+    cancel = 0x8,
+    compression_error = 0x9,
+    connect_error = 0xa,
+    enhance_your_calm = 0xb,
+    inadequate_security = 0xc,
+    http_1_1_required = 0xd
+};
+
+// what a client sends first, with prior knowledge that the server speaks h2c
+inline constexpr std::string_view PREFACE{"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"};
+
+inline constexpr std::size_t FRAME_HEADER_SIZE{9};
+inline constexpr std::uint32_t DEFAULT_WINDOW{65'535};
+inline constexpr std::uint32_t DEFAULT_MAX_FRAME{16'384};
+inline constexpr std::uint32_t MAX_FRAME_LIMIT{(1u << 24) - 1};
+inline constexpr std::uint32_t MAX_WINDOW{(1u << 31) - 1};
+
+struct frame_header {
+    std::uint32_t length{0};
+    frame_type type{frame_type::data};
+    std::uint8_t flags{0};
+    std::uint32_t stream{0};
+
+    auto has(std::uint8_t flag) const -> bool {
+        return (flags & flag) != 0;
+    }
+};
+
+// A frame as it was read, the payload points into the buffer of the reader
+// and is only valid until the next frame is read
+struct frame {
+    frame_header header;
+    std::span<const std::byte> payload;
+};
+
+auto read_u32(std::span<const std::byte> from) -> std::uint32_t;
+
+// the payload of DATA and HEADERS without the padding (and for HEADERS the priority fields), nullopt if it is malformed
+auto frame_content(const frame& f) -> std::optional<std::span<const std::byte>>;
+
+// Append a frame to out, these are used to build the frames that are then sent through a write_queue
+auto append_frame_header(std::string& out, std::uint32_t length, frame_type type, std::uint8_t flags, std::uint32_t stream) -> void;
+auto append_settings(std::string& out, std::span<const std::pair<setting, std::uint32_t>> values) -> void;
+auto append_settings_ack(std::string& out) -> void;
+auto append_ping(std::string& out, std::span<const std::byte> opaque, bool ack) -> void;
+auto append_window_update(std::string& out, std::uint32_t stream, std::uint32_t increment) -> void;
+auto append_rst_stream(std::string& out, std::uint32_t stream, error_code error) -> void;
+auto append_goaway(std::string& out, std::uint32_t last_stream, error_code error) -> void;
+// a HEADERS frame, followed by CONTINUATION frames if the block is larger than max_frame
+auto append_headers(std::string& out, std::uint32_t stream, std::string_view block, bool end_stream, std::uint32_t max_frame) -> void;
+
+// Read whole frames from the socket. The reads are made into a pooled buffer, that holds
+// as many frames as one read returned, so the frames in it are handled without another syscall
+class frame_reader {
+public:
+    explicit frame_reader(tcp::socket& socket, std::uint32_t max_frame = DEFAULT_MAX_FRAME);
+
+    // the next frame, nullopt if the connection was closed, failed, or the frame was larger than the limit
+    auto next() -> asio::awaitable<std::optional<frame>>;
+
+    // next stopped on a frame larger than the limit, the connection must be closed with FRAME_SIZE_ERROR
+    auto oversized() const -> bool {
+        return oversized_;
+    }
+
+    // the largest payload that we accept, what we announced with SETTINGS_MAX_FRAME_SIZE
+    auto max_frame(std::uint32_t limit) -> void {
+        max_frame_ = limit;
+    }
+
+    // bytes that were read and not handled yet, when it is 0 the next frame needs another read,
+    // so this is the time to send what the frames so far called for
+    auto buffered() const -> std::size_t {
+        return available();
+    }
+
+private:
+    auto available() const -> std::size_t {
+        return end_ - begin_;
+    }
+
+    auto fill(std::size_t needed) -> asio::awaitable<bool>;
+
+    tcp::socket& socket_;
+    std::uint32_t max_frame_;
+    pooled_buffer buffer_;
+    std::size_t begin_{0};
+    std::size_t end_{0};
+    bool oversized_{false};
+};
+
+}	// end of namespace h2
+}	// end of namespace comm
@@ -0,0 +1,99 @@
+#include "histogram.hh"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <ostream>
+
+namespace comm {
+namespace {
+
+auto lowest_in_bucket(std::size_t index) -> std::uint64_t {
+    constexpr auto half{latency_histogram::HALF_BUCKET};
+    if (index < 2 * half) {
+        return index;
+    }
+    const auto shift{index / half - 1};
+    return static_cast<std::uint64_t>(index - shift * half) << shift;
+}
+
+auto as_micro(std::chrono::nanoseconds d) -> double {
+    return static_cast<double>(d.count()) / 1'000.0;
+}
+
+}		// end of local namespace
+
+// Values below 2 * HALF_BUCKET have a bucket each. Above that, each power of two
+// range is split into HALF_BUCKET buckets, by the top SUB_BUCKET_BITS bits of the value
+auto latency_histogram::bucket_of(std::uint64_t value) -> std::size_t {
+    if (value < 2 * HALF_BUCKET) {
+        return static_cast<std::size_t>(value);
+    }
+    const auto shift{static_cast<std::size_t>(std::bit_width(value)) - SUB_BUCKET_BITS};
+    return shift * HALF_BUCKET + static_cast<std::size_t>(value >> shift);
+}
+
+auto latency_histogram::highest_in_bucket(std::size_t index) -> std::uint64_t {
+    return index + 1 < BUCKETS ? lowest_in_bucket(index + 1) - 1 : UINT64_MAX;
+}
+
+auto latency_histogram::record(std::uint64_t value) -> void {
+    ++counts_[bucket_of(value)];
+    ++count_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+auto latency_histogram::merge(const latency_histogram& other) -> void {
+    for (std::size_t i = 0; i < BUCKETS; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+auto latency_histogram::reset() -> void {
+    *this = latency_histogram{};
+}
+
+auto latency_histogram::min() const -> duration {
+    return duration{count_ == 0 ? 0 : static_cast<duration::rep>(min_)};
+}
+
+auto latency_histogram::max() const -> duration {
+    return duration{static_cast<duration::rep>(max_)};
+}
+
+auto latency_histogram::mean() const -> duration {
+    return duration{count_ == 0 ? 0 : static_cast<duration::rep>(sum_ / count_)};
+}
+
+auto latency_histogram::percentile(double fraction) const -> duration {
+    if (count_ == 0) {
+        return duration{0};
+    }
+    const auto wanted{std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * static_cast<double>(count_))))};
+    std::uint64_t seen{0};
+    for (std::size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= wanted) {
+            // the bucket is an approximation, but it can never be beyond the largest value we saw
+            return duration{static_cast<duration::rep>(std::min(highest_in_bucket(i), max_))};
+        }
+    }
+    return max();
+}
+
+auto operator << (std::ostream& os, const latency_histogram& h) -> std::ostream& {
+    return os << "count: " << h.count() << ", min: " << as_micro(h.min()) << "us"
+        << ", mean: " << as_micro(h.mean()) << "us"
+        << ", p50: " << as_micro(h.percentile(0.5)) << "us"
+        << ", p90: " << as_micro(h.percentile(0.9)) << "us"
+        << ", p99: " << as_micro(h.percentile(0.99)) << "us"
+        << ", p99.9: " << as_micro(h.percentile(0.999)) << "us"
+        << ", max: " << as_micro(h.max()) << "us";
+}
+
+}	// end of namespace comm
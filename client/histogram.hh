@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace comm {
+
+// Latency histogram in the style of HdrHistogram: values are counted in log-linear
+// buckets, so the precision is better than 2% over the whole range (nanoseconds to hours),
+// with a fixed size and no allocations. Recording is a few instructions and
+// it is not thread safe - use one per thread and merge them.
+class latency_histogram {
+public:
+    using duration = std::chrono::nanoseconds;
+
+    static constexpr unsigned SUB_BUCKET_BITS{7};
+    static constexpr std::size_t HALF_BUCKET{std::size_t{1} << (SUB_BUCKET_BITS - 1)};
+    static constexpr std::size_t BUCKETS{(64 - SUB_BUCKET_BITS + 1) * HALF_BUCKET + HALF_BUCKET};
+
+    auto record(duration value) -> void {
+        record(static_cast<std::uint64_t>(value.count() < 0 ? 0 : value.count()));
+    }
+
+    auto record(std::uint64_t value) -> void;
+
+    auto merge(const latency_histogram& other) -> void;
+
+    auto reset() -> void;
+
+    auto count() const -> std::uint64_t {
+        return count_;
+    }
+
+    auto min() const -> duration;
+    auto max() const -> duration;
+    auto mean() const -> duration;
+
+    // the value below which the given fraction of the values are, i.e. percentile(0.99) is p99
+    auto percentile(double fraction) const -> duration;
+
+    // the counts per bucket, with the highest value of each bucket, for exporting the distribution
+    auto buckets() const -> const std::array<std::uint64_t, BUCKETS>& {
+        return counts_;
+    }
+
+    static auto bucket_of(std::uint64_t value) -> std::size_t;
+    static auto highest_in_bucket(std::size_t index) -> std::uint64_t;
+
+private:
+    std::array<std::uint64_t, BUCKETS> counts_{};
+    std::uint64_t count_{0};
+    std::uint64_t sum_{0};
+    std::uint64_t min_{UINT64_MAX};
+    std::uint64_t max_{0};
+};
+
+// print count, min, mean, p50, p90, p99, p99.9 and max
+auto operator << (std::ostream& os, const latency_histogram& h) -> std::ostream&;
+
+}	// end of namespace comm
@@ -0,0 +1,464 @@
+#include "hpack.hh"
+#include <array>
+#include <limits>
+
+namespace comm {
+namespace hpack {
+namespace {
+
+// RFC 7541 appendix B, the code of each symbol, 256 is EOS
+struct huffman_code {
+    std::uint32_t code;
+    std::uint8_t bits;
+};
+
+constexpr std::array<huffman_code, 257> HUFFMAN_CODES{{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+}};
+
+// RFC 7541 appendix A, index 1 is the first entry
+constexpr std::size_t STATIC_TABLE_SIZE{61};
+
+struct static_entry {
+    std::string_view name;
+    std::string_view value;
+};
+
+constexpr std::array<static_entry, STATIC_TABLE_SIZE> STATIC_TABLE{{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+// each entry of the dynamic table counts as its strings and this overhead
+constexpr std::size_t ENTRY_OVERHEAD{32};
+constexpr std::uint16_t EOS{256};
+// the longest string or the largest index that we accept, a bound on what a peer can make us allocate
+constexpr std::uint64_t MAX_INTEGER{std::uint64_t{1} << 24};
+
+auto entry_size(std::string_view name, std::string_view value) -> std::size_t {
+    return name.size() + value.size() + ENTRY_OVERHEAD;
+}
+
+// a binary tree of the code, built once, that is walked one bit at a time when decoding
+struct huffman_tree {
+    struct node {
+        std::array<std::int16_t, 2> next{-1, -1};
+        std::int16_t symbol{-1};
+    };
+
+    std::vector<node> nodes;
+
+    huffman_tree() {
+        nodes.reserve(2 * HUFFMAN_CODES.size());
+        nodes.emplace_back();
+        for (std::size_t symbol = 0; symbol < HUFFMAN_CODES.size(); ++symbol) {
+            const auto [code, bits] = HUFFMAN_CODES[symbol];
+            std::size_t current{0};
+            for (int bit = bits - 1; bit >= 0; --bit) {
+                const auto branch{(code >> bit) & 1};
+                if (nodes[current].next[branch] < 0) {
+                    nodes[current].next[branch] = static_cast<std::int16_t>(nodes.size());
+                    nodes.emplace_back();
+                }
+                current = static_cast<std::size_t>(nodes[current].next[branch]);
+            }
+            nodes[current].symbol = static_cast<std::int16_t>(symbol);
+        }
+    }
+};
+
+auto tree() -> const huffman_tree& {
+    static const huffman_tree instance;
+    return instance;
+}
+
+auto encode_integer(std::uint64_t value, int prefix_bits, std::uint8_t flags, std::string& out) -> void {
+    const std::uint64_t limit{(std::uint64_t{1} << prefix_bits) - 1};
+    if (value < limit) {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out.push_back(static_cast<char>(flags | limit));
+    value -= limit;
+    while (value >= 128) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+auto encode_string(std::string_view value, std::string& out) -> void {
+    if (const auto coded{huffman_encoded_size(value)}; coded < value.size()) {
+        encode_integer(coded, 7, 0x80, out);
+        huffman_encode(value, out);
+    } else {
+        encode_integer(value.size(), 7, 0, out);
+        out.append(value);
+    }
+}
+
+// index of the entry in the static table, and whether the value matched too
+auto find_static(std::string_view name, std::string_view value) -> std::pair<std::size_t, bool> {
+    std::size_t by_name{0};
+    for (std::size_t i = 0; i < STATIC_TABLE.size(); ++i) {
+        if (STATIC_TABLE[i].name == name) {
+            if (STATIC_TABLE[i].value == value) {
+                return {i + 1, true};
+            }
+            if (by_name == 0) {
+                by_name = i + 1;
+            }
+        }
+    }
+    return {by_name, false};
+}
+
+// reads the representations of a header block, all reads are bounds checked
+class block_reader {
+public:
+    explicit block_reader(std::span<const std::byte> block) : block_{block} {
+    }
+
+    auto done() const -> bool {
+        return position_ == block_.size();
+    }
+
+    auto peek() const -> std::uint8_t {
+        return static_cast<std::uint8_t>(block_[position_]);
+    }
+
+    auto integer(int prefix_bits) -> std::optional<std::uint64_t> {
+        if (done()) {
+            return std::nullopt;
+        }
+        const std::uint64_t limit{(std::uint64_t{1} << prefix_bits) - 1};
+        std::uint64_t value{peek() & limit};
+        ++position_;
+        if (value < limit) {
+            return value;
+        }
+        for (int shift = 0; ; shift += 7) {
+            if (done() || shift > 28) {
+                return std::nullopt;
+            }
+            const auto next{peek()};
+            ++position_;
+            value += std::uint64_t{next & 0x7fu} << shift;
+            if ((next & 0x80) == 0) {
+                break;
+            }
+        }
+        return value <= MAX_INTEGER ? std::optional{value} : std::nullopt;
+    }
+
+    auto string() -> std::optional<std::string> {
+        if (done()) {
+            return std::nullopt;
+        }
+        const bool huffman{(peek() & 0x80) != 0};
+        const auto length{integer(7)};
+        if (!length || *length > block_.size() - position_) {
+            return std::nullopt;
+        }
+        const auto data{block_.subspan(position_, *length)};
+        position_ += *length;
+        std::string result;
+        if (!huffman) {
+            result.assign(reinterpret_cast<const char*>(data.data()), data.size());
+        } else if (!huffman_decode(data, result)) {
+            return std::nullopt;
+        }
+        return result;
+    }
+
+private:
+    std::span<const std::byte> block_;
+    std::size_t position_{0};
+};
+
+}		// end of local namespace
+
+auto huffman_encoded_size(std::string_view input) -> std::size_t {
+    std::size_t bits{0};
+    for (const auto c : input) {
+        bits += HUFFMAN_CODES[static_cast<std::uint8_t>(c)].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+auto huffman_encode(std::string_view input, std::string& out) -> void {
+    std::uint64_t pending{0};
+    int count{0};
+    for (const auto c : input) {
+        const auto [code, bits] = HUFFMAN_CODES[static_cast<std::uint8_t>(c)];
+        pending = (pending << bits) | code;
+        count += bits;
+        while (count >= 8) {
+            count -= 8;
+            out.push_back(static_cast<char>(pending >> count));
+        }
+    }
+    if (count > 0) {
+        // the padding is the most significant bits of EOS, all ones
+        out.push_back(static_cast<char>((pending << (8 - count)) | (0xffu >> count)));
+    }
+}
+
+auto huffman_decode(std::span<const std::byte> input, std::string& out) -> bool {
+    const auto& nodes{tree().nodes};
+    std::size_t current{0};
+    // the bits since the last symbol, at the end they must be fewer than 8 and all ones
+    int depth{0};
+    bool ones{true};
+    for (const auto b : input) {
+        const auto byte{static_cast<std::uint8_t>(b)};
+        for (int bit = 7; bit >= 0; --bit) {
+            const auto branch{(byte >> bit) & 1};
+            const auto next{nodes[current].next[branch]};
+            if (next < 0) {
+                return false;
+            }
+            current = static_cast<std::size_t>(next);
+            ++depth;
+            ones = ones && branch == 1;
+            if (const auto symbol{nodes[current].symbol}; symbol >= 0) {
+                if (symbol == EOS) {
+                    return false;
+                }
+                out.push_back(static_cast<char>(symbol));
+                current = 0;
+                depth = 0;
+                ones = true;
+            }
+        }
+    }
+    return depth < 8 && ones;
+}
+
+auto encoder::encode(std::string_view name, std::string_view value, std::string& out) const -> void {
+    const auto [index, exact] = find_static(name, value);
+    if (exact) {
+        encode_integer(index, 7, 0x80, out);
+        return;
+    }
+    // literal header field without indexing
+    encode_integer(index, 4, 0, out);
+    if (index == 0) {
+        encode_string(name, out);
+    }
+    encode_string(value, out);
+}
+
+auto decoder::lookup(std::uint64_t index) const -> std::optional<header> {
+    if (index == 0) {
+        return std::nullopt;
+    }
+    if (index <= STATIC_TABLE.size()) {
+        const auto& entry{STATIC_TABLE[index - 1]};
+        return header{std::string{entry.name}, std::string{entry.value}};
+    }
+    index -= STATIC_TABLE.size() + 1;
+    return index < table_.size() ? std::optional{table_[index]} : std::nullopt;
+}
+
+auto decoder::evict(std::size_t limit) -> void {
+    while (size_ > limit && !table_.empty()) {
+        size_ -= entry_size(table_.back().name, table_.back().value);
+        table_.pop_back();
+    }
+}
+
+auto decoder::insert(header entry) -> void {
+    const auto size{entry_size(entry.name, entry.value)};
+    // an entry larger than the table empties it and is not added
+    evict(size > max_size_ ? 0 : max_size_ - size);
+    if (size <= max_size_) {
+        size_ += size;
+        table_.push_front(std::move(entry));
+    }
+}
+
+auto decoder::decode(std::span<const std::byte> block) -> std::optional<header_list> {
+    block_reader reader{block};
+    header_list headers;
+    bool seen_header{false};
+    while (!reader.done()) {
+        const auto first{reader.peek()};
+        if (first & 0x80) {
+            // indexed header field
+            const auto index{reader.integer(7)};
+            auto entry{index ? lookup(*index) : std::nullopt};
+            if (!entry) {
+                return std::nullopt;
+            }
+            headers.push_back(std::move(*entry));
+            seen_header = true;
+            continue;
+        }
+        if ((first & 0xe0) == 0x20) {
+            // dynamic table size update, only allowed at the start of a block
+            const auto size{reader.integer(5)};
+            if (!size || *size > max_allowed_ || seen_header) {
+                return std::nullopt;
+            }
+            max_size_ = *size;
+            evict(max_size_);
+            continue;
+        }
+        // a literal, with incremental indexing (6 bits prefix), or without/never indexed (4 bits prefix)
+        const bool indexing{(first & 0xc0) == 0x40};
+        const auto index{reader.integer(indexing ? 6 : 4)};
+        if (!index) {
+            return std::nullopt;
+        }
+        header field;
+        if (*index == 0) {
+            auto name{reader.string()};
+            if (!name) {
+                return std::nullopt;
+            }
+            field.name = std::move(*name);
+        } else if (auto entry{lookup(*index)}; entry) {
+            field.name = std::move(entry->name);
+        } else {
+            return std::nullopt;
+        }
+        auto value{reader.string()};
+        if (!value) {
+            return std::nullopt;
+        }
+        field.value = std::move(*value);
+        if (indexing) {
+            insert(field);
+        }
+        headers.push_back(std::move(field));
+        seen_header = true;
+    }
+    return headers;
+}
+
+}	// end of namespace hpack
+}	// end of namespace comm
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace comm {
+namespace hpack {
+
+// HPACK (RFC 7541), the header compression of HTTP/2
+
+struct header {
+    std::string name;
+    std::string value;
+};
+
+using header_list = std::vector<header>;
+
+// The encoder does not use the dynamic table, so header blocks can be sent in any order
+// and the peer never has to keep state for us. Headers that are in the static table are
+// sent as an index, and strings are Huffman coded when that makes them shorter.
+class encoder {
+public:
+    auto encode(std::string_view name, std::string_view value, std::string& out) const -> void;
+
+    auto encode(const header_list& headers, std::string& out) const -> void {
+        for (const auto& h : headers) {
+            encode(h.name, h.value, out);
+        }
+    }
+};
+
+// Decode header blocks, with the dynamic table that the peer keeps in sync through them.
+// All the blocks of a connection must go through the same decoder, in the order they arrived.
+class decoder {
+public:
+    static constexpr std::size_t DEFAULT_TABLE_SIZE{4'096};
+
+    explicit decoder(std::size_t max_table_size = DEFAULT_TABLE_SIZE) : max_allowed_{max_table_size}, max_size_{max_table_size} {
+    }
+
+    // decode a whole header block, nullopt if it is not valid (a COMPRESSION_ERROR for the connection)
+    auto decode(std::span<const std::byte> block) -> std::optional<header_list>;
+
+    auto table_size() const -> std::size_t {
+        return size_;
+    }
+
+private:
+    auto lookup(std::uint64_t index) const -> std::optional<header>;
+    auto insert(header entry) -> void;
+    auto evict(std::size_t limit) -> void;
+
+    std::deque<header> table_;      // the newest entry is first
+    std::size_t max_allowed_;       // the limit that we announced in the settings
+    std::size_t max_size_;          // the limit that the encoder asked for, up to max_allowed_
+    std::size_t size_{0};
+};
+
+// Huffman code of the strings, exposed for testing
+auto huffman_encode(std::string_view input, std::string& out) -> void;
+auto huffman_encoded_size(std::string_view input) -> std::size_t;
+auto huffman_decode(std::span<const std::byte> input, std::string& out) -> bool;
+
+}	// end of namespace hpack
+}	// end of namespace comm
@@ -0,0 +1,252 @@
+#include "http_parser.hh"
+#include <charconv>
+
+namespace comm {
+namespace {
+
+constexpr auto lower(char c) -> char {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+constexpr auto is_space(char c) -> bool {
+    return c == ' ' || c == '\t';
+}
+
+auto is_digit(char c) -> bool {
+    return c >= '0' && c <= '9';
+}
+
+}		// end of local namespace
+
+auto iequals(std::string_view a, std::string_view b) -> bool {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (lower(a[i]) != lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+auto trim(std::string_view value) -> std::string_view {
+    while (!value.empty() && is_space(value.front())) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && is_space(value.back())) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+auto lower(std::string_view value) -> std::string {
+    std::string result;
+    result.reserve(value.size());
+    for (const auto c : value) {
+        result.push_back(lower(c));
+    }
+    return result;
+}
+
+auto parse_content_length(std::string_view value) -> std::optional<std::uint64_t> {
+    std::uint64_t length{0};
+    const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+    if (ec != std::errc{} || end != value.data() + value.size() || value.empty()) {
+        return std::nullopt;
+    }
+    return length;
+}
+
+auto has_token(std::string_view value, std::string_view token) -> bool {
+    while (!value.empty()) {
+        const auto i{value.find(',')};
+        if (iequals(trim(value.substr(0, i)), token)) {
+            return true;
+        }
+        if (i == std::string_view::npos) {
+            break;
+        }
+        value.remove_prefix(i + 1);
+    }
+    return false;
+}
+
+template<typename StartLine, typename Finish>
+auto message_parser::parse_lines(std::string_view data, StartLine start_line, Finish finish) -> result {
+    while (state_ == state::start_line || state_ == state::headers) {
+        const auto end{data.find('\n', position_)};
+        if (end == std::string_view::npos || end >= MAX_HEADER_SIZE) {
+            if (data.size() >= MAX_HEADER_SIZE) {
+                state_ = state::error;
+                break;
+            }
+            return result::incomplete;
+        }
+        auto length{end - position_};
+        if (length > 0 && data[end - 1] == '\r') {
+            --length;
+        }
+        const auto line{data.substr(position_, length)};
+        const auto offset{static_cast<std::uint32_t>(position_)};
+        position_ = end + 1;
+
+        if (state_ == state::start_line) {
+            // we should ignore empty lines before the start line (RFC 7230, 3.5)
+            if (line.empty()) {
+                continue;
+            }
+            state_ = start_line(line, offset) ? state::headers : state::error;
+        } else if (line.empty()) {
+            header_size_ = position_;
+            state_ = finish() ? state::done : state::error;
+        } else if (!parse_header(line, offset)) {
+            state_ = state::error;
+        }
+    }
+    return state_ == state::done ? result::done : result::error;
+}
+
+auto response_parser::parse(std::string_view data) -> result {
+    return parse_lines(data, [this](std::string_view line, std::uint32_t offset) {
+        return parse_status(line, offset);
+    }, [this]() {
+        return finish();
+    });
+}
+
+auto response_parser::parse_status(std::string_view line, std::uint32_t offset) -> bool {
+    // HTTP/1.1 200 OK
+    static constexpr std::string_view PREFIX{"HTTP/1."};
+    if (line.size() < 12 || line.substr(0, PREFIX.size()) != PREFIX || !is_digit(line[7]) || line[8] != ' ') {
+        return false;
+    }
+    minor_ = static_cast<unsigned int>(line[7] - '0');
+    const auto code{line.substr(9, 3)};
+    if (!(is_digit(code[0]) && is_digit(code[1]) && is_digit(code[2]))) {
+        return false;
+    }
+    status_ = static_cast<unsigned int>((code[0] - '0') * 100 + (code[1] - '0') * 10 + (code[2] - '0'));
+    if (line.size() > 12 && line[12] != ' ') {
+        return false;
+    }
+    status_line_ = text_range{offset, static_cast<std::uint32_t>(line.size())};
+    reason_ = line.size() > 13 ?
+        text_range{offset + 13, static_cast<std::uint32_t>(line.size() - 13)} :
+        text_range{offset + static_cast<std::uint32_t>(line.size()), 0};
+    keep_alive_ = minor_ >= 1;
+    return true;
+}
+
+auto message_parser::parse_header(std::string_view line, std::uint32_t offset) -> bool {
+    // obsolete line folding is not supported (RFC 7230, 3.2.4)
+    if (is_space(line.front()) || count_ == MAX_HEADERS) {
+        return false;
+    }
+    const auto colon{line.find(':')};
+    if (colon == std::string_view::npos || colon == 0) {
+        return false;
+    }
+    const auto name{line.substr(0, colon)};
+    if (is_space(name.back())) {
+        return false;
+    }
+    const auto raw_value{line.substr(colon + 1)};
+    const auto value{trim(raw_value)};
+    const auto value_offset{offset + colon + 1 + static_cast<std::uint32_t>(value.empty() ? 0 : value.data() - raw_value.data())};
+    headers_[count_++] = header_field{
+        text_range{offset, static_cast<std::uint32_t>(name.size())},
+        text_range{static_cast<std::uint32_t>(value_offset), static_cast<std::uint32_t>(value.size())}
+    };
+
+    // the headers that control the framing are processed as we go
+    if (iequals(name, "Content-Length")) {
+        // a repeated Content-Length must have the same value, otherwise we cannot tell where the body ends
+        const auto length{parse_content_length(value)};
+        if (!length || (has_content_length_ && *length != content_length_)) {
+            return false;
+        }
+        content_length_ = *length;
+        has_content_length_ = true;
+        // Transfer-Encoding takes precedence over Content-Length (RFC 7230, 3.3.3)
+        if (!transfer_encoding_) {
+            framing_ = body_framing::content_length;
+        }
+    } else if (iequals(name, "Transfer-Encoding")) {
+        // chunked must be the last encoding, otherwise the body is delimited by close
+        transfer_encoding_ = true;
+        const auto last{value.rfind(',')};
+        if (iequals(trim(last == std::string_view::npos ? value : value.substr(last + 1)), "chunked")) {
+            framing_ = body_framing::chunked;
+        } else {
+            framing_ = body_framing::close;
+        }
+    } else if (iequals(name, "Connection")) {
+        if (has_token(value, "close")) {
+            keep_alive_ = false;
+        } else if (has_token(value, "keep-alive")) {
+            keep_alive_ = true;
+        }
+    }
+    return true;
+}
+
+auto response_parser::finish() -> bool {
+    if ((status_ >= 100 && status_ < 200) || status_ == 204 || status_ == 304) {
+        framing_ = body_framing::none;
+    } else if (framing_ == body_framing::content_length && content_length_ == 0) {
+        framing_ = body_framing::none;
+    }
+    return true;
+}
+
+auto request_parser::parse(std::string_view data) -> result {
+    return parse_lines(data, [this](std::string_view line, std::uint32_t offset) {
+        return parse_request_line(line, offset);
+    }, [this]() {
+        return finish();
+    });
+}
+
+auto request_parser::parse_request_line(std::string_view line, std::uint32_t offset) -> bool {
+    // GET /index.html HTTP/1.1
+    const auto method_end{line.find(' ')};
+    if (method_end == 0 || method_end == std::string_view::npos) {
+        return false;
+    }
+    const auto target_end{line.find(' ', method_end + 1)};
+    if (target_end == std::string_view::npos || target_end == method_end + 1) {
+        return false;
+    }
+    const auto version{line.substr(target_end + 1)};
+    if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+        return false;
+    }
+    minor_ = static_cast<unsigned int>(version.back() - '0');
+    method_ = text_range{offset, static_cast<std::uint32_t>(method_end)};
+    target_ = text_range{offset + static_cast<std::uint32_t>(method_end + 1), static_cast<std::uint32_t>(target_end - method_end - 1)};
+    keep_alive_ = minor_ >= 1;
+    return true;
+}
+
+auto request_parser::finish() -> bool {
+    // a request is not delimited by closing the connection, as then there is no way to answer it
+    if (transfer_encoding_ && framing_ != body_framing::chunked) {
+        return false;
+    }
+    if (framing_ == body_framing::close || (framing_ == body_framing::content_length && content_length_ == 0)) {
+        framing_ = body_framing::none;
+    }
+    return true;
+}
+
+auto message_parser::find(std::string_view data, std::string_view name) const -> std::optional<std::string_view> {
+    for (const auto& h : headers()) {
+        if (iequals(h.name.view(data), name)) {
+            return h.value.view(data);
+        }
+    }
+    return std::nullopt;
+}
+
+}	// end of namespace comm
@@ -0,0 +1,186 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace comm {
+
+// How the body of the response is delimited
+enum class body_framing {
+    none,               // no body at all (1xx, 204 and 304)
+    content_length,     // exactly content_length() bytes
+    chunked,            // Transfer-Encoding: chunked
+    close               // read until the server close the connection
+};
+
+// Location of some text inside the buffer that was passed to the parser.
+// We are not storing views, as the buffer may be reallocated as it grows.
+struct text_range {
+    std::uint32_t offset{0};
+    std::uint32_t length{0};
+
+    auto view(std::string_view data) const -> std::string_view {
+        return data.substr(offset, length);
+    }
+};
+
+struct header_field {
+    text_range name;
+    text_range value;
+};
+
+// What the parsers of requests and responses share: the header lines, and the headers
+// that decide how the body is delimited (Content-Length, Transfer-Encoding and Connection).
+// Call parse with all the data received so far (the same buffer, possibly grown
+// between calls), it continues from where it stopped on the previous call.
+// It does not allocate nor copy, all the results are offsets into the buffer.
+class message_parser {
+public:
+    static constexpr std::size_t MAX_HEADERS{64};
+    static constexpr std::size_t MAX_HEADER_SIZE{64 * 1'024};
+
+    enum class result {
+        incomplete,     // need more data
+        done,           // got the full header, body starts at header_size()
+        error           // not a valid HTTP message
+    };
+
+    auto complete() const -> bool {
+        return state_ == state::done;
+    }
+
+    // number of bytes up to and including the empty line that ends the headers
+    auto header_size() const -> std::size_t {
+        return header_size_;
+    }
+
+    // HTTP/1.x minor version
+    auto version_minor() const -> unsigned int {
+        return minor_;
+    }
+
+    auto headers() const -> std::span<const header_field> {
+        return {headers_.data(), count_};
+    }
+
+    // value of the first header with this name (case insensitive)
+    auto find(std::string_view data, std::string_view name) const -> std::optional<std::string_view>;
+
+    auto framing() const -> body_framing {
+        return framing_;
+    }
+
+    auto content_length() const -> std::uint64_t {
+        return content_length_;
+    }
+
+    // true if after reading the body, the connection can be used for another message
+    auto keep_alive() const -> bool {
+        return keep_alive_ && framing_ != body_framing::close;
+    }
+
+protected:
+    enum class state {
+        start_line,
+        headers,
+        done,
+        error
+    };
+
+    // the loop over the lines, start_line(line, offset) parses the first one and
+    // finish() decides on the framing once all the headers are in
+    template<typename StartLine, typename Finish>
+    auto parse_lines(std::string_view data, StartLine start_line, Finish finish) -> result;
+    auto parse_header(std::string_view line, std::uint32_t offset) -> bool;
+
+    state state_{state::start_line};
+    std::size_t position_{0};       // start of the next line we did not process yet
+    std::size_t header_size_{0};
+    unsigned int minor_{0};
+    std::array<header_field, MAX_HEADERS> headers_{};
+    std::size_t count_{0};
+    body_framing framing_{body_framing::close};
+    std::uint64_t content_length_{0};
+    bool keep_alive_{false};
+    bool transfer_encoding_{false};
+    bool has_content_length_{false};
+};
+
+// Incremental HTTP/1.x response header parser.
+class response_parser : public message_parser {
+public:
+    auto parse(std::string_view data) -> result;
+
+    auto reset() -> void {
+        *this = response_parser{};
+    }
+
+    auto status_code() const -> unsigned int {
+        return status_;
+    }
+
+    auto status_line(std::string_view data) const -> std::string_view {
+        return status_line_.view(data);
+    }
+
+    auto reason(std::string_view data) const -> std::string_view {
+        return reason_.view(data);
+    }
+
+private:
+    auto parse_status(std::string_view line, std::uint32_t offset) -> bool;
+    auto finish() -> bool;
+
+    unsigned int status_{0};
+    text_range status_line_;
+    text_range reason_;
+};
+
+// Incremental HTTP/1.x request header parser, for the server side. A request without
+// Content-Length or Transfer-Encoding has no body, and Content-Length values that do not
+// agree with each other, or a Transfer-Encoding that does not end with chunked, are errors
+// (RFC 7230, 3.3.3)
+class request_parser : public message_parser {
+public:
+    auto parse(std::string_view data) -> result;
+
+    auto reset() -> void {
+        *this = request_parser{};
+    }
+
+    auto method(std::string_view data) const -> std::string_view {
+        return method_.view(data);
+    }
+
+    auto target(std::string_view data) const -> std::string_view {
+        return target_.view(data);
+    }
+
+private:
+    auto parse_request_line(std::string_view line, std::uint32_t offset) -> bool;
+    auto finish() -> bool;
+
+    text_range method_;
+    text_range target_;
+};
+
+// case insensitive compare of ASCII strings, as used for header names
+auto iequals(std::string_view a, std::string_view b) -> bool;
+
+// the value without the spaces and tabs around it
+auto trim(std::string_view value) -> std::string_view;
+
+// an ASCII string in lower case, as the header names of HTTP/2
+auto lower(std::string_view value) -> std::string;
+
+// a Content-Length value, only digits
+auto parse_content_length(std::string_view value) -> std::optional<std::uint64_t>;
+
+// true if a comma separated header value contains the token (case insensitive),
+// for example has_token("keep-alive, Upgrade", "upgrade")
+auto has_token(std::string_view value, std::string_view token) -> bool;
+
+}	// end of namespace comm
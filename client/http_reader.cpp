@@ -0,0 +1,238 @@
+#include "http_reader.hh"
+#include "io_backend.hh"
+#include "log/logging.hh"
+#include <algorithm>
+
+namespace comm {
+namespace {
+
+auto as_chunk(std::string_view data) -> body_chunk {
+    return std::as_bytes(std::span<const char>{data.data(), data.size()});
+}
+
+}		// end of local namespace
+
+response_reader::response_reader(tcp::socket& socket, std::size_t buffer_size, std::size_t max_buffer_size) :
+        socket_{socket}, head_{HEAD_SIZE}, buffer_{std::max<std::size_t>(buffer_size, 1'024)},
+        buffer_size_{std::max<std::size_t>(buffer_size, 1'024)},
+        max_buffer_size_{std::max(max_buffer_size, buffer_size_)}, read_size_{buffer_size_} {
+}
+
+auto response_reader::fail(const char* what, const boost::system::error_code& e) -> void {
+    if (e == asio::error::eof) {
+        LOG(ERROR) << "error: EOF while reading " << what << ENDL;
+    } else {
+        LOG(ERROR) << "error: got and error while trying to read " << what << ": " << e.message() << ENDL;
+    }
+    boost::system::error_code ec;
+    socket_.close(ec);
+}
+
+auto response_reader::read_head() -> asio::awaitable<bool> {
+    static constexpr std::size_t READ_SIZE{HEAD_SIZE};
+
+    try {
+        while (true) {
+            switch (parser_.parse(head_.get())) {
+            case response_parser::result::done:
+                co_return true;
+            case response_parser::result::error:
+                LOG(ERROR) << "error: invalid HTTP response header from the server" << ENDL;
+                socket_.close();
+                co_return false;
+            case response_parser::result::incomplete:
+                break;
+            }
+            const auto used{head_.get().size()};
+            head_.get().resize(used + READ_SIZE);
+            auto [e, n] = co_await socket_.async_read_some(
+                    asio::buffer(head_.get().data() + used, READ_SIZE),
+                    asio::as_tuple(asio::use_awaitable)
+            );
+            head_.get().resize(used + n);
+            if (e) {
+                fail("headers", e);
+                co_return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "critical error while reading from socket " << e.what() << ENDL;
+        boost::system::error_code ec;
+        socket_.close(ec);
+    }
+    co_return false;
+}
+
+auto response_reader::next_response() -> void {
+    head_.get().erase(0, parser_.header_size());
+    parser_.reset();
+    chunks_ = chunked_decoder{};
+    complete_ = false;
+}
+
+// A read without flags returns what was already waiting, so when it filled the buffer the data
+// arrives faster than we read it. A read with MSG_WAITALL (io_uring) always fills the buffer,
+// so only the data that is still waiting after it tells us that.
+auto response_reader::more_waiting(asio::socket_base::message_flags flags) -> bool {
+    if (flags == 0) {
+        return true;
+    }
+    boost::system::error_code ec;
+    return socket_.available(ec) > 0 && !ec;
+}
+
+// Read the next part of the body into the buffer, return 0 on EOF or error.
+// When we know that at least expected bytes are coming, ask for all of them at once
+auto response_reader::fill(std::uint64_t expected) -> asio::awaitable<std::size_t> {
+    buffer_.get().resize(read_size_);
+    const auto size{expected == 0 ? read_size_ : static_cast<std::size_t>(std::min<std::uint64_t>(expected, read_size_))};
+    const asio::socket_base::message_flags flags{expected == 0 ? 0 : WAIT_ALL};
+    auto [e, n] = co_await socket_.async_receive(
+            asio::buffer(buffer_.get().data(), size), flags,
+            asio::as_tuple(asio::use_awaitable)
+    );
+    if (e) {
+        if (e == asio::error::eof && parser_.framing() == body_framing::close) {
+            // this is how the end of the body is marked in this case
+            complete_ = true;
+            boost::system::error_code ec;
+            socket_.close(ec);
+        } else {
+            fail("body", e);
+        }
+        co_return 0;
+    }
+    if (n == read_size_ && read_size_ < max_buffer_size_ && more_waiting(flags)) {
+        // there was at least as much waiting as we asked for, the next read can take more
+        read_size_ = std::min(read_size_ * 2, max_buffer_size_);
+    }
+    co_return n;
+}
+
+auto response_reader::read_body(const body_handler& on_body) -> asio::awaitable<bool> {
+    // some of the body was read together with the headers
+    auto pending{std::string_view{head_.get()}.substr(parser_.header_size())};
+
+    switch (parser_.framing()) {
+    case body_framing::none:
+        complete_ = true;
+        co_return true;
+    case body_framing::content_length: {
+        auto remaining{parser_.content_length()};
+        if (!pending.empty()) {
+            const auto n{std::min<std::uint64_t>(remaining, pending.size())};
+            if (!co_await on_body(as_chunk(pending.substr(0, n)))) {
+                co_return false;
+            }
+            remaining -= n;
+        }
+        while (remaining > 0) {
+            const auto n{co_await fill(remaining)};
+            if (n == 0) {
+                co_return false;
+            }
+            if (!co_await on_body(as_chunk(std::string_view{buffer_.get().data(), n}))) {
+                co_return false;
+            }
+            remaining -= n;
+        }
+        complete_ = true;
+        co_return true;
+    }
+    case body_framing::close:
+        if (!pending.empty() && !co_await on_body(as_chunk(pending))) {
+            co_return false;
+        }
+        while (true) {
+            const auto n{co_await fill()};
+            if (n == 0) {
+                co_return complete_;
+            }
+            if (!co_await on_body(as_chunk(std::string_view{buffer_.get().data(), n}))) {
+                co_return false;
+            }
+        }
+    case body_framing::chunked:
+        while (true) {
+            while (!pending.empty()) {
+                const auto step{chunks_.decode(pending)};
+                pending.remove_prefix(step.consumed);
+                if (!step.data.empty() && !co_await on_body(as_chunk(step.data))) {
+                    co_return false;
+                }
+                if (chunks_.failed()) {
+                    LOG(ERROR) << "error: invalid chunked encoding in the response body" << ENDL;
+                    socket_.close();
+                    co_return false;
+                }
+                if (chunks_.done()) {
+                    complete_ = true;
+                    co_return true;
+                }
+            }
+            const auto n{co_await fill()};
+            if (n == 0) {
+                co_return false;
+            }
+            pending = std::string_view{buffer_.get().data(), n};
+        }
+    }
+    co_return false;
+}
+
+auto response_reader::read_decoded_body(const body_handler& on_body) -> asio::awaitable<bool> {
+    const auto encoding{header("Content-Encoding").value_or(std::string_view{})};
+    const auto coding{parse_content_coding(encoding)};
+    if (!coding) {
+        LOG(ERROR) << "error: unsupported Content-Encoding '" << encoding << "' in the response" << ENDL;
+        boost::system::error_code ec;
+        socket_.close(ec);
+        co_return false;
+    }
+    if (*coding == content_coding::identity || parser_.framing() == body_framing::none) {
+        co_return co_await read_body(on_body);
+    }
+    inflater decoder{*coding, buffer_size_};
+    bool empty{true};
+    const auto ok = co_await read_body([&decoder, &empty, &on_body](body_chunk chunk) -> asio::awaitable<bool> {
+        empty = empty && chunk.empty();
+        co_return co_await decoder.feed(chunk, on_body);
+    });
+    if (ok && !empty && !decoder.done()) {
+        LOG(ERROR) << "error: the compressed response body ended before the end of the stream" << ENDL;
+        co_return false;
+    }
+    co_return ok;
+}
+
+auto response_reader::collect_body(bool decode) -> asio::awaitable<std::optional<std::string>> {
+    // the memory for the body is taken from the pool, the caller can give it back with recycle_buffer.
+    // The Content-Length is what the server claims, so only a sane size of it is reserved
+    pooled_buffer memory{parser_.framing() == body_framing::content_length ?
+            static_cast<std::size_t>(std::min<std::uint64_t>(parser_.content_length(), pooled_buffer::MAX_RESERVE)) : buffer_size_};
+    auto& body{memory.get()};
+    auto append = [&body](body_chunk chunk) -> asio::awaitable<bool> {
+        body.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+        co_return true;
+    };
+    const auto ok = decode ? co_await read_decoded_body(append) : co_await read_body(append);
+    if (!ok) {
+        co_return std::nullopt;
+    }
+    co_return memory.release();
+}
+
+auto response_reader::read_body() -> asio::awaitable<std::optional<std::string>> {
+    co_return co_await collect_body(false);
+}
+
+auto response_reader::read_decoded_body() -> asio::awaitable<std::optional<std::string>> {
+    co_return co_await collect_body(true);
+}
+
+auto wait_readable(tcp::socket& socket) -> asio::awaitable<bool> {
+    auto [e] = co_await socket.async_wait(tcp::socket::wait_read, asio::as_tuple(asio::use_awaitable));
+    co_return !e;
+}
+
+}	// end of namespace comm
@@ -0,0 +1,118 @@
+#pragma once
+#include "network_fwd.hh"
+#include "http_parser.hh"
+#include "chunked_decoder.hh"
+#include "buffer_pool.hh"
+#include "inflater.hh"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace comm {
+
+// A part of the response body, it is only valid during the call to the body handler
+using body_chunk = std::span<const std::byte>;
+// Called with each part of the body as it arrives, return false to stop reading
+using body_handler = std::function<asio::awaitable<bool>(body_chunk)>;
+
+// Read an HTTP response from a socket: first the status line and the headers,
+// then stream the body to the caller in parts no larger than the read size.
+// The read size starts at buffer_size, and doubles each time a read fills it while more data is
+// waiting, since that means that the data arrives faster than we read it, up to max_buffer_size. So a small response costs
+// a small buffer, and a large one is read with few syscalls.
+// The body is never stored as a whole, unless the caller asks for it as a string.
+// The header and read buffers are taken from the buffer pool of the thread.
+// On error the socket is closed.
+class response_reader {
+public:
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE{16 * 1'024};
+    static constexpr std::size_t MAX_BUFFER_SIZE{1'024 * 1'024};
+    static constexpr std::size_t HEAD_SIZE{4 * 1'024};
+
+    explicit response_reader(tcp::socket& socket, std::size_t buffer_size = DEFAULT_BUFFER_SIZE,
+                             std::size_t max_buffer_size = MAX_BUFFER_SIZE);
+
+    auto read_head() -> asio::awaitable<bool>;
+
+    // stream the body to on_body, return true if all of it was read
+    auto read_body(const body_handler& on_body) -> asio::awaitable<bool>;
+
+    // read the whole body into a string
+    auto read_body() -> asio::awaitable<std::optional<std::string>>;
+
+    // Same as read_body, but a body with a Content-Encoding of gzip or deflate is decompressed
+    // on the way, and passed on in parts no larger than buffer_size
+    auto read_decoded_body(const body_handler& on_body) -> asio::awaitable<bool>;
+    auto read_decoded_body() -> asio::awaitable<std::optional<std::string>>;
+
+    auto parser() const -> const response_parser& {
+        return parser_;
+    }
+
+    auto status_code() const -> unsigned int {
+        return parser_.status_code();
+    }
+
+    auto header(std::string_view name) const -> std::optional<std::string_view> {
+        return parser_.find(head_.get(), name);
+    }
+
+    // the raw status line and headers
+    auto head() const -> std::string_view {
+        return std::string_view{head_.get()}.substr(0, parser_.header_size());
+    }
+
+    // The part of the body that was read together with the headers. A caller that reads the rest
+    // of the body from the socket by itself, instead of read_body, calls body_done() once it has all of it
+    auto buffered_body() const -> std::string_view {
+        return std::string_view{head_.get()}.substr(parser_.header_size());
+    }
+
+    auto body_done() -> void {
+        complete_ = true;
+    }
+
+    // a 1xx response, such as 100 Continue, that comes before the final response
+    auto interim() const -> bool {
+        return parser_.status_code() >= 100 && parser_.status_code() < 200;
+    }
+
+    // drop the response that was read, and keep any data that followed it for the next read_head
+    auto next_response() -> void;
+
+    // true if the body was read in full and the connection can be used for the next request
+    auto reusable() const -> bool {
+        return complete_ && parser_.keep_alive() && socket_.is_open();
+    }
+
+    // the size of the next read of the body
+    auto read_size() const -> std::size_t {
+        return read_size_;
+    }
+
+private:
+    auto fill(std::uint64_t expected = 0) -> asio::awaitable<std::size_t>;
+    // after a read that filled the buffer, whether the data arrives faster than we read it
+    auto more_waiting(asio::socket_base::message_flags flags) -> bool;
+    auto collect_body(bool decode) -> asio::awaitable<std::optional<std::string>>;
+    auto fail(const char* what, const boost::system::error_code& e) -> void;
+
+    tcp::socket& socket_;
+    response_parser parser_;
+    chunked_decoder chunks_;
+    pooled_buffer head_;
+    pooled_buffer buffer_;
+    std::size_t buffer_size_;
+    std::size_t max_buffer_size_;
+    std::size_t read_size_;
+    bool complete_{false};
+};
+
+// return true once there is something to read from the socket, without reading it
+auto wait_readable(tcp::socket& socket) -> asio::awaitable<bool>;
+
+}	// end of namespace comm
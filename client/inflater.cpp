@@ -0,0 +1,114 @@
+#include "inflater.hh"
+#include "http_parser.hh"
+#include "log/logging.hh"
+#include <zlib.h>
+
+namespace comm {
+namespace {
+
+// a zlib stream starts with a 2 bytes header that is a multiple of 31, with deflate as the method
+auto zlib_header(std::span<const std::byte> input) -> bool {
+    const auto cmf{static_cast<unsigned>(input[0])};
+    if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7) {
+        return false;
+    }
+    return input.size() < 2 || (cmf * 256 + static_cast<unsigned>(input[1])) % 31 == 0;
+}
+
+}		// end of local namespace
+
+struct inflater::stream {
+    z_stream z{};
+    bool open{false};
+
+    ~stream() {
+        if (open) {
+            inflateEnd(&z);
+        }
+    }
+};
+
+auto parse_content_coding(std::string_view value) -> std::optional<content_coding> {
+    if (value.empty() || iequals(value, "identity")) {
+        return content_coding::identity;
+    }
+    if (iequals(value, "gzip") || iequals(value, "x-gzip")) {
+        return content_coding::gzip;
+    }
+    if (iequals(value, "deflate")) {
+        return content_coding::deflate;
+    }
+    return std::nullopt;
+}
+
+inflater::inflater(content_coding coding, std::size_t output_size) :
+        coding_{coding}, stream_{std::make_unique<stream>()}, output_{output_size},
+        output_size_{std::max<std::size_t>(output_size, 1'024)} {
+    output_.get().resize(output_size_);
+}
+
+inflater::~inflater() = default;
+
+// the stream is opened with the first input, so we can tell raw deflate from zlib
+auto inflater::start(std::span<const std::byte> input) -> bool {
+    int window_bits{MAX_WBITS};
+    if (coding_ == content_coding::gzip) {
+        window_bits += 16;
+    } else if (!zlib_header(input)) {
+        window_bits = -MAX_WBITS;
+    }
+    if (inflateInit2(&stream_->z, window_bits) != Z_OK) {
+        LOG(ERROR) << "error: failed to start decompressing the response body" << ENDL;
+        return false;
+    }
+    stream_->open = true;
+    return true;
+}
+
+auto inflater::feed(std::span<const std::byte> input, const output_handler& on_output) -> asio::awaitable<bool> {
+    if (coding_ == content_coding::identity) {
+        co_return input.empty() || co_await on_output(input);
+    }
+    if (input.empty()) {
+        co_return true;
+    }
+    if (done_) {
+        // anything after the end of the stream is ignored
+        co_return true;
+    }
+    if (!stream_->open && !start(input)) {
+        co_return false;
+    }
+
+    auto& z{stream_->z};
+    z.next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(input.data()));
+    z.avail_in = static_cast<uInt>(input.size());
+    while (true) {
+        z.next_out = reinterpret_cast<Bytef*>(output_.get().data());
+        z.avail_out = static_cast<uInt>(output_size_);
+        const auto r{inflate(&z, Z_NO_FLUSH)};
+        if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+            LOG(ERROR) << "error: invalid compressed response body: " << (z.msg ? z.msg : "unknown error") << ENDL;
+            co_return false;
+        }
+        const auto produced{output_size_ - z.avail_out};
+        if (produced > 0 && !co_await on_output(std::as_bytes(std::span{output_.get().data(), produced}))) {
+            co_return false;
+        }
+        if (r == Z_STREAM_END) {
+            // a gzip body can have more than one member, one after the other
+            if (coding_ == content_coding::gzip && z.avail_in > 0) {
+                inflateReset(&z);
+                continue;
+            }
+            done_ = true;
+            co_return true;
+        }
+        // inflate only stops with room left in the output when it needs more input
+        if (z.avail_out > 0 || r == Z_BUF_ERROR) {
+            co_return true;
+        }
+    }
+}
+
+}	// end of namespace comm
@@ -0,0 +1,64 @@
+#pragma once
+#include "network_fwd.hh"
+#include "buffer_pool.hh"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace comm {
+
+// Ask the server for a compressed body (Accept-Encoding: gzip, deflate), and decompress it as it is read
+enum class body_encoding {
+    identity,
+    compressed
+};
+
+// The Content-Encoding of a response that we can decode
+enum class content_coding {
+    identity,
+    gzip,
+    deflate     // zlib format, or the raw deflate that some servers send instead
+};
+
+// nullopt for an encoding that we do not support
+auto parse_content_coding(std::string_view value) -> std::optional<content_coding>;
+
+// Streaming decompression of a response body. The input is passed in the parts it arrives,
+// and the output is passed on in parts no larger than the output buffer, so memory use
+// does not depend on the size of the body or on how well it compresses.
+class inflater {
+public:
+    using output_handler = std::function<asio::awaitable<bool>(std::span<const std::byte>)>;
+
+    static constexpr std::size_t DEFAULT_OUTPUT_SIZE{32 * 1'024};
+
+    explicit inflater(content_coding coding, std::size_t output_size = DEFAULT_OUTPUT_SIZE);
+    inflater(const inflater&) = delete;
+    auto operator = (const inflater&) -> inflater& = delete;
+    ~inflater();
+
+    // decompress the input and pass the result to on_output, return false on
+    // invalid input or if on_output returned false
+    auto feed(std::span<const std::byte> input, const output_handler& on_output) -> asio::awaitable<bool>;
+
+    // true once the end of the compressed stream was seen
+    auto done() const -> bool {
+        return done_;
+    }
+
+private:
+    struct stream;
+
+    auto start(std::span<const std::byte> input) -> bool;
+
+    content_coding coding_;
+    std::unique_ptr<stream> stream_;
+    pooled_buffer output_;
+    std::size_t output_size_;
+    bool done_{false};
+};
+
+}	// end of namespace comm
@@ -0,0 +1,20 @@
+#include "io_backend.hh"
+
+namespace comm {
+
+auto io_backend_name() -> const char* {
+    if constexpr (IO_URING) {
+        return "io_uring";
+    }
+#if defined(BOOST_ASIO_HAS_EPOLL)
+    return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+    return "kqueue";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+    return "iocp";
+#else
+    return "select";
+#endif
+}
+
+}	// end of namespace comm
@@ -0,0 +1,30 @@
+#pragma once
+#include "network_fwd.hh"
+#if defined(__linux__)
+#   include <sys/socket.h>
+#endif
+
+namespace comm {
+
+// The client is built with asio's io_uring backend for the sockets when COMM_IO_URING
+// is turned on in CMake, otherwise it uses epoll (or the native reactor of the platform).
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+inline constexpr bool IO_URING{true};
+#else
+inline constexpr bool IO_URING{false};
+#endif
+
+// With io_uring the kernel completes a receive with MSG_WAITALL only when the buffer is full
+// (or on EOF), so reading a known number of bytes is a single submission and a single
+// completion, instead of one for each segment that arrives.
+// With a reactor the socket is non blocking and the flag would not change anything.
+#if defined(__linux__)
+inline constexpr asio::socket_base::message_flags WAIT_ALL{IO_URING ? MSG_WAITALL : 0};
+#else
+inline constexpr asio::socket_base::message_flags WAIT_ALL{0};
+#endif
+
+// "io_uring" or "epoll"
+auto io_backend_name() -> const char*;
+
+}	// end of namespace comm
@@ -0,0 +1,183 @@
+#include "metrics.hh"
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace comm {
+namespace metrics {
+namespace {
+
+// Only the owning thread writes to its block, so a relaxed load and store is enough
+// for an increment, and other threads can read it at any time for a snapshot
+struct thread_block {
+    std::array<std::array<std::atomic<std::uint64_t>, BUCKETS>, STAGES> buckets{};
+    std::array<std::atomic<std::uint64_t>, STAGES> counts{};
+    std::array<std::atomic<std::uint64_t>, STAGES> sums{};
+    std::array<std::atomic<std::uint64_t>, COUNTERS> counters{};
+};
+
+auto bump(std::atomic<std::uint64_t>& value, std::uint64_t n) -> void {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// the blocks are kept after their thread exits, so its values are still in the snapshot
+struct registry {
+    std::mutex lock;
+    std::vector<std::shared_ptr<thread_block>> blocks;
+};
+
+auto all_blocks() -> registry& {
+    static registry r;
+    return r;
+}
+
+auto this_thread_block() -> thread_block& {
+    thread_local const auto block = [] {
+        auto b{std::make_shared<thread_block>()};
+        auto& r{all_blocks()};
+        std::lock_guard guard{r.lock};
+        r.blocks.push_back(b);
+        return b;
+    }();
+    return *block;
+}
+
+auto bucket_of(std::uint64_t us) -> std::size_t {
+    return static_cast<std::size_t>(std::lower_bound(BUCKET_BOUNDS.begin(), BUCKET_BOUNDS.end(), us) - BUCKET_BOUNDS.begin());
+}
+
+auto write_seconds(std::ostream& os, std::uint64_t us) -> std::ostream& {
+    return os << us / 1'000'000 << '.' << std::setw(6) << std::setfill('0') << us % 1'000'000 << std::setfill(' ');
+}
+
+}		// end of local namespace
+
+auto name(stage s) -> const char* {
+    switch (s) {
+    case stage::resolve:
+        return "resolve";
+    case stage::connect:
+        return "connect";
+    case stage::send:
+        return "send";
+    case stage::headers:
+        return "headers";
+    case stage::body:
+        return "body";
+    case stage::read:
+        return "read";
+    case stage::request:
+        return "request";
+    case stage::COUNT:
+        break;
+    }
+    return "unknown";
+}
+
+auto name(counter c) -> const char* {
+    switch (c) {
+    case counter::requests:
+        return "requests";
+    case counter::failures:
+        return "failures";
+    case counter::timeouts:
+        return "timeouts";
+    case counter::bytes_sent:
+        return "bytes_sent";
+    case counter::bytes_received:
+        return "bytes_received";
+    case counter::COUNT:
+        break;
+    }
+    return "unknown";
+}
+
+auto enable([[maybe_unused]] bool on) -> void {
+#ifndef COMM_NO_METRICS
+    enabled_flag.store(on, std::memory_order_relaxed);
+#endif  // COMM_NO_METRICS
+}
+
+auto record_slow(stage s, std::chrono::nanoseconds elapsed) -> void {
+    const auto i{static_cast<std::size_t>(s)};
+    const auto us{static_cast<std::uint64_t>(std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()))};
+    auto& block{this_thread_block()};
+    bump(block.buckets[i][bucket_of(us)], 1);
+    bump(block.counts[i], 1);
+    bump(block.sums[i], us);
+}
+
+auto add_slow(counter c, std::uint64_t n) -> void {
+    bump(this_thread_block().counters[static_cast<std::size_t>(c)], n);
+}
+
+auto take_snapshot() -> snapshot {
+    snapshot values;
+    auto& r{all_blocks()};
+    std::lock_guard guard{r.lock};
+    for (const auto& b : r.blocks) {
+        for (std::size_t s = 0; s < STAGES; ++s) {
+            auto& v{values.stages[s]};
+            for (std::size_t i = 0; i < BUCKETS; ++i) {
+                v.buckets[i] += b->buckets[s][i].load(std::memory_order_relaxed);
+            }
+            v.count += b->counts[s].load(std::memory_order_relaxed);
+            v.sum_us += b->sums[s].load(std::memory_order_relaxed);
+        }
+        for (std::size_t c = 0; c < COUNTERS; ++c) {
+            values.counters[c] += b->counters[c].load(std::memory_order_relaxed);
+        }
+    }
+    return values;
+}
+
+auto write_prometheus(std::ostream& os, const snapshot& values) -> void {
+    os << "# HELP comm_stage_duration_seconds time spent in each stage of a request\n"
+       << "# TYPE comm_stage_duration_seconds histogram\n";
+    for (std::size_t s = 0; s < STAGES; ++s) {
+        const auto& v{values.stages[s]};
+        const auto* stage_name{name(static_cast<stage>(s))};
+        std::uint64_t cumulative{0};
+        for (std::size_t i = 0; i < BUCKETS; ++i) {
+            cumulative += v.buckets[i];
+            os << "comm_stage_duration_seconds_bucket{stage=\"" << stage_name << "\",le=\"";
+            if (i < BUCKET_BOUNDS.size()) {
+                write_seconds(os, BUCKET_BOUNDS[i]);
+            } else {
+                os << "+Inf";
+            }
+            os << "\"} " << cumulative << '\n';
+        }
+        os << "comm_stage_duration_seconds_sum{stage=\"" << stage_name << "\"} ";
+        write_seconds(os, v.sum_us) << '\n';
+        os << "comm_stage_duration_seconds_count{stage=\"" << stage_name << "\"} " << v.count << '\n';
+    }
+    for (std::size_t c = 0; c < COUNTERS; ++c) {
+        const auto* counter_name{name(static_cast<counter>(c))};
+        os << "# TYPE comm_" << counter_name << "_total counter\n"
+           << "comm_" << counter_name << "_total " << values.counters[c] << '\n';
+    }
+}
+
+auto write_prometheus(std::ostream& os) -> void {
+    write_prometheus(os, take_snapshot());
+}
+
+auto dump_every(std::chrono::milliseconds interval, std::ostream& os) -> asio::awaitable<void> {
+    asio::steady_timer timer(co_await asio::this_coro::executor);
+    while (true) {
+        timer.expires_after(interval);
+        auto [e] = co_await timer.async_wait(asio::as_tuple(asio::use_awaitable));
+        if (e) {
+            co_return;
+        }
+        write_prometheus(os);
+        os.flush();
+    }
+}
+
+}	// end of namespace metrics
+}	// end of namespace comm
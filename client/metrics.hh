@@ -0,0 +1,140 @@
+#pragma once
+#include "network_fwd.hh"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace comm {
+namespace metrics {
+
+// The stages of a request that we measure
+enum class stage : std::size_t {
+    resolve,
+    connect,
+    send,
+    headers,    // from sending the request until we have all the headers
+    body,
+    read,       // a raw TCP read
+    request,    // a whole HTTP request
+    COUNT
+};
+
+enum class counter : std::size_t {
+    requests,
+    failures,
+    timeouts,
+    bytes_sent,
+    bytes_received,
+    COUNT
+};
+
+inline constexpr std::size_t STAGES{static_cast<std::size_t>(stage::COUNT)};
+inline constexpr std::size_t COUNTERS{static_cast<std::size_t>(counter::COUNT)};
+
+// the upper bounds of the latency buckets, in microseconds (the last bucket is +Inf)
+inline constexpr std::array<std::uint64_t, 17> BUCKET_BOUNDS{
+    50, 100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000,
+    100'000, 250'000, 500'000, 1'000'000, 2'500'000, 5'000'000, 10'000'000
+};
+inline constexpr std::size_t BUCKETS{BUCKET_BOUNDS.size() + 1};
+
+struct stage_values {
+    std::array<std::uint64_t, BUCKETS> buckets{};   // not cumulative
+    std::uint64_t count{0};
+    std::uint64_t sum_us{0};
+};
+
+// the values of all the threads, merged
+struct snapshot {
+    std::array<stage_values, STAGES> stages{};
+    std::array<std::uint64_t, COUNTERS> counters{};
+};
+
+auto name(stage s) -> const char*;
+auto name(counter c) -> const char*;
+
+// Metrics are off by default. When off, each recording point costs a relaxed load of a flag.
+// Building with COMM_NO_METRICS removes them altogether.
+#ifdef COMM_NO_METRICS
+inline auto enabled() -> bool {
+    return false;
+}
+#else
+inline std::atomic<bool> enabled_flag{false};
+
+inline auto enabled() -> bool {
+    return enabled_flag.load(std::memory_order_relaxed);
+}
+#endif  // COMM_NO_METRICS
+
+auto enable(bool on) -> void;
+
+// Each thread records into its own counters, there are no locks and no atomic
+// read-modify-write on this path. They are only merged when we take a snapshot.
+auto record_slow(stage s, std::chrono::nanoseconds elapsed) -> void;
+auto add_slow(counter c, std::uint64_t n) -> void;
+
+inline auto record(stage s, std::chrono::nanoseconds elapsed) -> void {
+    if (enabled()) {
+        record_slow(s, elapsed);
+    }
+}
+
+inline auto add(counter c, std::uint64_t n = 1) -> void {
+    if (enabled()) {
+        add_slow(c, n);
+    }
+}
+
+// Measure a stage from construction until stop() or the end of the scope,
+// the clock is not read when metrics are off
+class stage_timer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit stage_timer(stage s) : stage_{s}, running_{enabled()} {
+        if (running_) {
+            start_ = clock::now();
+        }
+    }
+    stage_timer(const stage_timer&) = delete;
+    auto operator = (const stage_timer&) -> stage_timer& = delete;
+
+    ~stage_timer() {
+        stop();
+    }
+
+    auto stop() -> void {
+        if (running_) {
+            running_ = false;
+            record_slow(stage_, clock::now() - start_);
+        }
+    }
+
+    // do not record this stage, for example since it failed
+    auto cancel() -> void {
+        running_ = false;
+    }
+
+private:
+    stage stage_;
+    bool running_;
+    clock::time_point start_{};
+};
+
+auto take_snapshot() -> snapshot;
+
+// write the snapshot in the Prometheus text exposition format
+auto write_prometheus(std::ostream& os, const snapshot& values) -> void;
+auto write_prometheus(std::ostream& os) -> void;
+
+// Write a Prometheus snapshot to os every interval, until the coroutine is cancelled
+// or its io_context is stopped, for example:
+//      asio::co_spawn(ctx, metrics::dump_every(std::chrono::seconds{10}, std::cerr), asio::detached);
+auto dump_every(std::chrono::milliseconds interval, std::ostream& os) -> asio::awaitable<void>;
+
+}	// end of namespace metrics
+}	// end of namespace comm
@@ -0,0 +1,260 @@
+#include "response_cache.hh"
+#include "async_client.hh"
+#include "http_parser.hh"
+#include "log/logging.hh"
+#include <charconv>
+#include <iterator>
+#include <optional>
+#include <ostream>
+
+namespace comm {
+namespace {
+
+auto make_key(const std::string& host, const std::string& port, const std::string& resource) -> std::string {
+    std::string key;
+    key.reserve(host.size() + port.size() + resource.size() + 2);
+    key.append(host).append(1, ' ').append(port).append(1, ' ').append(resource);
+    return key;
+}
+
+auto parse_seconds(std::string_view value) -> std::optional<std::int64_t> {
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+    }
+    std::int64_t seconds{0};
+    const auto [end, e] = std::from_chars(value.data(), value.data() + value.size(), seconds);
+    if (e != std::errc{} || end != value.data() + value.size() || value.empty()) {
+        return std::nullopt;
+    }
+    return seconds;
+}
+
+// what Cache-Control (and Age) let us do with a response
+struct freshness {
+    bool store{true};
+    std::chrono::seconds lifetime{0};
+};
+
+auto response_freshness(const http_response& response) -> freshness {
+    freshness result;
+    bool no_cache{false};
+    auto directives{response.header("Cache-Control").value_or(std::string_view{})};
+    while (!directives.empty()) {
+        const auto comma{directives.find(',')};
+        const auto directive{trim(directives.substr(0, comma))};
+        directives = comma == std::string_view::npos ? std::string_view{} : directives.substr(comma + 1);
+        if (iequals(directive, "no-store")) {
+            result.store = false;
+        } else if (iequals(directive, "no-cache")) {
+            no_cache = true;
+        } else if (directive.size() > 8 && iequals(directive.substr(0, 8), "max-age=")) {
+            result.lifetime = std::chrono::seconds{std::max<std::int64_t>(parse_seconds(directive.substr(8)).value_or(0), 0)};
+        }
+    }
+    if (no_cache) {
+        // it can be kept, but it must be revalidated each time
+        result.lifetime = std::chrono::seconds{0};
+    }
+    // the time that the response already spent in caches on the way
+    if (const auto age = response.header("Age"); age && result.lifetime.count() > 0) {
+        result.lifetime -= std::min(result.lifetime, std::chrono::seconds{std::max<std::int64_t>(parse_seconds(*age).value_or(0), 0)});
+    }
+    return result;
+}
+
+}		// end of local namespace
+
+auto operator << (std::ostream& os, const cache_stats& stats) -> std::ostream& {
+    return os << "hits: " << stats.hits << ", misses: " << stats.misses << ", coalesced: " << stats.coalesced
+        << ", revalidated: " << stats.revalidated << ", evictions: " << stats.evictions
+        << ", entries: " << stats.entries << ", bytes: " << stats.bytes;
+}
+
+response_cache::response_cache(cache_options options) : options_{options} {
+}
+
+auto response_cache::remove(std::unordered_map<std::string, entry>::iterator i) -> void {
+    bytes_ -= i->second.body->size();
+    used_.erase(i->second.used);
+    entries_.erase(i);
+}
+
+// drop the least recently used entries, but not the ones that are being revalidated
+auto response_cache::evict() -> void {
+    auto candidate{used_.end()};
+    while (candidate != used_.begin() && (entries_.size() > options_.max_entries || bytes_ > options_.max_bytes)) {
+        const auto victim{std::prev(candidate)};
+        if (in_flight_.contains(*victim)) {
+            candidate = victim;
+            continue;
+        }
+        remove(entries_.find(*victim));
+        ++stats_.evictions;
+    }
+}
+
+auto response_cache::store(const std::string& key, const body_type& body, std::string etag, clock::time_point expires) -> void {
+    auto [i, added] = entries_.try_emplace(key);
+    auto& e{i->second};
+    if (added) {
+        used_.push_front(key);
+    } else {
+        bytes_ -= e.body->size();
+        used_.splice(used_.begin(), used_, e.used);
+    }
+    e.used = used_.begin();
+    e.body = body;
+    e.etag = std::move(etag);
+    e.expires = expires;
+    bytes_ += body->size();
+}
+
+auto response_cache::begin_lookup(const std::string& key, body_type& body, std::string& etag, std::shared_ptr<flight>& f) -> lookup {
+    const auto now{clock::now()};
+    std::lock_guard guard{lock_};
+    if (auto i = in_flight_.find(key); i != in_flight_.end()) {
+        ++stats_.coalesced;
+        f = i->second;
+        return lookup::wait;
+    }
+    if (auto i = entries_.find(key); i != entries_.end()) {
+        if (i->second.expires > now) {
+            ++stats_.hits;
+            used_.splice(used_.begin(), used_, i->second.used);
+            body = i->second.body;
+            return lookup::cached;
+        }
+        // stale, it is kept while we ask the server if it changed
+        etag = i->second.etag;
+        if (etag.empty()) {
+            remove(i);
+        }
+    }
+    ++stats_.misses;
+    f = in_flight_[key] = std::make_shared<flight>();
+    return lookup::fetch;
+}
+
+auto response_cache::finish_lookup(const std::string& key, http_response& response) -> void {
+    // whatever the server sent, the allocation is done before taking the lock
+    auto received{std::make_shared<const std::string>(std::move(response.body))};
+    body_type body;
+    std::shared_ptr<flight> f;
+    {
+        const auto now{clock::now()};
+        std::lock_guard guard{lock_};
+        auto found{entries_.find(key)};
+        const auto status{response.status()};
+        if (status == 304 && found != entries_.end()) {
+            ++stats_.revalidated;
+            const auto fresh{response_freshness(response)};
+            found->second.expires = now + fresh.lifetime;
+            if (const auto etag = response.header("ETag"); etag) {
+                found->second.etag.assign(*etag);
+            }
+            used_.splice(used_.begin(), used_, found->second.used);
+            body = found->second.body;
+        } else if (status == 200) {
+            body = std::move(received);
+            const auto fresh{response_freshness(response)};
+            const auto etag{response.header("ETag").value_or(std::string_view{})};
+            if (options_.max_entries > 0 && fresh.store && (fresh.lifetime.count() > 0 || !etag.empty()) && body->size() <= options_.max_bytes) {
+                store(key, body, std::string{etag}, now + fresh.lifetime);
+            } else if (found != entries_.end()) {
+                remove(found);
+            }
+        } else if (status != 0 && status != 304) {
+            // as with async_http_client the body is returned whatever the status is, but it is not kept
+            body = std::move(received);
+        }
+        if (auto i = in_flight_.find(key); i != in_flight_.end()) {
+            f = std::move(i->second);
+            in_flight_.erase(i);
+        }
+        evict();
+    }
+    if (f) {
+        f->complete(body ? std::move(body) : std::make_shared<const std::string>());
+    }
+}
+
+// the request is not sent by any of the coroutines that want its result, so none of them can
+// abort it by leaving early, only the destruction of the executor it runs on can
+auto response_cache::fetch(std::string host, std::string port, std::string resource, std::string key, std::string etag,
+                           request_deadlines deadlines) -> asio::awaitable<void> {
+    bool finished{false};
+    on_exit done{[this, &key, &finished]() {
+        if (!finished) {
+            http_response failed;
+            finish_lookup(key, failed);
+        }
+    }};
+    std::string conditional;
+    if (!etag.empty()) {
+        conditional.append("If-None-Match: ").append(etag).append("\r\n");
+    }
+    auto response = co_await async_http_get(std::move(host), std::move(port), std::move(resource), std::move(conditional), deadlines);
+    finished = true;
+    finish_lookup(key, response);
+}
+
+auto response_cache::get(const std::string& host, const std::string& port, const std::string& resource,
+                         const request_deadlines& deadlines) -> asio::awaitable<body_type> {
+    const auto deadline{clock::now() + deadlines.total};
+    auto executor = co_await asio::this_coro::executor;
+    const auto key{make_key(host, port, resource)};
+    body_type body;
+    std::string etag;
+    std::shared_ptr<flight> f;
+
+    switch (begin_lookup(key, body, etag, f)) {
+    case lookup::cached:
+        co_return body;
+    case lookup::fetch:
+        asio::co_spawn(executor, fetch(host, port, resource, key, std::move(etag), deadlines), asio::detached);
+        break;
+    case lookup::wait:
+        break;
+    }
+    auto answer = co_await f->wait(deadline);
+    if (!answer) {
+        LOG(WARNING) << "the request for " << key << " did not finish before the deadline" << ENDL;
+        co_return std::make_shared<const std::string>();
+    }
+    co_return std::move(*answer);
+}
+
+auto response_cache::forget(const std::string& host, const std::string& port, const std::string& resource) -> void {
+    const auto key{make_key(host, port, resource)};
+    std::lock_guard guard{lock_};
+    if (auto i = entries_.find(key); i != entries_.end() && !in_flight_.contains(key)) {
+        remove(i);
+    }
+}
+
+auto response_cache::clear() -> void {
+    std::lock_guard guard{lock_};
+    for (auto i = entries_.begin(); i != entries_.end();) {
+        if (in_flight_.contains(i->first)) {
+            ++i;
+        } else {
+            remove(i++);
+        }
+    }
+}
+
+auto response_cache::stats() const -> cache_stats {
+    std::lock_guard guard{lock_};
+    auto stats{stats_};
+    stats.entries = entries_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+
+auto async_http_client(response_cache& cache, std::string host, std::string port, std::string resource,
+                       request_deadlines deadlines) -> asio::awaitable<std::string> {
+    const auto body{co_await cache.get(host, port, resource, deadlines)};
+    co_return *body;
+}
+
+}	// end of namespace comm
@@ -0,0 +1,109 @@
+#pragma once
+#include "network_fwd.hh"
+#include "deadline.hh"
+#include "single_flight.hh"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace comm {
+
+struct http_response;
+
+struct cache_options {
+    // the number of responses that are kept, with 0 nothing is kept
+    // and only the requests that are in flight at the same time are shared
+    std::size_t max_entries{0};
+    // the total size of the bodies that are kept, the least recently used are dropped first
+    std::size_t max_bytes{64 * 1'024 * 1'024};
+};
+
+struct cache_stats {
+    std::uint64_t hits{0};          // answered from the cache
+    std::uint64_t misses{0};        // had to send a request
+    std::uint64_t coalesced{0};     // waited for the same request that was already in flight
+    std::uint64_t revalidated{0};   // the server answered a stale entry with 304 Not Modified
+    std::uint64_t evictions{0};
+    std::size_t entries{0};
+    std::size_t bytes{0};
+};
+
+auto operator << (std::ostream& os, const cache_stats& stats) -> std::ostream&;
+
+// GET responses per host, port and resource. Concurrent requests for the same resource share
+// a single request (single flight), that the cache sends on the executor of the first of them,
+// and each of them waits for its result until its own deadline. When max_entries is set,
+// successful responses are kept for as long as their Cache-Control: max-age allows, and
+// a response with an ETag is revalidated with If-None-Match once it is stale.
+// Responses with Cache-Control: no-store are never kept, and with no-cache they are
+// revalidated on each use. Vary is not supported, so only use this for resources that
+// do not depend on the request headers.
+// As with the dns_cache, this can be used from any thread, and it must outlive its requests.
+class response_cache {
+public:
+    using clock = std::chrono::steady_clock;
+    // the bodies are shared by the cache and all the callers that asked for them, never copied
+    using body_type = std::shared_ptr<const std::string>;
+
+    explicit response_cache(cache_options options = {});
+    response_cache(const response_cache&) = delete;
+    auto operator = (const response_cache&) -> response_cache& = delete;
+
+    // as async_http_client, the body is empty if the request failed, or if deadlines.total
+    // passed first, but it is never null
+    auto get(const std::string& host, const std::string& port, const std::string& resource,
+             const request_deadlines& deadlines = {}) -> asio::awaitable<body_type>;
+
+    auto forget(const std::string& host, const std::string& port, const std::string& resource) -> void;
+
+    auto clear() -> void;
+
+    auto stats() const -> cache_stats;
+
+private:
+    using flight = single_flight<body_type>;
+
+    struct entry {
+        body_type body;
+        std::string etag;
+        clock::time_point expires{};
+        std::list<std::string>::iterator used;      // the place of the key in used_
+    };
+
+    // what a request should do, given the current entry
+    enum class lookup {
+        cached,
+        wait,
+        fetch
+    };
+
+    auto begin_lookup(const std::string& key, body_type& body, std::string& etag, std::shared_ptr<flight>& f) -> lookup;
+    auto finish_lookup(const std::string& key, http_response& response) -> void;
+    auto fetch(std::string host, std::string port, std::string resource, std::string key, std::string etag,
+               request_deadlines deadlines) -> asio::awaitable<void>;
+    auto store(const std::string& key, const body_type& body, std::string etag, clock::time_point expires) -> void;
+    auto remove(std::unordered_map<std::string, entry>::iterator i) -> void;
+    auto evict() -> void;
+
+    cache_options options_;
+    mutable std::mutex lock_;
+    std::unordered_map<std::string, std::shared_ptr<flight>> in_flight_;
+    std::unordered_map<std::string, entry> entries_;
+    std::list<std::string> used_;       // the keys of the entries, the most recently used first
+    std::size_t bytes_{0};
+    cache_stats stats_;
+};
+
+// Send the GET request through the cache, so identical requests in flight at the same time
+// are sent once, and the responses that can be kept are answered from the cache.
+// As with the other async_http_client functions an empty body means that the request failed
+auto async_http_client(response_cache& cache, std::string host, std::string port, std::string resource,
+                       request_deadlines deadlines = {}) -> asio::awaitable<std::string>;
+
+}	// end of namespace comm
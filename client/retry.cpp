@@ -0,0 +1,114 @@
+#include "retry.hh"
+#include "async_client.hh"
+#include "connection_pool.hh"
+#include <ostream>
+#include <random>
+
+namespace comm {
+namespace {
+
+auto random_engine() -> std::minstd_rand& {
+    thread_local std::minstd_rand engine{std::random_device{}()};
+    return engine;
+}
+
+}		// end of local namespace
+
+auto operator << (std::ostream& os, const retry_stats& stats) -> std::ostream& {
+    return os << "requests: " << stats.requests << ", retries: " << stats.retries
+        << ", hedges: " << stats.hedges << ", hedge wins: " << stats.hedge_wins
+        << ", budget exhausted: " << stats.budget_exhausted;
+}
+
+retry_budget::retry_budget(double ratio, std::size_t reserve) :
+        per_request_{static_cast<std::int64_t>(std::max(ratio, 0.0) * UNIT)},
+        max_{static_cast<std::int64_t>(std::max<std::size_t>(reserve, 1)) * UNIT},
+        balance_{max_} {
+}
+
+auto retry_budget::deposit() -> void {
+    auto current{balance_.load(std::memory_order_relaxed)};
+    while (current < max_ && !balance_.compare_exchange_weak(current, std::min(current + per_request_, max_), std::memory_order_relaxed)) {
+    }
+}
+
+auto retry_budget::withdraw() -> bool {
+    auto current{balance_.load(std::memory_order_relaxed)};
+    while (current >= UNIT) {
+        if (balance_.compare_exchange_weak(current, current - UNIT, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+hedge_delay_tracker::hedge_delay_tracker(double percentile, std::chrono::milliseconds minimum) :
+        percentile_{std::clamp(percentile, 0.0, 1.0)}, minimum_{minimum}, delay_{std::chrono::nanoseconds{minimum}.count()} {
+}
+
+auto hedge_delay_tracker::record(std::chrono::nanoseconds latency) -> void {
+    std::lock_guard guard{lock_};
+    recent_.record(latency);
+    const auto count{recent_.count()};
+    // computing the percentile walks the buckets, so we only do it once in a while
+    if (count >= MIN_SAMPLES && count % UPDATE_EVERY == 0) {
+        delay_.store(std::max(recent_.percentile(percentile_), minimum_).count(), std::memory_order_relaxed);
+    }
+    if (count >= WINDOW) {
+        recent_.reset();
+    }
+}
+
+request_policy::request_policy(retry_options options) :
+        options_{options}, budget_{options.budget_ratio, options.budget_reserve},
+        tracker_{options.hedge_percentile, options.min_hedge_delay} {
+}
+
+// "full jitter", so the clients that failed together do not all retry at the same time
+auto request_policy::backoff(std::size_t round) const -> std::chrono::nanoseconds {
+    const auto ceiling{std::min<std::chrono::nanoseconds>(options_.max_backoff,
+            std::chrono::nanoseconds{options_.base_backoff} * (std::int64_t{1} << std::min<std::size_t>(round, 30)))};
+    if (ceiling.count() <= 0) {
+        return std::chrono::nanoseconds{0};
+    }
+    std::uniform_int_distribution<std::int64_t> pick{0, ceiling.count()};
+    return std::chrono::nanoseconds{pick(random_engine())};
+}
+
+auto request_policy::stats() const -> retry_stats {
+    return retry_stats{
+        requests_.load(std::memory_order_relaxed),
+        retries_.load(std::memory_order_relaxed),
+        hedges_.load(std::memory_order_relaxed),
+        hedge_wins_.load(std::memory_order_relaxed),
+        budget_exhausted_.load(std::memory_order_relaxed)
+    };
+}
+
+auto async_http_client(request_policy& policy, std::string host, std::string port, std::string resource,
+                       request_deadlines deadlines) -> asio::awaitable<std::string> {
+    co_return co_await policy.run<std::string>(
+        [&]() {
+            return async_http_client(host, port, resource, deadlines);
+        },
+        [](const std::string& body) {
+            return body.empty();
+        },
+        request_deadlines::clock::now() + deadlines.total
+    );
+}
+
+auto async_http_client(request_policy& policy, connection_pool& pool, std::string host, std::string port, std::string resource,
+                       request_deadlines deadlines) -> asio::awaitable<std::string> {
+    co_return co_await policy.run<std::string>(pool.get_executor(),
+        [&]() {
+            return async_http_client(pool, host, port, resource, deadlines);
+        },
+        [](const std::string& body) {
+            return body.empty();
+        },
+        request_deadlines::clock::now() + deadlines.total
+    );
+}
+
+}	// end of namespace comm
@@ -0,0 +1,240 @@
+#pragma once
+#include "network_fwd.hh"
+#include "deadline.hh"
+#include "histogram.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace comm {
+class connection_pool;
+
+struct retry_options {
+    // the number of rounds, a round is a request and its hedge if there was one
+    std::size_t max_attempts{3};
+    // the wait before round n is a random time between 0 and min(max_backoff, base_backoff * 2^n)
+    std::chrono::milliseconds base_backoff{50};
+    std::chrono::milliseconds max_backoff{std::chrono::seconds{2}};
+    // send a second copy of a request that did not complete after hedge_percentile of the recent
+    // latencies, the first one to succeed is used and the other one is cancelled
+    bool hedge{false};
+    double hedge_percentile{0.95};
+    // the hedge delay is never shorter than this, and this is the delay until we have enough samples
+    std::chrono::milliseconds min_hedge_delay{10};
+    // retries and hedges together are limited to this fraction of the requests,
+    // with bursts of up to budget_reserve of them
+    double budget_ratio{0.1};
+    std::size_t budget_reserve{10};
+};
+
+struct retry_stats {
+    std::uint64_t requests{0};
+    std::uint64_t retries{0};
+    std::uint64_t hedges{0};            // hedges that were sent
+    std::uint64_t hedge_wins{0};        // hedges that completed before the request they were hedging
+    std::uint64_t budget_exhausted{0};  // retries and hedges that were not sent because of the budget
+};
+
+auto operator << (std::ostream& os, const retry_stats& stats) -> std::ostream&;
+
+// A token bucket: each request adds ratio of a token, each retry takes a whole one.
+// Under an outage this stops the clients from multiplying the load on the server.
+class retry_budget {
+public:
+    retry_budget(double ratio, std::size_t reserve);
+
+    auto deposit() -> void;
+    auto withdraw() -> bool;
+
+private:
+    static constexpr std::int64_t UNIT{1'000};
+
+    std::int64_t per_request_;
+    std::int64_t max_;
+    std::atomic<std::int64_t> balance_;
+};
+
+// The delay before sending a hedge, a percentile of the latencies of the recent requests
+class hedge_delay_tracker {
+public:
+    hedge_delay_tracker(double percentile, std::chrono::milliseconds minimum);
+
+    auto record(std::chrono::nanoseconds latency) -> void;
+
+    auto delay() const -> std::chrono::nanoseconds {
+        return std::chrono::nanoseconds{delay_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    static constexpr std::uint64_t MIN_SAMPLES{100};
+    static constexpr std::uint64_t UPDATE_EVERY{64};
+    // start over after this many samples, so the delay follows the server when it changes
+    static constexpr std::uint64_t WINDOW{10'000};
+
+    double percentile_;
+    std::chrono::nanoseconds minimum_;
+    std::mutex lock_;
+    latency_histogram recent_;
+    std::atomic<std::int64_t> delay_;
+};
+
+// Retries with exponential backoff and jitter, a retry budget and hedged requests.
+// One policy is meant to be shared by all the requests to an upstream, as the budget
+// and the hedge delay are learned from all of them. It is thread safe.
+class request_policy {
+public:
+    using clock = request_deadlines::clock;
+
+    explicit request_policy(retry_options options = {});
+
+    // Run attempt() until it succeeds, or the rounds or the budget ran out, and return the result
+    // of the last try. Each call to attempt() must start an independent request (a new connection,
+    // or one from a pool), as with hedging two of them run at the same time, on executor.
+    // The whole run, backoffs included, ends by deadline: the try in progress is then cancelled,
+    // and no other round is started. Only use this for idempotent requests.
+    template<typename T, typename Attempt, typename Failed>
+    auto run(asio::any_io_executor executor, Attempt attempt, Failed failed,
+             clock::time_point deadline = clock::time_point::max()) -> asio::awaitable<T>;
+
+    // same as above, the attempts run on a strand of the executor of the caller
+    template<typename T, typename Attempt, typename Failed>
+    auto run(Attempt attempt, Failed failed, clock::time_point deadline = clock::time_point::max()) -> asio::awaitable<T> {
+        co_return co_await run<T>(asio::make_strand(co_await asio::this_coro::executor), std::move(attempt), std::move(failed), deadline);
+    }
+
+    auto stats() const -> retry_stats;
+
+    auto hedge_delay() const -> std::chrono::nanoseconds {
+        return std::max<std::chrono::nanoseconds>(tracker_.delay(), options_.min_hedge_delay);
+    }
+
+private:
+    template<typename T, typename Attempt, typename Failed>
+    auto hedged(asio::any_io_executor executor, Attempt& attempt, Failed& failed, T& last) -> asio::awaitable<std::optional<T>>;
+
+    auto backoff(std::size_t round) const -> std::chrono::nanoseconds;
+
+    static auto bump(std::atomic<std::uint64_t>& counter) -> void {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    retry_options options_;
+    retry_budget budget_;
+    hedge_delay_tracker tracker_;
+    std::atomic<std::uint64_t> requests_{0};
+    std::atomic<std::uint64_t> retries_{0};
+    std::atomic<std::uint64_t> hedges_{0};
+    std::atomic<std::uint64_t> hedge_wins_{0};
+    std::atomic<std::uint64_t> budget_exhausted_{0};
+};
+
+template<typename T, typename Attempt, typename Failed>
+auto request_policy::run(asio::any_io_executor executor, Attempt attempt, Failed failed,
+                         clock::time_point deadline) -> asio::awaitable<T> {
+    budget_.deposit();
+    bump(requests_);
+    T last{};
+    for (std::size_t round = 0; round < std::max<std::size_t>(options_.max_attempts, 1); ++round) {
+        if (round > 0) {
+            const auto wait_until{clock::now() + backoff(round)};
+            if (wait_until >= deadline) {
+                // the retry could not complete in time anyway
+                break;
+            }
+            if (!budget_.withdraw()) {
+                bump(budget_exhausted_);
+                break;
+            }
+            bump(retries_);
+            asio::steady_timer wait(executor, wait_until);
+            co_await wait.async_wait(asio::as_tuple(asio::use_awaitable));
+            if ((co_await asio::this_coro::cancellation_state).cancelled() != asio::cancellation_type::none) {
+                break;
+            }
+        }
+        if (!options_.hedge) {
+            const auto started{clock::now()};
+            auto result = co_await with_deadline(asio::co_spawn(executor, attempt(), asio::use_awaitable), deadline);
+            if (!result) {
+                break;
+            }
+            if (!failed(*result)) {
+                tracker_.record(clock::now() - started);
+                co_return std::move(*result);
+            }
+            last = std::move(*result);
+        } else {
+            auto result = co_await with_deadline(hedged<T>(executor, attempt, failed, last), deadline);
+            if (!result) {
+                break;
+            }
+            if (*result) {
+                co_return std::move(**result);
+            }
+        }
+    }
+    co_return last;
+}
+
+// The request and its hedge run as a parallel group, the first one to succeed cancels the other.
+// The hedge waits for its turn on a timer, that the request moves to now if it failed,
+// so we do not wait for the delay when we already know that we need another try.
+template<typename T, typename Attempt, typename Failed>
+auto request_policy::hedged(asio::any_io_executor executor, Attempt& attempt, Failed& failed, T& last) -> asio::awaitable<std::optional<T>> {
+    std::optional<T> winner;
+    asio::steady_timer turn(executor, clock::now() + hedge_delay());
+
+    auto one = [&](bool hedge) -> asio::awaitable<void> {
+        if (hedge) {
+            while (turn.expiry() > clock::now()) {
+                co_await turn.async_wait(asio::as_tuple(asio::use_awaitable));
+                if ((co_await asio::this_coro::cancellation_state).cancelled() != asio::cancellation_type::none) {
+                    throw boost::system::system_error{asio::error::operation_aborted};
+                }
+            }
+            if (!budget_.withdraw()) {
+                bump(budget_exhausted_);
+                throw boost::system::system_error{asio::error::operation_aborted};
+            }
+            bump(hedges_);
+        }
+        const auto started{clock::now()};
+        auto result = co_await attempt();
+        if (failed(result)) {
+            if (!hedge) {
+                turn.expires_at(clock::now());
+            }
+            last = std::move(result);
+            throw boost::system::system_error{asio::error::try_again};
+        }
+        tracker_.record(clock::now() - started);
+        if (hedge) {
+            bump(hedge_wins_);
+        }
+        winner.emplace(std::move(result));
+    };
+
+    co_await asio::experimental::make_parallel_group(
+            asio::co_spawn(executor, one(false), asio::deferred),
+            asio::co_spawn(executor, one(true), asio::deferred)
+    ).async_wait(asio::experimental::wait_for_one_success(), asio::use_awaitable);
+    co_return winner;
+}
+
+// Send a GET request with the policy, each try is a new connection.
+// As with async_http_client, an empty body means that the request failed.
+// For raw TCP requests use run() with an attempt that connects and then calls async_tcp_read_write
+auto async_http_client(request_policy& policy, std::string host, std::string port, std::string resource,
+                       request_deadlines deadlines = {}) -> asio::awaitable<std::string>;
+
+// Same as above, with connections from the pool, the tries run on the executor of the pool
+auto async_http_client(request_policy& policy, connection_pool& pool, std::string host, std::string port, std::string resource,
+                       request_deadlines deadlines = {}) -> asio::awaitable<std::string>;
+
+}	// end of namespace comm
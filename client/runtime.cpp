@@ -0,0 +1,118 @@
+#include "runtime.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#ifdef __linux__
+#   include <pthread.h>
+#   include <sched.h>
+#endif  // __linux__
+
+namespace comm {
+namespace {
+
+auto pin_to_core([[maybe_unused]] std::thread& thread, [[maybe_unused]] std::size_t core) -> void {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % std::max(1u, std::thread::hardware_concurrency()), &set);
+    if (const auto r = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set); r != 0) {
+        LOG(WARNING) << "failed to pin thread to core " << core << ": " << r << ENDL;
+    }
+#endif  // __linux__
+}
+
+}		// end of local namespace
+
+runtime::runtime(runtime_options options) : options_{options} {
+    const auto count{options_.threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options_.threads};
+    shards_.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto s = std::make_unique<shard>();
+        s->work.emplace(s->context.get_executor());
+        shards_.push_back(std::move(s));
+    }
+}
+
+runtime::~runtime() {
+    stop();
+    join();
+}
+
+auto runtime::start() -> void {
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+        auto& s = *shards_[i];
+        if (s.thread.joinable()) {
+            continue;
+        }
+        s.thread = std::thread([&s]() {
+            try {
+                s.context.run();
+            } catch (const std::exception& e) {
+                LOG(ERROR) << "runtime thread terminated with error: " << e.what() << ENDL;
+            }
+        });
+        if (options_.pin_threads) {
+            pin_to_core(s.thread, i);
+        }
+    }
+}
+
+auto runtime::drain(std::chrono::milliseconds timeout) -> bool {
+    // without the work guard, each context returns from run once it has nothing more to do
+    for (auto& s : shards_) {
+        s->work.reset();
+    }
+    const auto deadline{std::chrono::steady_clock::now() + timeout};
+    while (in_flight() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    const auto drained{in_flight() == 0};
+    if (!drained) {
+        LOG(WARNING) << "runtime drain timeout, " << in_flight() << " coroutines still running" << ENDL;
+        stop();
+    }
+    join();
+    return drained;
+}
+
+auto runtime::stop() -> void {
+    for (auto& s : shards_) {
+        s->work.reset();
+        s->context.stop();
+    }
+}
+
+auto runtime::join() -> void {
+    for (auto& s : shards_) {
+        if (s->thread.joinable() && s->thread.get_id() != std::this_thread::get_id()) {
+            s->thread.join();
+        }
+    }
+}
+
+auto runtime::in_flight() const -> std::size_t {
+    std::size_t count{0};
+    for (const auto& s : shards_) {
+        count += s->in_flight.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+auto runtime::next() -> std::size_t {
+    if (options_.policy == dispatch_policy::round_robin || shards_.size() == 1) {
+        return next_.fetch_add(1, std::memory_order_relaxed) % shards_.size();
+    }
+    // least loaded, start the scan from a rotating position so ties are spread as well
+    const auto start{next_.fetch_add(1, std::memory_order_relaxed)};
+    auto best{start % shards_.size()};
+    auto load{in_flight(best)};
+    for (std::size_t i = 1; i < shards_.size() && load > 0; ++i) {
+        const auto candidate{(start + i) % shards_.size()};
+        if (const auto l = in_flight(candidate); l < load) {
+            best = candidate;
+            load = l;
+        }
+    }
+    return best;
+}
+
+}	// end of namespace comm
@@ -0,0 +1,115 @@
+#pragma once
+#include "network_fwd.hh"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace comm {
+
+// How new work is assigned to the io_contexts of the runtime
+enum class dispatch_policy {
+    round_robin,
+    least_loaded        // the context with the fewest coroutines in flight
+};
+
+struct runtime_options {
+    // number of io_context, each one with its own thread, 0 means one per core
+    std::size_t threads{0};
+    // pin thread i to core i (only supported on Linux)
+    bool pin_threads{false};
+    dispatch_policy policy{dispatch_policy::round_robin};
+};
+
+// Run N io_context, each one on its own thread, and spread coroutines between them.
+// Since each context is only used by a single thread, there is no need for strands,
+// and everything a coroutine uses (sockets, pools) should be bound to its context.
+class runtime {
+public:
+    explicit runtime(runtime_options options = {});
+    runtime(const runtime&) = delete;
+    auto operator = (const runtime&) -> runtime& = delete;
+    // stop the contexts without waiting for work in progress
+    ~runtime();
+
+    // start running the contexts, each in its own thread
+    auto start() -> void;
+
+    // Wait for all the work to finish and then stop the threads. If the work is not done
+    // by the timeout, the contexts are stopped anyway, and this would return false
+    auto drain(std::chrono::milliseconds timeout = std::chrono::seconds{30}) -> bool;
+
+    // stop all contexts now, pending work is abandoned
+    auto stop() -> void;
+
+    // wait for the threads to finish
+    auto join() -> void;
+
+    auto size() const -> std::size_t {
+        return shards_.size();
+    }
+
+    auto context(std::size_t index) -> asio::io_context& {
+        return shards_[index]->context;
+    }
+
+    // number of coroutines started with spawn that did not finish yet
+    auto in_flight() const -> std::size_t;
+
+    auto in_flight(std::size_t index) const -> std::size_t {
+        return shards_[index]->in_flight.load(std::memory_order_relaxed);
+    }
+
+    // select the context for the next coroutine based on the dispatch policy
+    auto next() -> std::size_t;
+
+    // Start the coroutine on one of the contexts, the completion token is as for asio::co_spawn.
+    // This is safe to call from any thread.
+    template<typename T, typename CompletionToken>
+    auto spawn(asio::awaitable<T> work, CompletionToken&& token) {
+        return spawn(next(), std::move(work), std::forward<CompletionToken>(token));
+    }
+
+    template<typename T, typename CompletionToken>
+    auto spawn(std::size_t index, asio::awaitable<T> work, CompletionToken&& token) {
+        auto& s = *shards_[index];
+        s.in_flight.fetch_add(1, std::memory_order_relaxed);
+        return asio::co_spawn(s.context, track(std::move(work), s.in_flight), std::forward<CompletionToken>(token));
+    }
+
+private:
+    // The members are destroyed in reverse order. Coroutines that were abandoned by stop, or by
+    // a drain that timed out, are destroyed with the context, and they still decrement in_flight
+    // then, so it must outlive the context. The work guard refers to the context, so it goes first
+    struct shard {
+        std::atomic<std::size_t> in_flight{0};
+        asio::io_context context{1};
+        std::optional<asio::executor_work_guard<asio::io_context::executor_type>> work;
+        std::thread thread;
+    };
+
+    template<typename T>
+    static auto track(asio::awaitable<T> work, std::atomic<std::size_t>& counter) -> asio::awaitable<T> {
+        struct done_guard {
+            std::atomic<std::size_t>& counter;
+            ~done_guard() {
+                counter.fetch_sub(1, std::memory_order_relaxed);
+            }
+        } guard{counter};
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(work);
+        } else {
+            co_return co_await std::move(work);
+        }
+    }
+
+    runtime_options options_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::atomic<std::size_t> next_{0};
+};
+
+}	// end of namespace comm
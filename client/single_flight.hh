@@ -0,0 +1,100 @@
+#pragma once
+#include "network_fwd.hh"
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace comm {
+
+// call f when we leave the scope, even if the coroutine frame is destroyed while it is suspended
+template<typename F>
+struct on_exit {
+    explicit on_exit(F f) : action{std::move(f)} {
+    }
+    on_exit(const on_exit&) = delete;
+    ~on_exit() {
+        action();
+    }
+
+    F action;
+};
+
+// The result of an operation that many coroutines wait for, possibly on different threads.
+// The operation runs in a coroutine of its own, that whoever created the flight spawns for it,
+// so none of the waiters can cut it short: a waiter that is cancelled, destroyed, or whose
+// deadline passed only stops waiting, and the others still get the result once it is complete.
+template<typename T>
+class single_flight {
+public:
+    using clock = asio::steady_timer::clock_type;
+
+    // Wait for the result, nullopt if the deadline passed first. The result is posted to the
+    // executor of the waiting coroutine
+    auto wait(clock::time_point deadline = clock::time_point::max()) -> asio::awaitable<std::optional<T>> {
+        auto executor = co_await asio::this_coro::executor;
+        auto w{std::make_shared<waiter>(executor, deadline)};
+        if (!join(w)) {
+            co_return w->result;
+        }
+        on_exit leave{[this, &w]() {
+            std::lock_guard guard{lock_};
+            waiters_.remove(w);
+        }};
+        while (!w->done) {
+            auto [e] = co_await w->signal.async_wait(asio::as_tuple(asio::use_awaitable));
+            if (!e && !w->done) {
+                co_return std::nullopt;
+            }
+        }
+        co_return std::move(w->result);
+    }
+
+    // store the result and wake all the waiters, the ones that come later get it right away
+    auto complete(T result) -> void {
+        std::list<std::shared_ptr<waiter>> waiters;
+        {
+            std::lock_guard guard{lock_};
+            result_ = result;
+            waiters.swap(waiters_);
+        }
+        for (auto& w : waiters) {
+            asio::post(w->signal.get_executor(), [w, result]() {
+                w->result = result;
+                w->done = true;
+                w->signal.cancel();
+            });
+        }
+    }
+
+private:
+    // only accessed from the executor of the waiting coroutine
+    struct waiter {
+        waiter(const asio::any_io_executor& executor, clock::time_point deadline) : signal{executor, deadline} {
+        }
+
+        std::optional<T> result;
+        bool done{false};
+        asio::steady_timer signal;
+    };
+
+    // false if the result is already here, and then it is in the waiter
+    auto join(const std::shared_ptr<waiter>& w) -> bool {
+        std::lock_guard guard{lock_};
+        if (result_) {
+            w->result = result_;
+            return false;
+        }
+        waiters_.push_back(w);
+        return true;
+    }
+
+    std::mutex lock_;
+    std::optional<T> result_;
+    std::list<std::shared_ptr<waiter>> waiters_;
+};
+
+}	// end of namespace comm
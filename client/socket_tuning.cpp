@@ -0,0 +1,62 @@
+#include "socket_tuning.hh"
+#include "log/logging.hh"
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace comm {
+namespace {
+
+template<typename Socket, typename Option>
+auto set(Socket& socket, const Option& option, const char* name) -> bool {
+    boost::system::error_code ec;
+    socket.set_option(option, ec);
+    if (ec) {
+        LOG(WARNING) << "failed to set " << name << " on the socket: " << ec.message() << ENDL;
+        return false;
+    }
+    return true;
+}
+
+template<typename Socket>
+auto size_buffers(Socket& socket, const socket_tuning& tuning) -> bool {
+    if (!socket.is_open()) {
+        return false;
+    }
+    bool ok{true};
+    if (tuning.receive_buffer > 0) {
+        ok = set(socket, asio::socket_base::receive_buffer_size{static_cast<int>(tuning.receive_buffer)}, "SO_RCVBUF");
+    }
+    if (tuning.send_buffer > 0) {
+        ok = set(socket, asio::socket_base::send_buffer_size{static_cast<int>(tuning.send_buffer)}, "SO_SNDBUF") && ok;
+    }
+    return ok;
+}
+
+}		// end of local namespace
+
+auto size_socket_buffers(tcp::socket& socket, const socket_tuning& tuning) -> bool {
+    return size_buffers(socket, tuning);
+}
+
+auto size_socket_buffers(tcp::acceptor& acceptor, const socket_tuning& tuning) -> bool {
+    return size_buffers(acceptor, tuning);
+}
+
+auto tune_socket(tcp::socket& socket, const socket_tuning& tuning) -> bool {
+    if (!socket.is_open()) {
+        return false;
+    }
+    bool ok{set(socket, tcp::no_delay{tuning.no_delay}, "TCP_NODELAY")};
+#if defined(__linux__) && defined(TCP_QUICKACK)
+    if (tuning.quick_ack) {
+        using quick_ack = asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>;
+        ok = set(socket, quick_ack{true}, "TCP_QUICKACK") && ok;
+    }
+#endif
+    return ok;
+}
+
+}	// end of namespace comm
@@ -0,0 +1,47 @@
+#pragma once
+#include "network_fwd.hh"
+#include <cstddef>
+
+namespace comm {
+
+// The socket options of a connection. The buffer sizes are set before the connection is made,
+// as the window scale is agreed on in the handshake, the rest once it is connected.
+// The defaults suit request/response traffic, use one of the profiles below to change them.
+struct socket_tuning {
+    // send small requests right away instead of waiting for the ACK of the previous segment (Nagle)
+    bool no_delay{true};
+    // ACK every segment instead of delaying the ACK (Linux only). The kernel may fall back
+    // to delayed ACKs later, so this mostly helps the first exchanges on the connection
+    bool quick_ack{false};
+    // SO_RCVBUF and SO_SNDBUF, 0 leaves them to the kernel. Note that setting the receive
+    // buffer turns off the automatic tuning of the kernel for this socket, and that the
+    // kernel limits the size to net.core.rmem_max and net.core.wmem_max
+    std::size_t receive_buffer{0};
+    std::size_t send_buffer{0};
+
+    // small RPCs, where the time to the first byte matters
+    static auto low_latency() -> socket_tuning {
+        socket_tuning t;
+        t.quick_ack = true;
+        return t;
+    }
+
+    // large transfers, where the window must cover the bandwidth delay product of the path
+    static auto bulk() -> socket_tuning {
+        socket_tuning t;
+        t.receive_buffer = 4 * 1'024 * 1'024;
+        t.send_buffer = 4 * 1'024 * 1'024;
+        return t;
+    }
+};
+
+// Set SO_RCVBUF and SO_SNDBUF on an open socket that is not connected yet, or on an acceptor
+// before it listens, so the accepted connections have them from the start
+auto size_socket_buffers(tcp::socket& socket, const socket_tuning& tuning) -> bool;
+auto size_socket_buffers(tcp::acceptor& acceptor, const socket_tuning& tuning) -> bool;
+
+// Set the rest of the options on a connected socket. A failure to set an option is logged and
+// otherwise ignored, the connection works without it. Return false if any of the options failed
+auto tune_socket(tcp::socket& socket, const socket_tuning& tuning) -> bool;
+
+}	// end of namespace comm
@@ -0,0 +1,284 @@
+#include "submission_queue.hh"
+#include "async_client.hh"
+#include "log/logging.hh"
+#include <ostream>
+#include <thread>
+
+namespace comm {
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// Retry the submission until it was accepted, the queue was closed, or the time is up.
+// At first only yield, as the drain usually makes room quickly, then sleep so we do not burn the core
+template<typename Submit>
+auto submit_with_backoff(Submit try_once, std::chrono::milliseconds wait) -> submit_status {
+    const auto deadline{clock::now() + wait};
+    for (std::size_t attempt = 0;; ++attempt) {
+        const auto status{try_once()};
+        if (status != submit_status::full || clock::now() >= deadline) {
+            return status;
+        }
+        if (attempt < 16) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds{50});
+        }
+    }
+}
+
+auto with_future(submission& job) -> std::future<std::string> {
+    auto promise{std::make_shared<std::promise<std::string>>()};
+    auto result{promise->get_future()};
+    job.done = [promise](std::string answer) {
+        promise->set_value(std::move(answer));
+    };
+    return result;
+}
+
+}		// end of local namespace
+
+auto operator << (std::ostream& os, const submission_stats& stats) -> std::ostream& {
+    return os << "accepted: " << stats.accepted << ", rejected: " << stats.rejected
+        << ", completed: " << stats.completed << ", batches: " << stats.batches << ", wakeups: " << stats.wakeups;
+}
+
+submission_queue::submission_queue(runtime& workers, std::size_t index, submission_options options) :
+        runtime_{workers}, index_{index}, context_{workers.context(index)}, options_{options}, ring_{options.capacity},
+        signal_{context_, asio::steady_timer::time_point::max()} {
+}
+
+submission_queue::~submission_queue() {
+    close();
+    while ((running_.load(std::memory_order_acquire) || posted_.load(std::memory_order_acquire) > 0) && !context_.stopped()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+}
+
+auto submission_queue::start() -> void {
+    if (running_.exchange(true)) {
+        return;
+    }
+    runtime_.spawn(index_, run(), asio::detached);
+}
+
+auto submission_queue::try_submit(submission& job) -> submit_status {
+    // counted before we look at closed_, and both are seq_cst as in run: either we see the close,
+    // or the drain sees us and does not return before we pushed or gave up
+    producers_.fetch_add(1);
+    if (closed_.load()) {
+        producers_.fetch_sub(1, std::memory_order_release);
+        return submit_status::closed;
+    }
+    if (!ring_.try_push(job)) {
+        producers_.fetch_sub(1, std::memory_order_release);
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return submit_status::full;
+    }
+    accepted_.fetch_add(1, std::memory_order_relaxed);
+    // pairs with the fence in run, either we see that the drain went to sleep,
+    // or the drain sees our submission before it goes to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed) && sleeping_.exchange(false)) {
+        wake();
+    }
+    producers_.fetch_sub(1, std::memory_order_release);
+    return submit_status::accepted;
+}
+
+auto submission_queue::submit(submission& job, std::chrono::milliseconds wait) -> submit_status {
+    return submit_with_backoff([this, &job]() {
+        return try_submit(job);
+    }, wait);
+}
+
+auto submission_queue::try_submit_future(submission job) -> submitted {
+    submitted result;
+    result.result = with_future(job);
+    result.status = try_submit(job);
+    return result;
+}
+
+auto submission_queue::close() -> void {
+    if (closed_.exchange(true)) {
+        return;
+    }
+    if (sleeping_.exchange(false)) {
+        wake();
+    }
+}
+
+auto submission_queue::wake() -> void {
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
+    posted_.fetch_add(1, std::memory_order_relaxed);
+    asio::post(context_, [this]() {
+        if (waiting_) {
+            signal_.cancel();
+        }
+        posted_.fetch_sub(1, std::memory_order_release);
+    });
+}
+
+auto submission_queue::sleep() -> asio::awaitable<void> {
+    waiting_ = true;
+    signal_.expires_at(asio::steady_timer::time_point::max());
+    co_await signal_.async_wait(asio::as_tuple(asio::use_awaitable));
+    waiting_ = false;
+}
+
+auto submission_queue::run() -> asio::awaitable<void> {
+    auto executor = co_await asio::this_coro::executor;
+    while (true) {
+        std::size_t taken{0};
+        while (taken < options_.batch && in_flight_ < options_.max_in_flight) {
+            auto job{ring_.try_pop()};
+            if (!job) {
+                break;
+            }
+            launch(std::move(*job));
+            ++taken;
+        }
+        if (taken > 0) {
+            batches_.fetch_add(1, std::memory_order_relaxed);
+            // let the requests that we started, and the rest of the work of the context, run
+            co_await asio::post(executor, asio::use_awaitable);
+            continue;
+        }
+        if (in_flight_ >= options_.max_in_flight) {
+            // a request that is done wakes us up
+            co_await sleep();
+            continue;
+        }
+        if (closed_.load() && !ring_.ready()) {
+            if (producers_.load() > 0) {
+                // a producer that did not see the close is about to push, or to give up
+                co_await asio::post(executor, asio::use_awaitable);
+                continue;
+            }
+            // nothing can be pushed from now on, but something may have been since we looked
+            if (ring_.ready()) {
+                continue;
+            }
+            if (in_flight_ == 0) {
+                break;
+            }
+            co_await sleep();
+            continue;
+        }
+        // nothing to do, tell the producers that they need to wake us up, and then check again,
+        // in case something was submitted before they could see it
+        sleeping_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring_.ready() || closed_.load(std::memory_order_relaxed)) {
+            sleeping_.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        co_await sleep();
+        sleeping_.store(false, std::memory_order_relaxed);
+    }
+    running_.store(false, std::memory_order_release);
+}
+
+auto submission_queue::launch(submission job) -> void {
+    ++in_flight_;
+    runtime_.spawn(index_, execute(std::move(job)), asio::detached);
+}
+
+auto submission_queue::execute(submission job) -> asio::awaitable<void> {
+    std::string result;
+    try {
+        switch (job.kind) {
+        case request_kind::http_get:
+            result = co_await async_http_client(job.host, job.port, job.resource, job.deadlines);
+            break;
+        case request_kind::tcp_exchange: {
+            connect_options options;
+            options.deadline = job.timeout;
+            if (auto socket = co_await async_connect(job.host, job.port, options); socket.is_open()) {
+                result = co_await async_tcp_read_write(socket, job.message, job.delimiter, job.timeout);
+            }
+            break;
+        }
+        }
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "submitted request to " << job.host << ":" << job.port << " failed: " << e.what() << ENDL;
+        result.clear();
+    }
+    completed_.fetch_add(1, std::memory_order_relaxed);
+    if (job.done) {
+        try {
+            job.done(std::move(result));
+        } catch (const std::exception& e) {
+            LOG(ERROR) << "completion of a submitted request failed: " << e.what() << ENDL;
+        }
+    }
+    --in_flight_;
+    if (waiting_) {
+        signal_.cancel();
+    }
+}
+
+auto submission_queue::stats() const -> submission_stats {
+    submission_stats stats;
+    stats.accepted = accepted_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+request_dispatcher::request_dispatcher(runtime& workers, submission_options options) : runtime_{workers} {
+    queues_.reserve(runtime_.size());
+    for (std::size_t i = 0; i < runtime_.size(); ++i) {
+        queues_.push_back(std::make_unique<submission_queue>(runtime_, i, options));
+        queues_.back()->start();
+    }
+}
+
+request_dispatcher::~request_dispatcher() {
+    close();
+}
+
+auto request_dispatcher::try_submit(submission& job) -> submit_status {
+    const auto first{runtime_.next()};
+    auto status{submit_status::full};
+    for (std::size_t i = 0; i < queues_.size() && status == submit_status::full; ++i) {
+        status = queues_[(first + i) % queues_.size()]->try_submit(job);
+    }
+    return status;
+}
+
+auto request_dispatcher::submit(submission& job, std::chrono::milliseconds wait) -> submit_status {
+    return submit_with_backoff([this, &job]() {
+        return try_submit(job);
+    }, wait);
+}
+
+auto request_dispatcher::try_submit_future(submission job) -> submitted {
+    submitted result;
+    result.result = with_future(job);
+    result.status = try_submit(job);
+    return result;
+}
+
+auto request_dispatcher::close() -> void {
+    for (auto& q : queues_) {
+        q->close();
+    }
+}
+
+auto request_dispatcher::stats() const -> submission_stats {
+    submission_stats total;
+    for (const auto& q : queues_) {
+        const auto s{q->stats()};
+        total.accepted += s.accepted;
+        total.rejected += s.rejected;
+        total.completed += s.completed;
+        total.batches += s.batches;
+        total.wakeups += s.wakeups;
+    }
+    return total;
+}
+
+}	// end of namespace comm
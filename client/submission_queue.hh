@@ -0,0 +1,239 @@
+#pragma once
+#include "network_fwd.hh"
+#include "deadline.hh"
+#include "runtime.hh"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace comm {
+
+// A bounded lock free queue for many producers and a single consumer, a ring of cells where
+// each cell has a sequence number that tells whose turn it is to use it (after D. Vyukov).
+// Producers claim a position with a CAS on the head, so a push never waits for a lock,
+// and the consumer reads the cells in order without any atomic read-modify-write.
+template<typename T>
+class mpsc_ring {
+public:
+    // the capacity is rounded up to a power of 2
+    explicit mpsc_ring(std::size_t capacity) : mask_{round_up(capacity) - 1}, cells_{new cell[mask_ + 1]} {
+        for (std::size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpsc_ring(const mpsc_ring&) = delete;
+    auto operator = (const mpsc_ring&) -> mpsc_ring& = delete;
+
+    // from any thread, value is moved from only if there was room for it
+    auto try_push(T& value) -> bool {
+        auto position{head_.load(std::memory_order_relaxed)};
+        while (true) {
+            auto& c{cells_[position & mask_]};
+            const auto sequence{c.sequence.load(std::memory_order_acquire)};
+            const auto diff{static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position)};
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    c.value = std::move(value);
+                    c.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // the consumer did not take the value that is a lap behind us yet, so we are full
+                return false;
+            } else {
+                position = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // only from the consumer
+    auto try_pop() -> std::optional<T> {
+        auto& c{cells_[tail_ & mask_]};
+        if (c.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+            return std::nullopt;
+        }
+        std::optional<T> value{std::move(c.value)};
+        c.value = T{};
+        c.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+        ++tail_;
+        return value;
+    }
+
+    // only from the consumer, true if the next value is ready to be taken
+    auto ready() const -> bool {
+        return cells_[tail_ & mask_].sequence.load(std::memory_order_acquire) == tail_ + 1;
+    }
+
+    auto capacity() const -> std::size_t {
+        return mask_ + 1;
+    }
+
+private:
+    struct cell {
+        std::atomic<std::size_t> sequence{0};
+        T value{};
+    };
+
+    static auto round_up(std::size_t n) -> std::size_t {
+        std::size_t size{2};
+        while (size < n) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    // producers and the consumer update different cache lines
+    static constexpr std::size_t CACHE_LINE{64};
+
+    const std::size_t mask_;
+    std::unique_ptr<cell[]> cells_;
+    alignas(CACHE_LINE) std::atomic<std::size_t> head_{0};
+    alignas(CACHE_LINE) std::size_t tail_{0};
+};
+
+enum class request_kind {
+    http_get,       // async_http_client(host, port, resource, deadlines)
+    tcp_exchange    // connect, then async_tcp_read_write(message, delimiter, timeout)
+};
+
+// A request that is handed to an io_context from a thread that does not run it
+struct submission {
+    request_kind kind{request_kind::http_get};
+    std::string host;
+    std::string port;
+    std::string resource;
+    request_deadlines deadlines;
+    std::string message;
+    std::string delimiter{"\n"};
+    std::chrono::milliseconds timeout{DEFAULT_IO_TIMEOUT};
+    // Called with the response body, or the answer of the server, that is empty on failure.
+    // It is called on the thread of the context, so it must not block
+    std::function<void(std::string)> done;
+};
+
+enum class submit_status {
+    accepted,
+    full,           // try again later, or slow down
+    closed
+};
+
+// a submission whose result is delivered through a future, it is only valid when it was accepted
+struct submitted {
+    submit_status status{submit_status::closed};
+    std::future<std::string> result;
+};
+
+struct submission_options {
+    // the number of requests that can wait in the queue of a context
+    std::size_t capacity{1'024};
+    // the number of requests that are taken from the queue before the other work of the context gets a turn
+    std::size_t batch{64};
+    // requests that are running at the same time on the context, when there are
+    // this many the queue is not drained, so it fills, and the producers see it
+    std::size_t max_in_flight{1'024};
+};
+
+struct submission_stats {
+    std::uint64_t accepted{0};
+    std::uint64_t rejected{0};      // the queue was full
+    std::uint64_t completed{0};
+    std::uint64_t batches{0};       // times the queue was drained
+    std::uint64_t wakeups{0};       // times a producer had to wake the drain up, this is the only time it posts to the context
+};
+
+auto operator << (std::ostream& os, const submission_stats& stats) -> std::ostream&;
+
+// Hand requests to a context of the runtime from other threads, without a post (and its handler
+// allocation) for each of them. The requests are pushed to a ring, and a single coroutine on the
+// context takes them in batches and starts them there. The context is only woken up through a post
+// when that coroutine ran out of work and went to sleep. The coroutine and the requests are started
+// with runtime::spawn, so they count in the in_flight of the context.
+class submission_queue {
+public:
+    submission_queue(runtime& workers, std::size_t index, submission_options options = {});
+    submission_queue(const submission_queue&) = delete;
+    auto operator = (const submission_queue&) -> submission_queue& = delete;
+    // close, and if the context is running, wait for the drain to return,
+    // so it must not be destroyed from the thread of the context
+    ~submission_queue();
+
+    // Safe to call from any thread. The job is moved from only if it was accepted,
+    // so after full it can be submitted again as is
+    auto try_submit(submission& job) -> submit_status;
+
+    // same as try_submit, and while the queue is full keep trying for up to wait
+    auto submit(submission& job, std::chrono::milliseconds wait) -> submit_status;
+
+    // same as try_submit, the result is delivered through the future instead of job.done
+    auto try_submit_future(submission job) -> submitted;
+
+    // Start the drain on the context, it is done once the queue was closed,
+    // and the requests that were accepted before are done. Until then runtime::drain waits for it
+    auto start() -> void;
+
+    // stop accepting requests, the ones that were accepted are still sent
+    auto close() -> void;
+
+    auto stats() const -> submission_stats;
+
+private:
+    auto run() -> asio::awaitable<void>;
+    auto launch(submission job) -> void;
+    auto execute(submission job) -> asio::awaitable<void>;
+    auto sleep() -> asio::awaitable<void>;
+    auto wake() -> void;
+
+    runtime& runtime_;
+    std::size_t index_;
+    asio::io_context& context_;
+    submission_options options_;
+    mpsc_ring<submission> ring_;
+    asio::steady_timer signal_;
+    std::atomic<bool> sleeping_{false};     // the drain waits for the producers to wake it
+    std::atomic<bool> closed_{false};
+    std::atomic<std::size_t> producers_{0}; // try_submit calls that may still push
+    std::atomic<bool> running_{false};      // the drain was started and is not done yet
+    std::atomic<std::size_t> posted_{0};    // wake ups that were posted to the context and did not run yet
+    bool waiting_{false};                   // the drain waits on signal_, for any reason
+    std::size_t in_flight_{0};              // only used from the context
+    std::atomic<std::uint64_t> accepted_{0};
+    std::atomic<std::uint64_t> rejected_{0};
+    std::atomic<std::uint64_t> completed_{0};
+    std::atomic<std::uint64_t> batches_{0};
+    std::atomic<std::uint64_t> wakeups_{0};
+};
+
+// A submission queue for each context of the runtime. Requests go to the context that the
+// runtime selects, and if its queue is full, to the next one that has room
+class request_dispatcher {
+public:
+    explicit request_dispatcher(runtime& workers, submission_options options = {});
+    request_dispatcher(const request_dispatcher&) = delete;
+    auto operator = (const request_dispatcher&) -> request_dispatcher& = delete;
+    ~request_dispatcher();
+
+    auto try_submit(submission& job) -> submit_status;
+    auto submit(submission& job, std::chrono::milliseconds wait) -> submit_status;
+    auto try_submit_future(submission job) -> submitted;
+
+    // Close all the queues, call it before runtime::drain, so the drain coroutines
+    // return once the requests that were accepted are done
+    auto close() -> void;
+
+    auto stats() const -> submission_stats;
+
+private:
+    runtime& runtime_;
+    std::vector<std::unique_ptr<submission_queue>> queues_;
+};
+
+}	// end of namespace comm
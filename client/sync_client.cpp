@@ -1,23 +1,45 @@
 #include "sync_client.hh"
+#include "http_parser.hh"
+#include "chunked_decoder.hh"
+#include "dns_cache.hh"
 #include "log/logging.hh"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <sstream>
 
 namespace comm {
-auto connect(const char* to, const char* port, boost::asio::io_context& ctx) -> std::optional<tcp::socket> {
+auto connect(const char* to, const char* port, boost::asio::io_context& ctx, const socket_tuning& tuning) -> std::optional<tcp::socket> {
     if (!(to && port)) {
       LOG(ERROR) << "we have null points " << std::boolalpha << (to == nullptr) << ", " << (port == nullptr) << ENDL;
       return std::nullopt;
     }
-    tcp::resolver resolver(ctx);
-    tcp::resolver::results_type endpoints = resolver.resolve(to, port);
+    const auto endpoints{dns_cache::shared().resolve(to, port, ctx)};
+    if (!endpoints) {
+      return std::nullopt;
+    }
     LOG(INFO) << "connecting to remote server: " << to << ":" << port << ENDL;
     // Try each endpoint until we successfully establish a connection.
     tcp::socket socket(ctx);
-    boost::system::error_code ec;
-    boost::asio::connect(socket, endpoints, ec);
+    boost::system::error_code ec{boost::asio::error::not_found};
+    for (const auto& endpoint : *endpoints) {
+      // the buffer sizes must be set before connecting, so each address gets a socket of its own
+      socket.close(ec);
+      socket.open(endpoint.endpoint().protocol(), ec);
+      if (!ec) {
+        size_socket_buffers(socket, tuning);
+        socket.connect(endpoint.endpoint(), ec);
+      }
+      if (!ec) {
+        break;
+      }
+    }
     if (ec) {
 	    LOG(ERROR) << "failed to connect to " << to << ":" << port << " - " << ec.message() << ENDL;
+      dns_cache::shared().forget(to, port);
       return std::nullopt;
     }
+    tune_socket(socket, tuning);
     return socket;
 }
 
@@ -52,12 +74,13 @@ auto tcp_send_request(tcp::socket& with, const std::string& request) -> bool {
 }
 
 auto http_send_request(tcp::socket& with, const char* host, const std::string& response) -> bool {
-    boost::asio::streambuf request;
-    std::ostream request_stream(&request);
-    request_stream << "GET " << response << " HTTP/1.1\r\n";
-    request_stream << "Host: " << host << "\r\n";
-    request_stream << "Accept: */*\r\n";
-    request_stream << "Connection: close\r\n\r\n";
+    using namespace std::string_view_literals;
+
+    const std::array<boost::asio::const_buffer, 5> request{
+        boost::asio::buffer("GET "sv), boost::asio::buffer(response),
+        boost::asio::buffer(" HTTP/1.1\r\nHost: "sv), boost::asio::buffer(host, std::strlen(host)),
+        boost::asio::buffer("\r\nAccept: */*\r\nConnection: close\r\n\r\n"sv)
+    };
 
     // Send the request.
     boost::system::error_code ec;
@@ -70,76 +93,109 @@ auto http_send_request(tcp::socket& with, const char* host, const std::string& r
 }
 
 auto http_handle_response(tcp::socket& from) -> std::optional<std::string> {
-    boost::asio::streambuf response;
-    boost::asio::read_until(from, response, "\r\n");
+    static constexpr std::size_t READ_SIZE{4 * 1'024};
 
-    // Check that response is OK.
-    std::istream response_stream(&response);
-    std::string http_version;
+    // Read until we have the status line and all the headers, anything
+    // after the header in the buffer is the start of the body
+    std::string buffer;
+    response_parser parser;
     boost::system::error_code ec;
-    response_stream >> http_version;
-    unsigned int status_code{10000};
-    response_stream >> status_code;
-    std::string status_message;
-    std::getline(response_stream, status_message);
-    if (!response_stream || http_version.size() < 6 || http_version.substr(0, 5) != "HTTP/") {
-      LOG(WARNING) << "Invalid response: '" << status_message << "'" << ENDL;
-      return {};
+    auto r{parser.parse(buffer)};
+    while (r == response_parser::result::incomplete) {
+      const auto used{buffer.size()};
+      buffer.resize(used + READ_SIZE);
+      const auto n = from.read_some(boost::asio::buffer(buffer.data() + used, READ_SIZE), ec);
+      buffer.resize(used + n);
+      if (ec) {
+        LOG(ERROR) << "failed to read header: " << ec.message() << ENDL;
+        return std::nullopt;
+      }
+      r = parser.parse(buffer);
     }
-    if (status_code != 200) {
-      LOG(WARNING) << "Error from server: Response returned with status code " << status_code << ENDL;
+    if (r == response_parser::result::error) {
+      LOG(WARNING) << "Invalid response: '" << buffer.substr(0, buffer.find('\n')) << "'" << ENDL;
       return std::nullopt;
     }
-
-    // Read the response headers, which are terminated by a blank line.
-    boost::asio::read_until(from, response, "\r\n\r\n", ec);
-    if (ec) {
-      LOG(ERROR) << "failed to read header: " << ec.message() << ENDL;
-      return {};
-    }
-
-    // Process the response headers.
-    std::string header;
-    while (std::getline(response_stream, header) && header != "\r") {
-      //LOG(INFO) << header << ENDL;
-    }
-    //LOG(INFO) << ENDL;
-
-    std::ostringstream output;
-    // Write whatever content we already have to output.
-    if (response.size() > 0) {
-      output << &response;
+    if (parser.status_code() != 200) {
+      LOG(WARNING) << "Error from server: Response returned with status code " << parser.status_code() << ENDL;
+      return std::nullopt;
     }
 
-    // Read until EOF, writing data to output as we go.
-    boost::system::error_code error;
-    auto r = boost::asio::read(from, response, boost::asio::transfer_at_least(1), error);
-    while (r && !error) {
-      output << &response;
-      r = boost::asio::read(from, response, boost::asio::transfer_at_least(1), error);
+    std::string output{buffer.substr(parser.header_size())};
+    switch (parser.framing()) {
+      case body_framing::none:
+        return std::string{};
+      case body_framing::content_length: {
+        const auto len{static_cast<std::size_t>(parser.content_length())};
+        const auto have{std::min(len, output.size())};
+        output.resize(len);
+        boost::asio::read(from, boost::asio::buffer(output.data() + have, len - have), ec);
+        if (ec) {
+          LOG(ERROR) << "failed to read body: " << ec.message() << ENDL;
+          return std::nullopt;
+        }
+        return output;
+      }
+      case body_framing::close:
+        // Read until EOF, writing data to output as we go.
+        boost::asio::read(from, boost::asio::dynamic_buffer(output), ec);
+        if (ec != boost::asio::error::eof) {
+          LOG(ERROR) << "got invalid error of " << ec.message() << ENDL;
+          return std::nullopt;
+        }
+        return output;
+      case body_framing::chunked:
+        break;
     }
-    if (error != boost::asio::error::eof) {
-      LOG(ERROR) << "got invalid error of " << ec.message() << ENDL;
-      return std::nullopt;
+    // decode the chunks in place, the decoded body is never longer than the encoded data
+    chunked_decoder chunks;
+    std::size_t decoded{0};
+    std::size_t next{0};
+    while (true) {
+      while (next < output.size()) {
+        const auto step{chunks.decode(std::string_view{output}.substr(next))};
+        std::copy(step.data.begin(), step.data.end(), output.begin() + decoded);
+        decoded += step.data.size();
+        next += step.consumed;
+        if (chunks.failed()) {
+          LOG(ERROR) << "invalid chunked encoding in the response body" << ENDL;
+          return std::nullopt;
+        }
+        if (chunks.done()) {
+          output.resize(decoded);
+          return output;
+        }
+      }
+      output.resize(decoded + READ_SIZE);
+      next = decoded;
+      const auto n = from.read_some(boost::asio::buffer(output.data() + decoded, READ_SIZE), ec);
+      output.resize(decoded + n);
+      if (ec) {
+        LOG(ERROR) << "failed to read body: " << ec.message() << ENDL;
+        return std::nullopt;
+      }
     }
-    return output.str();
 }
 
 auto http_upload(tcp::socket& connection, const char* host, const std::string& resource, const std::string& body) -> std::optional<std::string> {
-    boost::asio::streambuf request;
-    std::ostream request_stream(&request);
-    request_stream << "POST " << resource << " HTTP/1.1\r\n";
-    request_stream << "Host: " << host << "\r\n";
-    request_stream << "Accept: */*\r\n";
-    request_stream << "Content-Type: text/plain; charset=UTF-8\r\n";
-    request_stream << "Content-Length: " << body.length() << "\r\n";
-    request_stream << "Connection: close\r\n\r\n";
-    request_stream << body;
+    using namespace std::string_view_literals;
+
+    // the headers and the body are separate buffers in a single gather write,
+    // so the body is never copied into the request
+    const auto length{std::to_string(body.length())};
+    const std::array<boost::asio::const_buffer, 8> request{
+        boost::asio::buffer("POST "sv), boost::asio::buffer(resource),
+        boost::asio::buffer(" HTTP/1.1\r\nHost: "sv), boost::asio::buffer(host, std::strlen(host)),
+        boost::asio::buffer("\r\nAccept: */*\r\nContent-Type: text/plain; charset=UTF-8\r\nContent-Length: "sv),
+        boost::asio::buffer(length),
+        boost::asio::buffer("\r\nConnection: close\r\n\r\n"sv),
+        boost::asio::buffer(body)
+    };
 
     // Send the request.
     boost::system::error_code ec;
     const auto s = boost::asio::write(connection, request, ec);
-    if (ec || s < body.size()) {
+    if (ec || s < boost::asio::buffer_size(request)) {
       LOG(ERROR) << "error sending request: " << ec.message() << ENDL;
 	    return std::nullopt;
     }
@@ -1,5 +1,6 @@
 #pragma once
 #include "network_fwd.hh"
+#include "socket_tuning.hh"
 #include <string>
 #include <optional>
 
@@ -10,7 +11,8 @@ auto http_send_request(tcp::socket& with, const char* host, const std::string& r
 auto tcp_handle_response(tcp::socket& from, const std::string_view delimiter) -> std::optional<std::string>;
 auto tcp_send_request(tcp::socket& with, const std::string& request) -> bool;
 
-auto connect(const char* to, const char* port, boost::asio::io_context& ctx) -> std::optional<tcp::socket>;
+// the connected socket is set up with tuning, by default with TCP_NODELAY
+auto connect(const char* to, const char* port, boost::asio::io_context& ctx, const socket_tuning& tuning = {}) -> std::optional<tcp::socket>;
 
 auto http_upload(tcp::socket& connection, const char* host, const std::string& resource, const std::string& body) -> std::optional<std::string>;
 }	// end of namespace comm
@@ -0,0 +1,137 @@
+#include "tcp_pipeline.hh"
+#include "write_queue.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <deque>
+#include <list>
+
+namespace comm {
+
+// Both the write and the read loops are holding the state, so it is safe
+// to destroy the channel while they are still running
+struct pipelined_channel::state {
+    struct pending {
+        explicit pending(const asio::any_io_executor& executor) :
+            signal{executor, asio::steady_timer::time_point::max()} {
+        }
+
+        std::string reply;
+        bool done{false};
+        asio::steady_timer signal;
+    };
+
+    state(tcp::socket s, std::string d, std::size_t max) :
+            socket{std::move(s)}, output{socket}, delimiter{std::move(d)}, max_outstanding{std::max<std::size_t>(max, 1)} {
+    }
+
+    auto fail_all() -> void;
+    auto wake_slot_waiter() -> void;
+
+    tcp::socket socket;
+    write_queue output;                               // requests sent together while a write is in progress
+    std::string delimiter;
+    std::size_t max_outstanding;
+    std::deque<std::shared_ptr<pending>> waiting;     // in the order the requests were sent
+    std::list<asio::steady_timer*> slot_waiters;
+    std::string input;                                // data we read beyond the last reply
+    bool reading{false};
+};
+
+auto pipelined_channel::read_loop(std::shared_ptr<state> s) -> asio::awaitable<void> {
+  while (!s->waiting.empty() && s->socket.is_open()) {
+    auto [e, n] = co_await asio::async_read_until(s->socket,
+            asio::dynamic_buffer(s->input), s->delimiter,
+            asio::as_tuple(asio::use_awaitable)
+    );
+    if (e) {
+      if (e != asio::error::eof && e != asio::error::operation_aborted) {
+        LOG(ERROR) << "error: got and error while trying to read pipelined reply " << e.message() << ENDL;
+      }
+      s->fail_all();
+      break;
+    }
+    auto p = std::move(s->waiting.front());
+    s->waiting.pop_front();
+    p->reply.assign(s->input, 0, n);
+    s->input.erase(0, n);
+    p->done = true;
+    p->signal.cancel();
+    s->wake_slot_waiter();
+  }
+  s->reading = false;
+}
+
+auto pipelined_channel::state::fail_all() -> void {
+  boost::system::error_code ec;
+  socket.close(ec);
+  for (auto& p : waiting) {
+    p->done = true;
+    p->signal.cancel();
+  }
+  waiting.clear();
+  for (auto* t : slot_waiters) {
+    t->cancel();
+  }
+  slot_waiters.clear();
+}
+
+auto pipelined_channel::state::wake_slot_waiter() -> void {
+  if (!slot_waiters.empty()) {
+    slot_waiters.front()->cancel();
+    slot_waiters.pop_front();
+  }
+}
+
+pipelined_channel::pipelined_channel(tcp::socket socket, std::string delimiter, std::size_t max_outstanding) :
+        state_{std::make_shared<state>(std::move(socket), std::move(delimiter), max_outstanding)} {
+}
+
+pipelined_channel::~pipelined_channel() {
+  close();
+}
+
+auto pipelined_channel::close() -> void {
+  if (state_) {
+    state_->fail_all();
+  }
+}
+
+auto pipelined_channel::is_open() const -> bool {
+  return state_ && state_->socket.is_open();
+}
+
+auto pipelined_channel::outstanding() const -> std::size_t {
+  return state_ ? state_->waiting.size() : 0;
+}
+
+auto pipelined_channel::request(std::string message) -> asio::awaitable<std::string> {
+  auto s = state_;
+  const auto executor{s->socket.get_executor()};
+  // wait for a free slot, the read loop would wake us once a reply arrives
+  while (s->waiting.size() >= s->max_outstanding && s->socket.is_open()) {
+    asio::steady_timer slot(executor, asio::steady_timer::time_point::max());
+    s->slot_waiters.push_back(&slot);
+    co_await slot.async_wait(asio::as_tuple(asio::use_awaitable));
+    s->slot_waiters.remove(&slot);
+  }
+  if (!s->socket.is_open() || message.empty()) {
+    co_return std::string{};
+  }
+
+  auto p = std::make_shared<state::pending>(executor);
+  s->waiting.push_back(p);
+  if (!s->reading) {
+    s->reading = true;
+    asio::co_spawn(executor, read_loop(s), asio::detached);
+  }
+  // requests that are queued while we are sending are coalesced into the next write
+  if (co_await s->output.send(message) == 0) {
+    s->fail_all();
+  }
+  while (!p->done) {
+    co_await p->signal.async_wait(asio::as_tuple(asio::use_awaitable));
+  }
+  co_return std::move(p->reply);
+}
+
+}	// end of namespace comm
@@ -0,0 +1,43 @@
+#pragma once
+#include "network_fwd.hh"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace comm {
+
+// A TCP connection for a delimiter framed protocol that supports pipelining:
+// up to max_outstanding requests are sent without waiting for the replies,
+// and since the server answers in order, replies are matched to requests FIFO.
+// The channel owns the socket, and it must be used from the socket's executor.
+class pipelined_channel {
+public:
+    pipelined_channel(tcp::socket socket, std::string delimiter, std::size_t max_outstanding = 16);
+    pipelined_channel(const pipelined_channel&) = delete;
+    auto operator = (const pipelined_channel&) -> pipelined_channel& = delete;
+    pipelined_channel(pipelined_channel&&) = default;
+    auto operator = (pipelined_channel&&) -> pipelined_channel& = default;
+    // close the connection, requests that are still waiting get empty replies
+    ~pipelined_channel();
+
+    // Send the message and wait for its reply (including the delimiter).
+    // If we already have max_outstanding requests, this waits for a free slot first.
+    // On failure the reply is empty and the channel is closed.
+    auto request(std::string message) -> asio::awaitable<std::string>;
+
+    auto close() -> void;
+
+    auto is_open() const -> bool;
+
+    // number of requests that were sent (or queued to be sent) and did not get a reply yet
+    auto outstanding() const -> std::size_t;
+
+private:
+    struct state;
+
+    static auto read_loop(std::shared_ptr<state> s) -> asio::awaitable<void>;
+
+    std::shared_ptr<state> state_;
+};
+
+}	// end of namespace comm
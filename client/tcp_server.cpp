@@ -0,0 +1,465 @@
+#include "tcp_server.hh"
+#include "deadline.hh"
+#include "http_parser.hh"
+#include "log/logging.hh"
+#include <array>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#if defined(__linux__)
+#   include <sys/socket.h>
+#endif
+
+namespace comm {
+
+// The state that the server shares with the coroutines of its acceptors and connections,
+// so it stays valid until the last of them is done, even if the server is gone by then
+struct server_state {
+    struct shard {
+        // owned by the accept loop, so it is gone with its context even if the loop never finished
+        tcp::acceptor* acceptor{nullptr};
+        // only used from the thread of the context
+        std::unordered_set<server_connection*> connections;
+    };
+
+    server_options options;
+    connection_handler handler;
+    std::vector<std::unique_ptr<shard>> shards;     // one for each context of the runtime
+    std::atomic<bool> draining{false};
+    std::atomic<std::size_t> active{0};
+    std::atomic<std::uint64_t> accepted{0};
+    std::atomic<std::uint64_t> messages{0};
+    std::atomic<std::uint64_t> rejected{0};
+};
+
+namespace {
+
+using clock = request_deadlines::clock;
+
+constexpr std::size_t READ_SIZE{16 * 1'024};
+constexpr std::string_view END_OF_HEAD{"\r\n\r\n"};
+
+// on Linux the kernel spreads the connections between the sockets that share a port,
+// on other systems the last socket to bind gets all of them
+#if defined(__linux__) && defined(SO_REUSEPORT)
+constexpr bool BALANCED_REUSE_PORT{true};
+using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#else
+constexpr bool BALANCED_REUSE_PORT{false};
+#endif
+
+auto reason(unsigned int status) -> std::string_view {
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 413: return "Content Too Large";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+auto session(std::shared_ptr<server_state> state, std::size_t shard, tcp::socket socket) -> asio::awaitable<void> {
+    server_connection connection{std::move(socket), state, shard};
+    try {
+        co_await state->handler(connection);
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "connection handler failed: " << e.what() << ENDL;
+    }
+    connection.close();
+}
+
+// With an acceptor for each context the connection stays on the context of the acceptor,
+// otherwise the runtime selects the context for it
+auto accept_loop(std::shared_ptr<server_state> state, runtime& workers, std::size_t index, bool per_context, tcp::acceptor acceptor) -> asio::awaitable<void> {
+    struct listening {
+        server_state::shard& shard;
+        ~listening() {
+            shard.acceptor = nullptr;
+        }
+    } guard{*state->shards[index]};
+    guard.shard.acceptor = &acceptor;
+    while (true) {
+        const auto target{per_context ? index : workers.next()};
+        tcp::socket socket{workers.context(target)};
+        auto [e] = co_await acceptor.async_accept(socket, asio::as_tuple(asio::use_awaitable));
+        if (e) {
+            if (e == asio::error::operation_aborted || !acceptor.is_open()) {
+                co_return;
+            }
+            // most likely we are out of file descriptors, so give the connections a chance to close
+            LOG(WARNING) << "failed to accept a connection: " << e.message() << ENDL;
+            asio::steady_timer pause{acceptor.get_executor(), std::chrono::milliseconds{10}};
+            co_await pause.async_wait(asio::as_tuple(asio::use_awaitable));
+            continue;
+        }
+        state->accepted.fetch_add(1, std::memory_order_relaxed);
+        tune_socket(socket, state->options.tuning);
+        workers.spawn(target, session(state, target, std::move(socket)), asio::detached);
+    }
+}
+
+auto open_acceptor(asio::io_context& context, const tcp::endpoint& endpoint, bool shared_port, const socket_tuning& tuning) -> std::optional<tcp::acceptor> {
+    tcp::acceptor acceptor{context};
+    boost::system::error_code ec;
+    acceptor.open(endpoint.protocol(), ec);
+    if (!ec) {
+        acceptor.set_option(asio::socket_base::reuse_address{true}, ec);
+    }
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    if (!ec && shared_port) {
+        acceptor.set_option(reuse_port{true}, ec);
+    }
+#else
+    (void)shared_port;
+#endif
+    if (!ec) {
+        // the accepted connections inherit the buffer sizes, and the window scale that they offer
+        size_socket_buffers(acceptor, tuning);
+        acceptor.bind(endpoint, ec);
+    }
+    if (!ec) {
+        acceptor.listen(asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        LOG(ERROR) << "failed to listen on " << endpoint << ": " << ec.message() << ENDL;
+        return std::nullopt;
+    }
+    return acceptor;
+}
+
+}		// end of local namespace
+
+auto operator << (std::ostream& os, const server_stats& stats) -> std::ostream& {
+    return os << "accepted: " << stats.accepted << ", messages: " << stats.messages
+        << ", rejected: " << stats.rejected << ", active: " << stats.active;
+}
+
+auto server_request::header(std::string_view name) const -> std::optional<std::string_view> {
+    for (const auto& f : fields) {
+        if (iequals(f.name.view(head), name)) {
+            return f.value.view(head);
+        }
+    }
+    return std::nullopt;
+}
+
+server_connection::server_connection(tcp::socket socket, std::shared_ptr<server_state> state, std::size_t shard) :
+        socket_{std::move(socket)}, state_{std::move(state)}, shard_{shard}, buffer_{READ_SIZE} {
+    state_->shards[shard_]->connections.insert(this);
+    state_->active.fetch_add(1, std::memory_order_relaxed);
+}
+
+server_connection::~server_connection() {
+    state_->shards[shard_]->connections.erase(this);
+    state_->active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+auto server_connection::draining() const -> bool {
+    return state_->draining.load(std::memory_order_relaxed);
+}
+
+auto server_connection::close() -> void {
+    boost::system::error_code ec;
+    socket_.shutdown(tcp::socket::shutdown_both, ec);
+    socket_.close(ec);
+}
+
+auto server_connection::fill() -> asio::awaitable<bool> {
+    auto& data{buffer_.get()};
+    const auto used{data.size()};
+    idle_ = used == 0;
+    data.resize(used + READ_SIZE);
+    const auto result = co_await with_deadline(
+            socket_.async_read_some(asio::buffer(data.data() + used, READ_SIZE), asio::as_tuple(asio::use_awaitable)),
+            clock::now() + state_->options.idle_timeout
+    );
+    idle_ = false;
+    const auto [e, n] = result.value_or(std::tuple{boost::system::error_code{asio::error::timed_out}, std::size_t{0}});
+    data.resize(used + n);
+    if (e) {
+        if (e != asio::error::eof && e != asio::error::operation_aborted && e != asio::error::timed_out) {
+            LOG(WARNING) << "failed to read from the connection: " << e.message() << ENDL;
+        }
+        close();
+        co_return false;
+    }
+    co_return true;
+}
+
+auto server_connection::read_until(std::string_view delimiter, std::size_t limit, unsigned int status) -> asio::awaitable<std::size_t> {
+    auto& data{buffer_.get()};
+    // drop the message that was returned last, what follows it was sent ahead by the client
+    data.erase(0, std::exchange(consumed_, 0));
+    if (draining() || delimiter.empty()) {
+        co_return 0;
+    }
+    std::size_t from{0};
+    while (true) {
+        if (const auto at = std::string_view{data}.find(delimiter, from); at != std::string_view::npos) {
+            if (at + delimiter.size() > limit) {
+                break;
+            }
+            co_return at + delimiter.size();
+        }
+        if (data.size() > limit) {
+            break;
+        }
+        // the delimiter may start at the end of what we have
+        from = data.size() >= delimiter.size() ? data.size() - delimiter.size() + 1 : 0;
+        if (!co_await fill()) {
+            co_return 0;
+        }
+    }
+    co_await reject(status);
+    co_return 0;
+}
+
+auto server_connection::read_message(std::string_view delimiter) -> asio::awaitable<std::optional<std::string_view>> {
+    const auto size{co_await read_until(delimiter, state_->options.max_message, 0)};
+    if (size == 0) {
+        co_return std::nullopt;
+    }
+    consumed_ = size;
+    state_->messages.fetch_add(1, std::memory_order_relaxed);
+    co_return std::string_view{buffer_.get()}.substr(0, size);
+}
+
+auto server_connection::read_request() -> asio::awaitable<std::optional<server_request>> {
+    const auto head_size{co_await read_until(END_OF_HEAD, std::min(request_parser::MAX_HEADER_SIZE, state_->options.max_message), 431)};
+    if (head_size == 0) {
+        co_return std::nullopt;
+    }
+    auto& data{buffer_.get()};
+    // the views into the buffer are taken again once we have the body, since reading it may move the buffer
+    std::string_view head{data.data(), head_size};
+    parser_.reset();
+    if (parser_.parse(head) != request_parser::result::done) {
+        co_await reject(400);
+        co_return std::nullopt;
+    }
+    if (parser_.framing() == body_framing::chunked) {
+        // we only support bodies with Content-Length
+        co_await reject(501);
+        co_return std::nullopt;
+    }
+    const auto length{parser_.framing() == body_framing::content_length ? parser_.content_length() : 0};
+    if (length > state_->options.max_message - head_size) {
+        co_await reject(413);
+        co_return std::nullopt;
+    }
+    const auto size{head_size + static_cast<std::size_t>(length)};
+    if (data.size() < size) {
+        if (const auto expect = parser_.find(head, "Expect"); expect && iequals(*expect, "100-continue")) {
+            if (!co_await send("HTTP/1.1 100 Continue\r\n\r\n")) {
+                co_return std::nullopt;
+            }
+        }
+        while (data.size() < size) {
+            if (!co_await fill()) {
+                co_return std::nullopt;
+            }
+        }
+    }
+    consumed_ = size;
+    state_->messages.fetch_add(1, std::memory_order_relaxed);
+    head = std::string_view{data.data(), head_size};
+    server_request request;
+    request.method = parser_.method(head);
+    request.target = parser_.target(head);
+    request.head = head;
+    request.body = std::string_view{data}.substr(head_size, static_cast<std::size_t>(length));
+    request.fields = parser_.headers();
+    request.version_minor = parser_.version_minor();
+    request.keep_alive = parser_.keep_alive();
+    co_return request;
+}
+
+auto server_connection::write(std::span<const asio::const_buffer> data) -> asio::awaitable<bool> {
+    const auto result = co_await with_deadline(
+            asio::async_write(socket_, data, asio::as_tuple(asio::use_awaitable)),
+            clock::now() + state_->options.idle_timeout
+    );
+    if (!result || std::get<0>(*result)) {
+        if (result && std::get<0>(*result) != asio::error::operation_aborted) {
+            LOG(WARNING) << "failed to send to the connection: " << std::get<0>(*result).message() << ENDL;
+        }
+        close();
+        co_return false;
+    }
+    co_return true;
+}
+
+auto server_connection::send(std::string_view data) -> asio::awaitable<bool> {
+    const std::array<asio::const_buffer, 1> buffers{asio::buffer(data)};
+    co_return co_await write(buffers);
+}
+
+auto server_connection::send(const http_reply& reply, bool keep_alive) -> asio::awaitable<bool> {
+    keep_alive = keep_alive && !draining();
+    // no body at all, for 1xx, 204 and 304
+    const auto no_body{reply.status < 200 || reply.status == 204 || reply.status == 304};
+    std::string head{"HTTP/1.1 "};
+    head.append(std::to_string(reply.status)).append(" ").append(reason(reply.status)).append("\r\n");
+    if (!no_body) {
+        if (!reply.content_type.empty()) {
+            head.append("Content-Type: ").append(reply.content_type).append("\r\n");
+        }
+        head.append("Content-Length: ").append(std::to_string(reply.body.size())).append("\r\n");
+    }
+    for (const auto& [name, value] : reply.headers) {
+        head.append(name).append(": ").append(value).append("\r\n");
+    }
+    head.append(keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    const std::array<asio::const_buffer, 2> buffers{asio::buffer(head), asio::buffer(no_body ? std::string_view{} : std::string_view{reply.body})};
+    if (!co_await write(buffers)) {
+        co_return false;
+    }
+    if (!keep_alive) {
+        boost::system::error_code ec;
+        socket_.shutdown(tcp::socket::shutdown_send, ec);
+    }
+    co_return true;
+}
+
+auto server_connection::reject(unsigned int status) -> asio::awaitable<void> {
+    state_->rejected.fetch_add(1, std::memory_order_relaxed);
+    if (status != 0) {
+        http_reply reply;
+        reply.status = status;
+        co_await send(reply, false);
+    }
+    close();
+}
+
+auto serve_messages(std::string delimiter, message_handler handler) -> connection_handler {
+    return [delimiter = std::move(delimiter), handler = std::move(handler)](server_connection& connection) -> asio::awaitable<void> {
+        while (const auto message = co_await connection.read_message(delimiter)) {
+            const auto answer{co_await handler(*message)};
+            if (!co_await connection.send(answer)) {
+                co_return;
+            }
+        }
+    };
+}
+
+auto serve_http(http_handler handler) -> connection_handler {
+    return [handler = std::move(handler)](server_connection& connection) -> asio::awaitable<void> {
+        while (const auto request = co_await connection.read_request()) {
+            const auto reply{co_await handler(*request)};
+            if (!co_await connection.send(reply, request->keep_alive) || !request->keep_alive || connection.draining()) {
+                co_return;
+            }
+        }
+    };
+}
+
+tcp_server::tcp_server(runtime& workers, server_options options) :
+        runtime_{workers}, options_{std::move(options)}, state_{std::make_shared<server_state>()} {
+    state_->options = options_;
+    for (std::size_t i = 0; i < runtime_.size(); ++i) {
+        state_->shards.push_back(std::make_unique<server_state::shard>());
+    }
+}
+
+tcp_server::~tcp_server() {
+    stop();
+}
+
+auto tcp_server::start(connection_handler handler) -> bool {
+    boost::system::error_code ec;
+    const auto address{asio::ip::make_address(options_.address, ec)};
+    if (ec) {
+        LOG(ERROR) << "invalid address to listen on '" << options_.address << "': " << ec.message() << ENDL;
+        return false;
+    }
+    state_->handler = std::move(handler);
+    const auto per_context{options_.reuse_port && BALANCED_REUSE_PORT && runtime_.size() > 1};
+    const auto count{per_context ? runtime_.size() : 1};
+    tcp::endpoint endpoint{address, options_.port};
+    std::vector<tcp::acceptor> acceptors;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto acceptor{open_acceptor(runtime_.context(i), endpoint, per_context, options_.tuning)};
+        if (!acceptor) {
+            return false;
+        }
+        // when the system picked the port, the rest of the acceptors share it with the first
+        endpoint.port(acceptor->local_endpoint().port());
+        acceptors.push_back(std::move(*acceptor));
+    }
+    port_ = endpoint.port();
+    for (std::size_t i = 0; i < count; ++i) {
+        runtime_.spawn(i, accept_loop(state_, runtime_, i, per_context, std::move(acceptors[i])), asio::detached);
+    }
+    LOG(INFO) << "listening on " << endpoint << " with " << count << " acceptors" << ENDL;
+    return true;
+}
+
+auto tcp_server::drain(std::chrono::milliseconds timeout) -> bool {
+    state_->draining.store(true, std::memory_order_relaxed);
+    // each shard is only touched from the thread of its context
+    for (std::size_t i = 0; i < state_->shards.size(); ++i) {
+        asio::post(runtime_.context(i), [state = state_, i]() {
+            auto& s{*state->shards[i]};
+            if (s.acceptor) {
+                boost::system::error_code ec;
+                s.acceptor->close(ec);
+            }
+            for (auto c : s.connections) {
+                if (c->idle()) {
+                    c->close();
+                }
+            }
+        });
+    }
+    const auto deadline{std::chrono::steady_clock::now() + timeout};
+    while (state_->active.load(std::memory_order_relaxed) > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    const auto drained{state_->active.load(std::memory_order_relaxed) == 0};
+    if (!drained) {
+        LOG(WARNING) << "server drain timeout, closing " << state_->active.load(std::memory_order_relaxed) << " connections" << ENDL;
+        stop();
+    }
+    return drained;
+}
+
+auto tcp_server::stop() -> void {
+    state_->draining.store(true, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < state_->shards.size(); ++i) {
+        asio::post(runtime_.context(i), [state = state_, i]() {
+            auto& s{*state->shards[i]};
+            if (s.acceptor) {
+                boost::system::error_code ec;
+                s.acceptor->close(ec);
+            }
+            for (auto c : s.connections) {
+                c->close();
+            }
+        });
+    }
+}
+
+auto tcp_server::stats() const -> server_stats {
+    server_stats stats;
+    stats.accepted = state_->accepted.load(std::memory_order_relaxed);
+    stats.messages = state_->messages.load(std::memory_order_relaxed);
+    stats.rejected = state_->rejected.load(std::memory_order_relaxed);
+    stats.active = state_->active.load(std::memory_order_relaxed);
+    return stats;
+}
+
+}	// end of namespace comm
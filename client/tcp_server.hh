@@ -0,0 +1,183 @@
+#pragma once
+#include "network_fwd.hh"
+#include "buffer_pool.hh"
+#include "http_parser.hh"
+#include "runtime.hh"
+#include "socket_tuning.hh"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace comm {
+
+// The server side of the protocols that the clients speak: messages that end with a delimiter
+// (as with async_tcp_read_write) and HTTP/1.1 requests with a Content-Length body.
+// The connections are served by coroutines on the contexts of a runtime, that may be
+// shared with the clients, and each connection stays on the context that it was accepted on.
+
+struct server_options {
+    // where to listen, with port 0 the system picks the port (see tcp_server::port)
+    std::string address{"0.0.0.0"};
+    unsigned short port{0};
+    // On Linux, an acceptor for each context of the runtime, all on the same port with SO_REUSEPORT,
+    // so the kernel spreads the new connections between the contexts. Otherwise a single acceptor
+    // hands the connections to the contexts by the dispatch policy of the runtime
+    bool reuse_port{true};
+    // the buffer sizes are set on the acceptors, the rest on each connection that is accepted
+    socket_tuning tuning;
+    // a connection that does not send anything for this long is closed,
+    // this is also the limit for sending a response to a client that does not read it
+    std::chrono::milliseconds idle_timeout{std::chrono::seconds{30}};
+    // the largest message, or request with its headers and body, a larger one closes the connection
+    std::size_t max_message{1'024 * 1'024};
+};
+
+struct server_stats {
+    std::uint64_t accepted{0};      // connections
+    std::uint64_t messages{0};      // messages and requests that were read
+    std::uint64_t rejected{0};      // connections closed for a malformed or too large message
+    std::size_t active{0};          // connections open now
+};
+
+auto operator << (std::ostream& os, const server_stats& stats) -> std::ostream&;
+
+// An HTTP request as it was read, all the views point into the buffer of the connection
+// and are only valid until the next read
+struct server_request {
+    std::string_view method;
+    std::string_view target;
+    std::string_view head;          // the request line and the headers
+    std::string_view body;
+    std::span<const header_field> fields;   // the headers, as offsets into head
+    unsigned int version_minor{1};
+    bool keep_alive{true};
+
+    // value of the first header with this name (case insensitive)
+    auto header(std::string_view name) const -> std::optional<std::string_view>;
+};
+
+struct http_reply {
+    unsigned int status{200};
+    std::string body;
+    std::string content_type{"text/plain"};
+    // more headers, Content-Length and Connection are added by the server
+    std::vector<std::pair<std::string, std::string>> headers;
+};
+
+struct server_state;
+
+// One accepted connection, as it is given to the handler. The reads return nullopt once
+// the connection was closed, was idle for too long, or the server started to drain,
+// and then the handler should return.
+class server_connection {
+public:
+    server_connection(tcp::socket socket, std::shared_ptr<server_state> state, std::size_t shard);
+    server_connection(const server_connection&) = delete;
+    auto operator = (const server_connection&) -> server_connection& = delete;
+    ~server_connection();
+
+    // the next message, up to and including the delimiter. The view points into the buffer
+    // of the connection, and is valid until the next read
+    auto read_message(std::string_view delimiter) -> asio::awaitable<std::optional<std::string_view>>;
+
+    // The next request with its body. A request that is not valid is answered with an error
+    // and the connection is closed. Requests with Expect: 100-continue are told to continue
+    auto read_request() -> asio::awaitable<std::optional<server_request>>;
+
+    // send all the data, false if the connection failed
+    auto send(std::string_view data) -> asio::awaitable<bool>;
+
+    // send the response, once the server is draining the client is told that the connection is closed
+    auto send(const http_reply& reply, bool keep_alive) -> asio::awaitable<bool>;
+
+    // true once the server was asked to stop, the handler should not wait for more messages
+    auto draining() const -> bool;
+
+    // waiting for the next message, without a part of one in the buffer
+    auto idle() const -> bool {
+        return idle_;
+    }
+
+    auto close() -> void;
+
+    auto socket() -> tcp::socket& {
+        return socket_;
+    }
+
+private:
+    // read more into the buffer, limited by the idle timeout
+    auto fill() -> asio::awaitable<bool>;
+    // the size of the next message that ends with the delimiter, 0 if there is none. When there is
+    // more than limit without the delimiter, the connection is rejected (with an HTTP status unless it is 0)
+    auto read_until(std::string_view delimiter, std::size_t limit, unsigned int status) -> asio::awaitable<std::size_t>;
+    auto write(std::span<const asio::const_buffer> data) -> asio::awaitable<bool>;
+    auto reject(unsigned int status) -> asio::awaitable<void>;
+
+    tcp::socket socket_;
+    std::shared_ptr<server_state> state_;
+    std::size_t shard_;
+    pooled_buffer buffer_;
+    request_parser parser_;         // of the last request, the fields of the request point into it
+    std::size_t consumed_{0};       // the size of the message that was returned last
+    bool idle_{false};
+};
+
+// Called for each connection, on the context that it was accepted on. The connection is closed
+// once the handler returns
+using connection_handler = std::function<asio::awaitable<void>(server_connection&)>;
+// answer a message, the answer is sent as is
+using message_handler = std::function<asio::awaitable<std::string>(std::string_view)>;
+using http_handler = std::function<asio::awaitable<http_reply>(const server_request&)>;
+
+// a connection handler that answers each message until the connection is closed
+auto serve_messages(std::string delimiter, message_handler handler) -> connection_handler;
+
+// a connection handler that answers each request, as long as the client keeps the connection alive
+auto serve_http(http_handler handler) -> connection_handler;
+
+// Accept connections and run the handler for each of them. The server must be drained (or stopped)
+// before the runtime, since its acceptors keep the contexts busy. All the functions here are called
+// from threads that are not running the contexts of the runtime.
+class tcp_server {
+public:
+    explicit tcp_server(runtime& workers, server_options options = {});
+    tcp_server(const tcp_server&) = delete;
+    auto operator = (const tcp_server&) -> tcp_server& = delete;
+    // stop the server without waiting for the connections
+    ~tcp_server();
+
+    // listen and start accepting, false if we failed to listen
+    auto start(connection_handler handler) -> bool;
+
+    // the port that we listen on
+    auto port() const -> unsigned short {
+        return port_;
+    }
+
+    // Stop accepting, close the connections that wait for their next message, and wait for the
+    // rest to finish with what they are doing. If they are not done by the timeout they are closed,
+    // and this returns false
+    auto drain(std::chrono::milliseconds timeout = std::chrono::seconds{30}) -> bool;
+
+    // stop accepting and close all the connections now
+    auto stop() -> void;
+
+    auto stats() const -> server_stats;
+
+private:
+    runtime& runtime_;
+    server_options options_;
+    std::shared_ptr<server_state> state_;
+    unsigned short port_{0};
+};
+
+}	// end of namespace comm
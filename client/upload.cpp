@@ -0,0 +1,253 @@
+#include "upload.hh"
+#include "buffer_pool.hh"
+#include "http_reader.hh"
+#include "metrics.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string_view>
+
+namespace comm {
+namespace {
+
+using namespace std::string_view_literals;
+using clock = request_deadlines::clock;
+
+auto write_all(tcp::socket& socket, std::span<const asio::const_buffer> buffers) -> asio::awaitable<bool> {
+    auto [e, n] = co_await asio::async_write(socket, buffers, asio::as_tuple(asio::use_awaitable));
+    if (e) {
+        LOG(ERROR) << "error: failed to send upload: " << e.message() << ENDL;
+        co_return false;
+    }
+    metrics::add(metrics::counter::bytes_sent, n);
+    co_return true;
+}
+
+// Send the body part by part, each part must be sent within DEFAULT_IO_TIMEOUT.
+// With chunked encoding each part is a chunk, its size line and the data go out in a single gather write
+auto send_body(tcp::socket& socket, upload_body& body, const upload_options& options, clock::time_point end) -> asio::awaitable<bool> {
+    const auto chunked{!body.length.has_value()};
+    pooled_buffer memory{std::max<std::size_t>(options.chunk_size, 1)};
+    auto& buffer{memory.get()};
+    buffer.resize(std::max<std::size_t>(options.chunk_size, 1));
+    std::array<char, 20> size_line{};
+    std::uint64_t sent{0};
+
+    auto send = [&](std::span<const asio::const_buffer> parts) -> asio::awaitable<bool> {
+        const auto ok = co_await with_deadline(write_all(socket, parts), std::min(clock::now() + DEFAULT_IO_TIMEOUT, end));
+        if (!ok) {
+            LOG(WARNING) << "timeout while sending the upload body" << ENDL;
+        }
+        co_return ok.value_or(false);
+    };
+
+    while (true) {
+        const auto n = co_await body.source(std::as_writable_bytes(std::span{buffer}));
+        if (!n) {
+            LOG(ERROR) << "error: failed to read the body of the upload" << ENDL;
+            co_return false;
+        }
+        if (*n == 0) {
+            break;
+        }
+        if (!chunked && sent + *n > *body.length) {
+            LOG(ERROR) << "error: the upload body is longer than its length " << *body.length << ENDL;
+            co_return false;
+        }
+        auto line_end{size_line.data()};
+        if (chunked) {
+            line_end = std::to_chars(size_line.data(), size_line.data() + size_line.size() - 2, *n, 16).ptr;
+            *line_end++ = '\r';
+            *line_end++ = '\n';
+        }
+        const std::array<asio::const_buffer, 3> parts{
+            asio::buffer(size_line.data(), static_cast<std::size_t>(line_end - size_line.data())),
+            asio::buffer(buffer.data(), *n),
+            chunked ? asio::buffer("\r\n"sv) : asio::const_buffer{}
+        };
+        if (!co_await send(parts)) {
+            co_return false;
+        }
+        sent += *n;
+    }
+
+    if (chunked) {
+        const std::array<asio::const_buffer, 1> last{asio::buffer("0\r\n\r\n"sv)};
+        co_return co_await send(last);
+    }
+    if (sent != *body.length) {
+        LOG(ERROR) << "error: the upload body ended after " << sent << " bytes, expected " << *body.length << ENDL;
+        co_return false;
+    }
+    co_return true;
+}
+
+// Where the body comes from. As with the file_sink of the downloads, when asio has async files
+// (with io_uring on Linux, or on Windows) the reads are asynchronous, otherwise they are blocking
+class file_source {
+public:
+    explicit file_source([[maybe_unused]] const asio::any_io_executor& executor)
+#if defined(BOOST_ASIO_HAS_FILE)
+        : file_{executor}
+#endif
+    {
+    }
+
+    file_source(const file_source&) = delete;
+    auto operator = (const file_source&) -> file_source& = delete;
+
+    auto open(const std::string& path) -> bool {
+#if defined(BOOST_ASIO_HAS_FILE)
+        boost::system::error_code ec;
+        file_.open(path, asio::file_base::read_only, ec);
+        if (ec) {
+            LOG(ERROR) << "error: failed to open " << path << " for upload: " << ec.message() << ENDL;
+            return false;
+        }
+#else
+        file_.open(path, std::ios::binary);
+        if (!file_) {
+            LOG(ERROR) << "error: failed to open " << path << " for upload" << ENDL;
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    // the number of bytes that were read into the buffer, 0 at the end of the file
+    auto read(std::span<std::byte> into) -> asio::awaitable<std::optional<std::size_t>> {
+#if defined(BOOST_ASIO_HAS_FILE)
+        auto [e, n] = co_await asio::async_read(file_, asio::buffer(into.data(), into.size()), asio::as_tuple(asio::use_awaitable));
+        if (e && e != asio::error::eof) {
+            LOG(ERROR) << "error: failed to read the upload from the file: " << e.message() << ENDL;
+            co_return std::nullopt;
+        }
+        co_return n;
+#else
+        file_.read(reinterpret_cast<char*>(into.data()), static_cast<std::streamsize>(into.size()));
+        if (file_.bad()) {
+            co_return std::nullopt;
+        }
+        co_return static_cast<std::size_t>(file_.gcount());
+#endif
+    }
+
+private:
+#if defined(BOOST_ASIO_HAS_FILE)
+    asio::stream_file file_;
+#else
+    std::ifstream file_;
+#endif
+};
+
+}		// end of local namespace
+
+auto file_body(const asio::any_io_executor& executor, const std::string& path) -> std::optional<upload_body> {
+    auto file{std::make_shared<file_source>(executor)};
+    if (!file->open(path)) {
+        return std::nullopt;
+    }
+    upload_body body;
+    std::error_code ec;
+    if (const auto size = std::filesystem::file_size(path, ec); !ec) {
+        body.length = size;
+    }
+    body.source = [file](std::span<std::byte> into) -> asio::awaitable<std::optional<std::size_t>> {
+        co_return co_await file->read(into);
+    };
+    return body;
+}
+
+auto async_http_upload(tcp::socket& with_socket, const std::string& host, const std::string& resource,
+                       upload_body body, upload_options options) -> asio::awaitable<upload_result> {
+    const auto end{clock::now() + options.deadlines.total};
+    metrics::add(metrics::counter::requests);
+    upload_result result;
+    auto failed = [&](const char* what) {
+        LOG(WARNING) << "upload to " << host << resource << " failed while " << what << ENDL;
+        boost::system::error_code ec;
+        with_socket.close(ec);
+        metrics::add(metrics::counter::failures);
+        result.status = 0;
+        return result;
+    };
+
+    try {
+        std::array<char, 24> length{};
+        const auto length_end{body.length ? std::to_chars(length.data(), length.data() + length.size(), *body.length).ptr : length.data()};
+        const std::array<asio::const_buffer, 10> head{
+            asio::buffer("POST "sv), asio::buffer(resource),
+            asio::buffer(" HTTP/1.1\r\nHost: "sv), asio::buffer(host),
+            asio::buffer("\r\nAccept: */*\r\nContent-Type: "sv), asio::buffer(body.content_type),
+            asio::buffer(body.length ? "\r\nContent-Length: "sv : "\r\nTransfer-Encoding: chunked"sv),
+            asio::buffer(length.data(), static_cast<std::size_t>(length_end - length.data())),
+            asio::buffer(options.expect_continue ? "\r\nExpect: 100-continue"sv : ""sv),
+            asio::buffer(options.keep_alive ? "\r\nConnection: keep-alive\r\n\r\n"sv : "\r\nConnection: close\r\n\r\n"sv)
+        };
+        // as with the other requests, the headers are sent within the first byte limit
+        if (!(co_await with_deadline(write_all(with_socket, head), std::min(clock::now() + options.deadlines.first_byte, end))).value_or(false)) {
+            co_return failed("sending the request headers");
+        }
+
+        response_reader reader(with_socket);
+        auto read_head = [&]() -> asio::awaitable<bool> {
+            co_return (co_await with_deadline(reader.read_head(), std::min(clock::now() + options.deadlines.first_byte, end))).value_or(false);
+        };
+
+        // with 100-continue the server either accepts the request, or rejects it with its final response
+        bool rejected{false};
+        if (options.expect_continue) {
+            const auto answered = co_await with_deadline(wait_readable(with_socket), std::min(clock::now() + options.continue_timeout, end));
+            if (answered.value_or(false)) {
+                if (!co_await read_head()) {
+                    co_return failed("waiting for 100 Continue");
+                }
+                if (reader.interim()) {
+                    reader.next_response();
+                } else {
+                    rejected = true;
+                }
+            }
+        }
+
+        if (!rejected) {
+            metrics::stage_timer sending{metrics::stage::send};
+            if (!co_await send_body(with_socket, body, options, end)) {
+                sending.cancel();
+                co_return failed("sending the body");
+            }
+            sending.stop();
+            result.body_sent = true;
+            do {
+                if (reader.interim()) {
+                    reader.next_response();
+                }
+                if (!co_await read_head()) {
+                    co_return failed("waiting for the response headers");
+                }
+            } while (reader.interim());
+        }
+
+        auto response = co_await with_deadline(reader.read_body(), end);
+        if (!response || !*response) {
+            co_return failed("reading the response body");
+        }
+        result.status = reader.status_code();
+        result.response = std::move(**response);
+        // after a rejection the server did not read the body we announced, so the connection cannot be reused
+        if (!(options.keep_alive && result.body_sent && reader.reusable())) {
+            boost::system::error_code ec;
+            with_socket.close(ec);
+        }
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "error: while uploading to " << host << resource << ": " << e.what() << ENDL;
+        co_return failed("uploading");
+    }
+    co_return result;
+}
+
+}	// end of namespace comm
@@ -0,0 +1,55 @@
+#pragma once
+#include "network_fwd.hh"
+#include "deadline.hh"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+
+namespace comm {
+
+// Write the next part of the request body into the buffer and return the number of bytes
+// that were written, 0 at the end of the body, or nullopt if the body cannot be produced
+using body_source = std::function<asio::awaitable<std::optional<std::size_t>>(std::span<std::byte>)>;
+
+struct upload_body {
+    body_source source;
+    // when the size is known the body is sent with Content-Length, otherwise it is sent chunked
+    std::optional<std::uint64_t> length;
+    std::string content_type{"application/octet-stream"};
+};
+
+// Send the content of the file, it is read part by part as it is sent. The reads are made
+// on executor, and they are asynchronous when asio has async files, blocking otherwise
+auto file_body(const asio::any_io_executor& executor, const std::string& path) -> std::optional<upload_body>;
+
+struct upload_options {
+    // total is the limit for the whole upload, and each part of the body must be sent within DEFAULT_IO_TIMEOUT,
+    // so a stalled upload is stopped long before that
+    request_deadlines deadlines{.total = std::chrono::hours{1}};
+    // send "Expect: 100-continue" and wait for the server to accept the request before sending the body
+    bool expect_continue{true};
+    // servers that do not support it never answer, in which case the body is sent after this time
+    std::chrono::milliseconds continue_timeout{std::chrono::seconds{1}};
+    // the size of each part of the body
+    std::size_t chunk_size{64 * 1'024};
+    bool keep_alive{false};
+};
+
+struct upload_result {
+    unsigned int status{0};     // 0 on failure
+    bool body_sent{false};      // false if the server answered before we sent the body
+    std::string response;       // the body of the response
+};
+
+// Send a POST request with a body that is streamed from the source, so only a single part of
+// it is in memory at any time. With expect_continue, if the server rejects the request (for
+// example with 401 or 413) the body is not sent at all. On failure, or if the server did not
+// read the body, the socket is closed
+auto async_http_upload(tcp::socket& with_socket, const std::string& host, const std::string& resource,
+                       upload_body body, upload_options options = {}) -> asio::awaitable<upload_result>;
+
+}	// end of namespace comm
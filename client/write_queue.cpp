@@ -0,0 +1,136 @@
+#include "write_queue.hh"
+#include "log/logging.hh"
+#include <algorithm>
+#include <array>
+
+namespace comm {
+
+// The caller that finds no write in progress is the one that writes: it takes
+// everything that was queued so far, its own message included, and sends it in
+// one write. Messages queued during this write are sent by the first of them,
+// which is woken up with the lead flag set once the write is done.
+struct write_queue::entry {
+    entry(const asio::any_io_executor& executor, std::span<const asio::const_buffer> message) :
+            parts{message.begin(), message.end()}, size{asio::buffer_size(message)},
+            signal{executor, asio::steady_timer::time_point::max()} {
+    }
+
+    std::vector<asio::const_buffer> parts;
+    std::size_t size;
+    std::size_t sent{0};
+    bool done{false};
+    bool lead{false};
+    bool batched{false};    // taken for a write, and no longer in the queue
+    asio::steady_timer signal;
+};
+
+write_queue::write_queue(tcp::socket& socket) : socket_{socket} {
+}
+
+auto write_queue::send(std::string_view header, std::string_view body) -> asio::awaitable<std::size_t> {
+  const std::array<asio::const_buffer, 2> message{
+      asio::buffer(header.data(), header.size()), asio::buffer(body.data(), body.size())
+  };
+  co_return co_await send(std::span<const asio::const_buffer>{message.data(), body.empty() ? 1u : 2u});
+}
+
+auto write_queue::send(std::span<const asio::const_buffer> message) -> asio::awaitable<std::size_t> {
+  if (!socket_.is_open()) {
+    LOG(WARNING) << "trying to send over a closed connection" << ENDL;
+    co_return 0;
+  }
+  auto e = std::make_shared<entry>(socket_.get_executor(), message);
+  if (e->size == 0) {
+    co_return 0;
+  }
+  queue_.push_back(e);
+  if (!writing_) {
+    writing_ = true;
+    e->lead = true;
+  }
+  // the coroutine may be cancelled while it waits, or destroyed
+  struct leave_guard {
+    write_queue& queue;
+    const std::shared_ptr<entry>& e;
+    ~leave_guard() {
+      queue.leave(e);
+    }
+  } guard{*this, e};
+  // The buffers of a message are not copied, so once it was taken for a write its sender stays
+  // until the write is done, even if it was cancelled. Until then a cancelled sender drops its message
+  const auto throws{co_await asio::this_coro::throw_if_cancelled()};
+  co_await asio::this_coro::throw_if_cancelled(false);
+  while (!e->done) {
+    const auto cancelled{(co_await asio::this_coro::cancellation_state).cancelled() != asio::cancellation_type::none};
+    if (cancelled && !e->batched) {
+      break;
+    }
+    if (e->lead) {
+      co_await flush();
+    } else {
+      co_await e->signal.async_wait(asio::as_tuple(asio::use_awaitable));
+    }
+  }
+  co_await asio::this_coro::throw_if_cancelled(throws);
+  if (!e->done) {
+    if (throws) {
+      throw boost::system::system_error{asio::error::operation_aborted};
+    }
+    co_return 0;
+  }
+  co_return e->sent;
+}
+
+auto write_queue::leave(const std::shared_ptr<entry>& e) -> void {
+  if (e->done || e->batched) {
+    return;
+  }
+  if (const auto i = std::find(queue_.begin(), queue_.end(), e); i != queue_.end()) {
+    queue_.erase(i);
+  }
+  if (e->lead) {
+    // it was told to write the next batch, someone else has to
+    next_lead();
+  }
+}
+
+auto write_queue::next_lead() -> void {
+  if (queue_.empty()) {
+    writing_ = false;
+  } else {
+    queue_.front()->lead = true;
+    queue_.front()->signal.cancel();
+  }
+}
+
+auto write_queue::flush() -> asio::awaitable<void> {
+  auto batch{std::move(queue_)};
+  queue_.clear();
+  buffers_.clear();
+  for (const auto& e : batch) {
+    e->batched = true;
+    buffers_.insert(buffers_.end(), e->parts.begin(), e->parts.end());
+  }
+  ++writes_;
+  messages_ += batch.size();
+
+  // the write carries the messages of the others as well, so cancelling the lead must not cut it short
+  auto [ec, written] = co_await asio::async_write(socket_, buffers_,
+          asio::bind_cancellation_slot(asio::cancellation_slot{}, asio::as_tuple(asio::use_awaitable)));
+  if (ec) {
+    LOG(ERROR) << "failed to send " << batch.size() << " queued messages: " << ec.message() << ENDL;
+    boost::system::error_code ignore;
+    socket_.close(ignore);
+    // messages that were queued during the write would fail as well
+    batch.insert(batch.end(), queue_.begin(), queue_.end());
+    queue_.clear();
+  }
+  for (auto& e : batch) {
+    e->sent = ec ? 0 : e->size;
+    e->done = true;
+    e->signal.cancel();
+  }
+  next_lead();
+}
+
+}	// end of namespace comm
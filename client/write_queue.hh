@@ -0,0 +1,64 @@
+#pragma once
+#include "network_fwd.hh"
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace comm {
+
+// Outbound messages for a single socket. Messages that are queued while a write
+// is in progress are sent together by the next write, as one gather write over
+// all of their buffers, so many small concurrent sends cost a single syscall.
+// The buffers of the messages are not copied, they must stay valid until send returns, which is
+// the case when the caller co_awaits it. A sender that is cancelled while its message waits in the
+// queue drops the message. Once the message was taken for a write, the sender stays until the write
+// is done, and the cancellation is seen by the caller after that, so the write of a batch is never
+// cut short by one of its senders.
+// The queue does not own the socket, and it must be used from the socket's executor.
+class write_queue {
+public:
+    explicit write_queue(tcp::socket& socket);
+    write_queue(const write_queue&) = delete;
+    auto operator = (const write_queue&) -> write_queue& = delete;
+
+    // Queue a message made of these buffers and wait until it was sent.
+    // Return the number of bytes sent, 0 on failure, in which case the socket is closed
+    auto send(std::span<const asio::const_buffer> message) -> asio::awaitable<std::size_t>;
+
+    // the headers and the body are kept as separate buffers, the body is not copied
+    auto send(std::string_view header, std::string_view body = {}) -> asio::awaitable<std::size_t>;
+
+    // messages waiting for the current write to finish
+    auto pending() const -> std::size_t {
+        return queue_.size();
+    }
+
+    // number of gather writes issued, and number of messages they carried
+    auto writes() const -> std::size_t {
+        return writes_;
+    }
+
+    auto messages() const -> std::size_t {
+        return messages_;
+    }
+
+private:
+    struct entry;
+
+    auto flush() -> asio::awaitable<void>;
+    // the sender left send before its message was done
+    auto leave(const std::shared_ptr<entry>& e) -> void;
+    auto next_lead() -> void;
+
+    tcp::socket& socket_;
+    std::deque<std::shared_ptr<entry>> queue_;
+    std::vector<asio::const_buffer> buffers_;   // reused between writes
+    std::size_t writes_{0};
+    std::size_t messages_{0};
+    bool writing_{false};
+};
+
+}	// end of namespace comm
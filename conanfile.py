@@ -27,6 +27,7 @@ class ImageServerRecipe(ConanFile):
     def requirements(self):
         self.requires("glog/0.7.0")
         self.requires("boost/1.85.0")
+        self.requires("zlib/1.3.1")
         
     def generate(self):
         deps = CMakeDeps(self)
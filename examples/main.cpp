@@ -1,5 +1,6 @@
 #include "async_client.hh"
 #include "sync_client.hh"
+#include "fetch_all.hh"
 #include <iostream>
 #include <istream>
 #include <ostream>
@@ -10,75 +11,26 @@
 #include <sstream>
 #include <ranges>
 #include <boost/asio.hpp>
-#include <boost/asio/experimental/parallel_group.hpp>
 #ifdef USE_ASYNC_MULTI_WAIT
 namespace asio = boost::asio;
-using asio::ip::tcp;
-auto async_post(auto executor, auto op, auto&& token) {
-    return asio::async_compose<decltype(token), void()>(
-        [executor, fn = std::move(op)](auto& self) mutable {
-            asio::post(executor, 
-              [fn = std::move(fn), self = std::move(self)]() mutable {
-                fn();
-                std::move(self).complete();
-            });
-        },
-        token, executor);
-}
-
-
-auto for_each_parallel(auto ex, auto action, auto& input_range, auto&& token) {
-    return asio::async_compose<decltype(token), void(std::vector<size_t>)>(
-        [ex, action, &input_range](auto& self) mutable {
-            auto&& ops = input_range                                                        //
-                | std::ranges::views::transform([&](auto& elem) {                                //
-                             return async_post(                                             //
-                                 ex, [&elem, &action]() { action(elem); }, asio::deferred); //
-                         });
-            using Op = std::decay_t<decltype(ops.front())>;
-            std::vector<Op> vops(ops.begin(), ops.end());
-
-            namespace X = asio::experimental;
-            auto grp    = X::make_parallel_group(vops);
-
-            std::move(grp).async_wait(                                                           //
-                X::wait_for_all(), [self = std::move(self)](std::vector<size_t> order) mutable { //
-                    std::move(self).complete(std::move(order));
-                });
-        },
-        token, ex);
-}
-
-
 
 auto test_multi(const char* host, const char* port, const char* resource, boost::asio::io_context& ctx) -> int {
-    boost::asio::io_context io_context;
-
-    asio::thread_pool tp(3);
-    boost::asio::io_context* ctx_handle[] {&ctx, &ctx, &ctx};
+    static constexpr std::size_t REQUESTS{5};
+    static constexpr std::size_t MAX_IN_FLIGHT{3};
 
-    for (auto i : std::ranges::views::iota(0, 5)) {
-      std::cout << "running for the " << i << " time.." << std::endl;
-      auto fp = for_each_parallel(tp.get_executor(),
-          [resource, host, port](auto& ctx) {
-              if (auto s = connect(host, port, *ctx); s) {
-                if (send_request(s.value(), host, resource)) {
-                  const auto a{handle_response(*s)};
-                  if (a) {
-                    std::cout << "successfully read from server: " << a.value().size() << std::endl;
-                  }
-                } else {
-                  std::cerr << "send failed" << std::endl;
-                }
-              } else {
-                std::cerr << "connect failed" << std::endl;
-              }
-      }, ctx_handle, asio::use_future);
-      std::cout << "successfully lunched" << std::endl;
-      fp.wait();
-      std::cout << "the wait is over" << std::endl;
+    const std::vector<comm::http_request> requests(REQUESTS, comm::http_request{host, port, resource});
+    auto results = asio::co_spawn(ctx, comm::fetch_all(ctx.get_executor(), requests, MAX_IN_FLIGHT), asio::use_future);
+    ctx.run();
+    ctx.restart();
+    int failed{0};
+    for (const auto& r : results.get()) {
+      if (r.empty()) {
+        ++failed;
+      } else {
+        std::cout << "successfully read from server: " << r.size() << std::endl;
+      }
     }
-    return 0;
+    return failed == 0 ? 0 : -1;
 }
 #endif	// USE_ASYNC_MULTI_WAIT
 int main(int argc, char* argv[]) {
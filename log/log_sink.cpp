@@ -0,0 +1,317 @@
+#include "log_sink.hh"
+
+#ifdef NO_GLOG
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+namespace internal {
+namespace {
+
+using clock = std::chrono::system_clock;
+
+constexpr std::size_t MAX_LINE{512};            // longer lines are truncated
+constexpr std::size_t RING_SIZE{256};           // lines per thread, a power of 2
+constexpr auto FLUSH_INTERVAL{std::chrono::milliseconds{10}};
+
+struct record {
+    clock::time_point time{};
+    int level{INFO};
+    std::size_t size{0};
+    std::array<char, MAX_LINE> text{};
+};
+
+// A ring with a single producer, the thread that owns it, and a single consumer,
+// whoever holds the drain lock of the sink. When it is full new lines are dropped,
+// a thread that logs never waits for the writer.
+struct ring {
+    std::array<record, RING_SIZE> records{};
+    alignas(64) std::atomic<std::size_t> head{0};     // next slot to write
+    alignas(64) std::atomic<std::size_t> tail{0};     // next slot to read
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<bool> closed{false};                // the owning thread exited
+
+    // return the number of lines that are waiting, or 0 if the line was dropped
+    auto push(const record& line) -> std::size_t {
+        const auto h{head.load(std::memory_order_relaxed)};
+        const auto pending{h - tail.load(std::memory_order_acquire)};
+        if (pending == RING_SIZE) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        auto& slot{records[h & (RING_SIZE - 1)]};
+        slot.time = line.time;
+        slot.level = line.level;
+        slot.size = line.size;
+        std::copy_n(line.text.data(), line.size, slot.text.data());
+        head.store(h + 1, std::memory_order_release);
+        return pending + 1;
+    }
+};
+
+auto level_letter(int level) -> char {
+    switch (level) {
+    case FATAL:
+        return 'F';
+    case ERROR:
+        return 'E';
+    case WARNING:
+        return 'W';
+    default:
+        return 'I';
+    }
+}
+
+class sink {
+public:
+    // never destroyed, so lines from static destructors are still written
+    static auto instance() -> sink& {
+        static auto* s = [] {
+            auto* created{new sink};
+            std::atexit([] {
+                instance().stop();
+            });
+            return created;
+        }();
+        return *s;
+    }
+
+    auto attach() -> std::shared_ptr<ring> {
+        auto r{std::make_shared<ring>()};
+        std::lock_guard guard{rings_lock_};
+        rings_.push_back(r);
+        return r;
+    }
+
+    auto write(const record& line) -> void;
+
+    auto flush() -> void {
+        std::lock_guard guard{drain_lock_};
+        // drain a copy of the list, so a thread that logs its first line does not wait for our writes
+        {
+            std::lock_guard rings_guard{rings_lock_};
+            draining_ = rings_;
+        }
+        bool wrote{false};
+        bool released{false};
+        for (auto& r : draining_) {
+            // read closed first, so nothing is pushed after we drained a closed ring
+            const auto closed{r->closed.load(std::memory_order_acquire)};
+            wrote = drain(*r) || wrote;
+            released = released || closed;
+            if (!closed) {
+                r.reset();
+            }
+        }
+        // what is left in the copy are the closed rings, that are drained for good
+        if (released) {
+            std::lock_guard rings_guard{rings_lock_};
+            std::erase_if(rings_, [this](const std::shared_ptr<ring>& r) {
+                return std::find(draining_.begin(), draining_.end(), r) != draining_.end();
+            });
+        }
+        draining_.clear();
+        if (wrote) {
+            std::fflush(stdout);
+        }
+    }
+
+    // from here on the lines are written by the thread that logs them
+    auto stop() -> void {
+        {
+            std::lock_guard guard{wait_lock_};
+            done_ = true;
+        }
+        wake_.notify_one();
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+        stopped_.store(true, std::memory_order_release);
+        flush();
+    }
+
+    auto wake() -> void {
+        wake_.notify_one();
+    }
+
+private:
+    sink() : writer_{[this]() { run(); }} {
+    }
+
+    auto run() -> void {
+        std::unique_lock lock{wait_lock_};
+        while (!done_) {
+            wake_.wait_for(lock, FLUSH_INTERVAL);
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+    auto drain(ring& r) -> bool {
+        auto tail{r.tail.load(std::memory_order_relaxed)};
+        const auto head{r.head.load(std::memory_order_acquire)};
+        const auto wrote{tail != head};
+        for (; tail != head; ++tail) {
+            print(r.records[tail & (RING_SIZE - 1)]);
+        }
+        r.tail.store(tail, std::memory_order_release);
+        if (const auto dropped = r.dropped.exchange(0, std::memory_order_relaxed); dropped > 0) {
+            std::fprintf(stdout, "W %s: %llu log lines were dropped, the writer is too slow\n",
+                format_time(clock::now()), static_cast<unsigned long long>(dropped));
+            return true;
+        }
+        return wrote;
+    }
+
+    auto print(const record& line) -> void {
+        std::fprintf(stdout, "%c %s: %.*s\n", level_letter(line.level), format_time(line.time), static_cast<int>(line.size), line.text.data());
+    }
+
+    // localtime and strftime are only called once a second, the rest of the time we just add the milliseconds
+    auto format_time(clock::time_point t) -> const char* {
+        const auto seconds{clock::to_time_t(t)};
+        if (seconds != cached_second_) {
+            std::tm local{};
+#ifdef _WIN32
+            localtime_s(&local, &seconds);
+#else
+            localtime_r(&seconds, &local);
+#endif
+            std::strftime(cached_time_.data(), cached_time_.size(), "%T", &local);
+            cached_second_ = seconds;
+        }
+        const auto ms{std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count() % 1000};
+        std::snprintf(formatted_.data(), formatted_.size(), "%s.%03d", cached_time_.data(), static_cast<int>(ms));
+        return formatted_.data();
+    }
+
+    std::mutex rings_lock_;
+    std::vector<std::shared_ptr<ring>> rings_;
+    std::mutex drain_lock_;     // the consumer side of all the rings, and the time cache
+    std::vector<std::shared_ptr<ring>> draining_;   // the rings that flush drains, under drain_lock_
+    std::time_t cached_second_{-1};
+    std::array<char, 16> cached_time_{};
+    std::array<char, 32> formatted_{};
+    std::atomic<bool> stopped_{false};
+    std::mutex wait_lock_;
+    std::condition_variable wake_;
+    bool done_{false};
+    std::thread writer_;
+};
+
+// marks the ring as closed when its thread exits, so the writer can release it
+struct ring_owner {
+    std::shared_ptr<ring> r;
+
+    ~ring_owner() {
+        r->closed.store(true, std::memory_order_release);
+    }
+};
+
+auto this_thread_ring() -> ring& {
+    thread_local const ring_owner owner{sink::instance().attach()};
+    return *owner.r;
+}
+
+auto sink::write(const record& line) -> void {
+    if (stopped_.load(std::memory_order_acquire)) {
+        std::lock_guard guard{drain_lock_};
+        print(line);
+        std::fflush(stdout);
+        return;
+    }
+    const auto pending{this_thread_ring().push(line)};
+    if (line.level == FATAL) {
+        flush();
+    } else if (pending == RING_SIZE / 2) {
+        // the timer of the writer would be too late to keep up with this thread
+        wake();
+    }
+}
+
+}		// end of local namespace
+
+// The text of the line is formatted straight into a record, with no allocation.
+// Each thread reuses its own writer, a new one is only made when a LOG is used
+// while building the text of another line in the same thread.
+struct log_line::writer : std::streambuf {
+    record line;
+    std::ostream os{this};
+    bool busy{false};
+    bool truncated{false};
+
+    auto start(int level, const char* function) -> void {
+        line.time = clock::now();
+        line.level = level;
+        truncated = false;
+        setp(line.text.data(), line.text.data() + line.text.size());
+        os.clear();
+        os.flags(std::ios_base::dec | std::ios_base::skipws);
+        os.precision(6);
+        os.fill(' ');
+        os << function << ": ";
+    }
+
+    auto finish() -> void {
+        line.size = static_cast<std::size_t>(pptr() - pbase());
+        while (line.size > 0 && line.text[line.size - 1] == '\n') {
+            --line.size;
+        }
+        if (truncated && line.size >= 3) {
+            std::copy_n("...", 3, line.text.data() + line.size - 3);
+        }
+    }
+
+    auto overflow(int_type c) -> int_type override {
+        truncated = true;
+        return traits_type::not_eof(c);
+    }
+};
+
+log_line::log_line(int level, const char* function) : writer_{nullptr}, owned_{false} {
+    thread_local writer local;
+    if (local.busy) {
+        writer_ = new writer;
+        owned_ = true;
+    } else {
+        writer_ = &local;
+    }
+    writer_->busy = true;
+    writer_->start(level, function);
+}
+
+log_line::~log_line() {
+    writer_->finish();
+    sink::instance().write(writer_->line);
+    writer_->busy = false;
+    if (owned_) {
+        delete writer_;
+    }
+}
+
+auto log_line::stream() -> std::ostream& {
+    return writer_->os;
+}
+
+auto start_sink() -> void {
+    sink::instance();
+}
+
+auto flush_sink() -> void {
+    sink::instance().flush();
+}
+
+}   // end of namespace internal
+#endif      // NO_GLOG
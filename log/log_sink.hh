@@ -0,0 +1,14 @@
+#pragma once
+// The background writer that is used by LOG when building without glog
+#include "logging.hh"
+
+#ifdef NO_GLOG
+namespace internal {
+
+// start the writer thread, otherwise it starts with the first LOG line
+auto start_sink() -> void;
+// write all the lines that were logged so far, from all the threads
+auto flush_sink() -> void;
+
+}   // end of namespace internal
+#endif      // NO_GLOG
@@ -1,4 +1,5 @@
 #include "logging.hh"
+#include "log_sink.hh"
 #include <mutex>
 
 auto init_log() -> void {
@@ -11,5 +12,15 @@ auto init_log() -> void {
     	  google::InitGoogleLogging("recorder");
        }
    );
+#else
+    internal::start_sink();
+#endif  // NO_GLOG
+}
+
+auto flush_log() -> void {
+#ifndef NO_GLOG
+    google::FlushLogFiles(google::GLOG_INFO);
+#else
+    internal::flush_sink();
 #endif  // NO_GLOG
 }
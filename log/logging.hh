@@ -1,31 +1,12 @@
 #pragma once
-#ifndef __linux__
-#   ifndef NO_GLOG
-#       define NO_GLOG
-#   endif   // NO_GLOG
-#include <chrono>
-#include <sstream>
-#include <string>
-#include <iomanip>
+// glog is used on Linux, unless the build defines NO_GLOG
+#if !defined(__linux__) && !defined(NO_GLOG)
+#   define NO_GLOG
+#endif
 
-namespace internal {
-inline auto timestamp() -> std::string {
-    using namespace std::chrono;
-    using clock = system_clock;
-    
-    const auto current_time_point {clock::now()};
-    const auto current_time {clock::to_time_t (current_time_point)};
-    const auto current_localtime {*std::localtime (&current_time)};
-    const auto current_time_since_epoch {current_time_point.time_since_epoch()};
-    const auto current_milliseconds {duration_cast<milliseconds> (current_time_since_epoch).count() % 1000};
-    
-    std::ostringstream stream;
-    stream << std::put_time (&current_localtime, "%T") << "." << std::setw (3) << std::setfill ('0') << current_milliseconds;
-    return stream.str();
-}
-}   // end of namespace internal
+#ifdef NO_GLOG
+#include <ostream>
 
-#   include <iostream>
 #   ifndef FATAL
 #       define FATAL 1
 #   endif
@@ -38,14 +19,46 @@ inline auto timestamp() -> std::string {
 #   ifndef INFO
 #       define INFO 4
 #   endif
-#   define LOG(x) std::cout << ::internal::timestamp() << ": " << __func__ << ": "
+// Levels above LOG_LEVEL are removed at compile time, the arguments
+// of such a LOG line are not even evaluated
+#   ifndef LOG_LEVEL
+#       define LOG_LEVEL INFO
+#   endif
+
+namespace internal {
+
+// A single log line. The text is formatted into a buffer of the calling thread,
+// and when the line ends it is copied into the ring buffer of this thread.
+// A background thread writes these rings to stdout, so logging never waits on IO
+// or on a lock that is shared with the other threads.
+class log_line {
+public:
+    log_line(int level, const char* function);
+    log_line(const log_line&) = delete;
+    auto operator = (const log_line&) -> log_line& = delete;
+    ~log_line();
+
+    auto stream() -> std::ostream&;
+
+private:
+    struct writer;
+    writer* writer_;
+    bool owned_;
+};
+
+}   // end of namespace internal
+
+#   define LOG(x) if constexpr ((x) > LOG_LEVEL) {} else ::internal::log_line{x, __func__}.stream()
+// verbose lines, as with glog VLOG(n), they are above INFO so they are removed unless LOG_LEVEL allows them
+#   define VLOG(n) LOG(INFO + (n))
 #   ifndef ENDL
-#       define ENDL  std::endl;
+#       define ENDL ""
 #   endif
-//__PRETTY_FUNCTION__
 #else
 #   include <glog/logging.h>
 #   define ENDL ""
 #endif      // NO_GLOG
 
 auto init_log() -> void;
+// Write all the pending log lines before returning
+auto flush_log() -> void;
@@ -0,0 +1,26 @@
+#pragma once
+#include <iostream>
+#include <string_view>
+
+// The checks of the test programs. A failed check is reported with its location and the test
+// goes on, so a single run shows all the failures, and main returns test::result()
+namespace test {
+
+inline int failures{0};
+
+inline auto check(bool passed, std::string_view expression, const char* file, int line) -> bool {
+    if (!passed) {
+        ++failures;
+        std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+    }
+    return passed;
+}
+
+inline auto result(std::string_view name) -> int {
+    std::cout << name << ": " << (failures == 0 ? "passed" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+}	// end of namespace test
+
+#define CHECK(x) ::test::check(static_cast<bool>(x), #x, __FILE__, __LINE__)
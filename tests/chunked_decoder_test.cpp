@@ -0,0 +1,97 @@
+#include "check.hh"
+#include "chunked_decoder.hh"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace comm;
+
+namespace {
+
+struct decoded {
+    std::string body;
+    std::size_t consumed{0};
+    bool done{false};
+    bool failed{false};
+};
+
+// feed the input in pieces of this size, as it would arrive from the socket
+auto decode(std::string_view input, std::size_t piece) -> decoded {
+    chunked_decoder decoder;
+    decoded result;
+    while (result.consumed < input.size() && !decoder.done() && !decoder.failed()) {
+        auto part{input.substr(result.consumed, piece)};
+        // a piece may take a few calls
+        while (!part.empty() && !decoder.done() && !decoder.failed()) {
+            const auto step{decoder.decode(part)};
+            result.body.append(step.data);
+            result.consumed += step.consumed;
+            part.remove_prefix(step.consumed);
+            if (step.consumed == 0) {
+                break;
+            }
+        }
+    }
+    result.done = decoder.done();
+    result.failed = decoder.failed();
+    return result;
+}
+
+auto decodes(std::string_view input, std::string_view body) -> bool {
+    // all the ways to split it, from a byte at a time to all at once
+    for (std::size_t piece = 1; piece <= input.size(); ++piece) {
+        const auto r{decode(input, piece)};
+        if (!r.done || r.failed || r.body != body || r.consumed != input.size()) {
+            std::cerr << "pieces of " << piece << ": done " << r.done << ", consumed " << r.consumed
+                << ", body '" << r.body << "'" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+auto fails(std::string_view input) -> bool {
+    for (std::size_t piece = 1; piece <= input.size(); ++piece) {
+        if (!decode(input, piece).failed) {
+            std::cerr << "pieces of " << piece << " did not fail" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+}		// end of local namespace
+
+auto main() -> int {
+    CHECK(decodes("0\r\n\r\n", ""));
+    CHECK(decodes("5\r\nhello\r\n0\r\n\r\n", "hello"));
+    CHECK(decodes("5\r\nhello\r\n7\r\n, world\r\n0\r\n\r\n", "hello, world"));
+    CHECK(decodes("A\r\n0123456789\r\na\r\nabcdefghij\r\n0\r\n\r\n", "0123456789abcdefghij"));
+    // extensions are ignored
+    CHECK(decodes("5;name=value\r\nhello\r\n0;last\r\n\r\n", "hello"));
+    // trailers are read and ignored
+    CHECK(decodes("5\r\nhello\r\n0\r\nExpires: never\r\nX-Sum: 1\r\n\r\n", "hello"));
+
+    // the decoder stops at the end of the body, what comes after it is the next response
+    const std::string_view two{"3\r\nabc\r\n0\r\n\r\nHTTP/1.1 200 OK\r\n"};
+    const auto first{decode(two, two.size())};
+    CHECK(first.done && first.body == "abc" && first.consumed == two.find("HTTP"));
+
+    CHECK(fails("x\r\n"));
+    CHECK(fails("\r\n"));
+    CHECK(fails("5\r\nhelloXX0\r\n\r\n"));
+    // a size that does not fit in 64 bits
+    CHECK(fails("10000000000000000\r\n"));
+    // a line that is longer than the limit
+    CHECK(fails("5;" + std::string(chunked_decoder::MAX_LINE + 1, 'x') + "\r\n"));
+
+    // reset starts a new body
+    chunked_decoder decoder;
+    decoder.decode("0\r\n\r\n");
+    CHECK(decoder.done());
+    decoder.reset();
+    CHECK(!decoder.done());
+    const auto again{decoder.decode("2\r\nok\r\n")};
+    CHECK(again.data == "ok");
+    return test::result("chunked_decoder");
+}
@@ -0,0 +1,127 @@
+#include "check.hh"
+#include "bench/server.hh"
+#include "h2_client.hh"
+#include "h2_frame.hh"
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace comm;
+
+namespace {
+
+constexpr std::size_t BODY_SIZE{100'000};
+
+// run the coroutine on a context of its own until it is done
+template<typename F>
+auto run(F test) -> void {
+    asio::io_context context;
+    asio::co_spawn(context, test(), [](std::exception_ptr e) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    });
+    context.run();
+}
+
+// concurrent requests share the connection, the bodies are larger than a frame, and than the
+// default window, so they take a few WINDOW_UPDATEs to arrive
+auto requests(unsigned short port) -> void {
+    run([port]() -> asio::awaitable<void> {
+        h2_options options;
+        options.stream_window = h2::DEFAULT_WINDOW;
+        request_deadlines deadlines;
+        auto connection = co_await async_h2_connect("127.0.0.1", std::to_string(port), options, deadlines);
+        if (!CHECK(connection)) {
+            co_return;
+        }
+        auto executor = co_await asio::this_coro::executor;
+        std::vector<h2_response> responses(8);
+        auto remaining{responses.size()};
+        asio::steady_timer done{executor, asio::steady_timer::time_point::max()};
+        for (std::size_t i = 0; i < responses.size(); ++i) {
+            asio::co_spawn(executor, [&, i]() -> asio::awaitable<void> {
+                h2_request req;
+                req.resource = "/" + std::to_string(i);
+                responses[i] = co_await connection->request(std::move(req), deadlines);
+                if (--remaining == 0) {
+                    done.cancel();
+                }
+            }, asio::detached);
+        }
+        co_await done.async_wait(asio::as_tuple(asio::use_awaitable));
+        for (const auto& response : responses) {
+            CHECK(response.status == 200 && response.body.size() == BODY_SIZE);
+        }
+        CHECK(connection->stats().streams == responses.size() && connection->stats().failed == 0);
+        CHECK(connection->is_open());
+        co_await connection->close();
+        CHECK(!connection->is_open());
+    });
+}
+
+// a header list above what we announced closes the connection, both when the block itself
+// is too large, and when it only decodes to too much
+auto header_list_limit(unsigned short port, std::uint32_t limit) -> void {
+    run([port, limit]() -> asio::awaitable<void> {
+        h2_options options;
+        options.max_header_list = limit;
+        request_deadlines deadlines;
+        auto connection = co_await async_h2_connect("127.0.0.1", std::to_string(port), options, deadlines);
+        if (!CHECK(connection)) {
+            co_return;
+        }
+        h2_request req;
+        const auto response = co_await connection->request(std::move(req), deadlines);
+        CHECK(!response.ok());
+        CHECK(!connection->is_open());
+    });
+}
+
+// a server that answers the preface with a frame larger than we accept, the client
+// must tell it why it closes with GOAWAY FRAME_SIZE_ERROR
+auto oversized_frame() -> void {
+    auto received{h2::error_code::no_error};
+    run([&received]() -> asio::awaitable<void> {
+        auto executor = co_await asio::this_coro::executor;
+        tcp::acceptor acceptor{executor, {asio::ip::make_address("127.0.0.1"), 0}};
+        const auto port{std::to_string(acceptor.local_endpoint().port())};
+        asio::co_spawn(executor, [&acceptor, &received]() -> asio::awaitable<void> {
+            auto socket = co_await acceptor.async_accept(asio::use_awaitable);
+            std::array<char, h2::PREFACE.size()> preface{};
+            co_await asio::async_read(socket, asio::buffer(preface), asio::use_awaitable);
+            std::string frames;
+            h2::append_frame_header(frames, h2::DEFAULT_MAX_FRAME + 1, h2::frame_type::data, 0, 1);
+            frames.append(h2::DEFAULT_MAX_FRAME + 1, '\0');
+            co_await asio::async_write(socket, asio::buffer(frames), asio::use_awaitable);
+            h2::frame_reader reader{socket};
+            while (auto f = co_await reader.next()) {
+                if (f->header.type == h2::frame_type::goaway && f->payload.size() >= 8) {
+                    received = static_cast<h2::error_code>(h2::read_u32(f->payload.subspan(4)));
+                    break;
+                }
+            }
+        }, asio::detached);
+        h2_options options;
+        request_deadlines deadlines;
+        const auto connection = co_await async_h2_connect("127.0.0.1", port, options, deadlines);
+        CHECK(!connection);
+    });
+    CHECK(received == h2::error_code::frame_size_error);
+}
+
+}		// end of local namespace
+
+auto main() -> int {
+    bench::local_server server{BODY_SIZE, 1};
+    server.start();
+    requests(server.h2_port());
+    header_list_limit(server.h2_port(), 16);
+    header_list_limit(server.h2_port(), 100);
+    oversized_frame();
+    server.stop();
+    return test::result("h2_client");
+}
@@ -0,0 +1,168 @@
+#include "check.hh"
+#include "h2_frame.hh"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace comm;
+
+namespace {
+
+struct socket_pair {
+    explicit socket_pair(asio::io_context& context) : client{context}, server{context} {
+        tcp::acceptor acceptor{context, {asio::ip::make_address("127.0.0.1"), 0}};
+        client.connect(acceptor.local_endpoint());
+        acceptor.accept(server);
+        server.set_option(tcp::no_delay{true});
+    }
+
+    tcp::socket client;
+    tcp::socket server;
+};
+
+auto content(const h2::frame& f) -> std::string {
+    const auto c{h2::frame_content(f)};
+    return c ? std::string{reinterpret_cast<const char*>(c->data()), c->size()} : std::string{"<malformed>"};
+}
+
+// the frames that the tests send, a few of each kind
+auto sample_frames() -> std::string {
+    std::string out;
+    const std::array<std::pair<h2::setting, std::uint32_t>, 2> settings{{
+        {h2::setting::max_concurrent_streams, 100}, {h2::setting::initial_window_size, 1 << 20}
+    }};
+    h2::append_settings(out, settings);
+    h2::append_settings_ack(out);
+    const std::array<std::byte, 8> opaque{std::byte{1}, std::byte{2}, std::byte{3}, std::byte{4},
+        std::byte{5}, std::byte{6}, std::byte{7}, std::byte{8}};
+    h2::append_ping(out, opaque, false);
+    h2::append_window_update(out, 3, 12'345);
+    // a header block that is larger than the frame limit, so it is sent with CONTINUATION frames
+    h2::append_headers(out, 1, std::string(40, 'h'), true, 16);
+    const std::string body(5'000, 'd');
+    h2::append_frame_header(out, static_cast<std::uint32_t>(body.size()), h2::frame_type::data, h2::flags::END_STREAM, 1);
+    out += body;
+    h2::append_rst_stream(out, 5, h2::error_code::cancel);
+    h2::append_goaway(out, 7, h2::error_code::no_error);
+    return out;
+}
+
+struct read_frame {
+    h2::frame_header header;
+    std::string payload;
+};
+
+// read count frames, while the other side writes them in pieces of the given size
+auto exchange(const std::string& frames, std::size_t piece, std::size_t count) -> std::vector<read_frame> {
+    asio::io_context context;
+    socket_pair sockets{context};
+    std::vector<read_frame> result;
+    asio::co_spawn(context, [&]() -> asio::awaitable<void> {
+        for (std::size_t sent = 0; sent < frames.size(); sent += piece) {
+            const auto n{std::min(piece, frames.size() - sent)};
+            co_await asio::async_write(sockets.server, asio::buffer(frames.data() + sent, n), asio::use_awaitable);
+            // give the reader a chance to see each piece on its own
+            asio::steady_timer pause{sockets.server.get_executor(), std::chrono::microseconds{50}};
+            co_await pause.async_wait(asio::use_awaitable);
+        }
+        boost::system::error_code ec;
+        sockets.server.shutdown(tcp::socket::shutdown_send, ec);
+    }, asio::detached);
+    asio::co_spawn(context, [&]() -> asio::awaitable<void> {
+        h2::frame_reader reader{sockets.client};
+        while (result.size() < count) {
+            const auto f{co_await reader.next()};
+            if (!f) {
+                break;
+            }
+            result.push_back(read_frame{f->header, std::string{reinterpret_cast<const char*>(f->payload.data()), f->payload.size()}});
+        }
+    }, asio::detached);
+    context.run();
+    return result;
+}
+
+auto check_samples(const std::vector<read_frame>& frames) -> void {
+    if (!CHECK(frames.size() == 11)) {
+        return;
+    }
+    CHECK(frames[0].header.type == h2::frame_type::settings && frames[0].payload.size() == 12 && frames[0].header.stream == 0);
+    CHECK(frames[1].header.type == h2::frame_type::settings && frames[1].header.has(h2::flags::ACK) && frames[1].payload.empty());
+    CHECK(frames[2].header.type == h2::frame_type::ping && frames[2].payload.size() == 8 && frames[2].payload[7] == 8);
+    CHECK(frames[3].header.type == h2::frame_type::window_update && frames[3].header.stream == 3);
+    CHECK(h2::read_u32(std::as_bytes(std::span{frames[3].payload})) == 12'345);
+    // 40 bytes of headers in frames of up to 16
+    CHECK(frames[4].header.type == h2::frame_type::headers && frames[4].header.has(h2::flags::END_STREAM));
+    CHECK(!frames[4].header.has(h2::flags::END_HEADERS) && frames[4].payload.size() == 16);
+    CHECK(frames[5].header.type == h2::frame_type::continuation && !frames[5].header.has(h2::flags::END_HEADERS));
+    CHECK(frames[6].header.type == h2::frame_type::continuation && frames[6].header.has(h2::flags::END_HEADERS));
+    CHECK(frames[6].payload.size() == 8 && frames[6].header.stream == 1);
+    CHECK(frames[7].header.type == h2::frame_type::data && frames[7].payload == std::string(5'000, 'd'));
+    CHECK(frames[8].header.type == h2::frame_type::rst_stream && frames[8].header.stream == 5);
+    CHECK(h2::read_u32(std::as_bytes(std::span{frames[8].payload})) == static_cast<std::uint32_t>(h2::error_code::cancel));
+    CHECK(frames[9].header.type == h2::frame_type::goaway);
+    CHECK(h2::read_u32(std::as_bytes(std::span{frames[9].payload})) == 7);
+    CHECK(frames[10].header.type == h2::frame_type::ping);
+}
+
+auto split_reads() -> void {
+    auto frames{sample_frames()};
+    // and one more frame after the large one, so it starts in the same read as the end of the others
+    const std::array<std::byte, 8> opaque{};
+    h2::append_ping(frames, opaque, true);
+    for (const std::size_t piece : {std::size_t{1}, std::size_t{5}, std::size_t{9}, std::size_t{10}, std::size_t{4'099}, frames.size()}) {
+        check_samples(exchange(frames, piece, 11));
+    }
+}
+
+auto too_large() -> void {
+    std::string frames;
+    h2::append_frame_header(frames, h2::DEFAULT_MAX_FRAME + 1, h2::frame_type::data, 0, 1);
+    frames.append(h2::DEFAULT_MAX_FRAME + 1, 'x');
+    // the reader gives up on the frame, and does not read its payload
+    CHECK(exchange(frames, frames.size(), 1).empty());
+}
+
+auto closed_in_the_middle() -> void {
+    std::string frames;
+    h2::append_window_update(frames, 0, 1);
+    h2::append_frame_header(frames, 100, h2::frame_type::data, 0, 1);
+    frames.append(50, 'x');
+    const auto read{exchange(frames, 7, 2)};
+    CHECK(read.size() == 1 && read[0].header.type == h2::frame_type::window_update);
+}
+
+auto padding() -> void {
+    // PADDED with 3 bytes of padding
+    const std::string padded{"\x03" "body" "\0\0\0", 8};
+    h2::frame f{h2::frame_header{8, h2::frame_type::data, h2::flags::PADDED, 1}, std::as_bytes(std::span{padded})};
+    CHECK(content(f) == "body");
+    // PADDED and PRIORITY on HEADERS
+    const std::string both{"\x02" "\0\0\0\1\x10" "hb" "\0\0", 10};
+    f = h2::frame{h2::frame_header{10, h2::frame_type::headers, h2::flags::PADDED | h2::flags::PRIORITY, 1},
+        std::as_bytes(std::span{both})};
+    CHECK(content(f) == "hb");
+    // more padding than payload
+    const std::string bad{"\x09" "ab", 3};
+    f = h2::frame{h2::frame_header{3, h2::frame_type::data, h2::flags::PADDED, 1}, std::as_bytes(std::span{bad})};
+    CHECK(!h2::frame_content(f));
+    f = h2::frame{h2::frame_header{0, h2::frame_type::data, h2::flags::PADDED, 1}, {}};
+    CHECK(!h2::frame_content(f));
+}
+
+}		// end of local namespace
+
+auto main() -> int {
+    split_reads();
+    too_large();
+    closed_in_the_middle();
+    padding();
+    return test::result("h2_frame");
+}
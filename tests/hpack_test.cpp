@@ -0,0 +1,180 @@
+#include "check.hh"
+#include "hpack.hh"
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace comm;
+
+namespace {
+
+// the examples of RFC 7541 are written as hex, with spaces between the groups
+auto from_hex(std::string_view hex) -> std::vector<std::byte> {
+    std::vector<std::byte> bytes;
+    auto digit = [](char c) {
+        return c <= '9' ? c - '0' : c - 'a' + 10;
+    };
+    for (std::size_t i = 0; i < hex.size(); ++i) {
+        if (hex[i] == ' ') {
+            continue;
+        }
+        bytes.push_back(static_cast<std::byte>(digit(hex[i]) * 16 + digit(hex[i + 1])));
+        ++i;
+    }
+    return bytes;
+}
+
+auto same(const hpack::header_list& decoded, const hpack::header_list& expected) -> bool {
+    if (decoded.size() != expected.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < decoded.size(); ++i) {
+        if (decoded[i].name != expected[i].name || decoded[i].value != expected[i].value) {
+            std::cerr << "header " << i << " is " << decoded[i].name << ": " << decoded[i].value
+                << ", expected " << expected[i].name << ": " << expected[i].value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+auto decodes(hpack::decoder& d, std::string_view hex, const hpack::header_list& expected, std::size_t table_size) -> bool {
+    const auto block{from_hex(hex)};
+    const auto decoded{d.decode(block)};
+    return decoded && same(*decoded, expected) && d.table_size() == table_size;
+}
+
+auto huffman_round_trip() -> void {
+    std::vector<std::string> inputs{"", "a", "www.example.com", "no-cache", "custom-key",
+        "Mon, 21 Oct 2013 20:13:21 GMT", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"};
+    std::string all;
+    for (int c = 0; c < 256; ++c) {
+        all.push_back(static_cast<char>(c));
+    }
+    inputs.push_back(all);
+    for (const auto& input : inputs) {
+        std::string encoded;
+        hpack::huffman_encode(input, encoded);
+        CHECK(encoded.size() == hpack::huffman_encoded_size(input));
+        std::string decoded;
+        CHECK(hpack::huffman_decode(std::as_bytes(std::span{encoded}), decoded));
+        CHECK(decoded == input);
+    }
+    // C.4.1, the Huffman code of www.example.com
+    std::string encoded;
+    hpack::huffman_encode("www.example.com", encoded);
+    CHECK(std::as_bytes(std::span{encoded}).size() == 12);
+    const auto expected{from_hex("f1e3 c2e5 f23a 6ba0 ab90 f4ff")};
+    CHECK(std::equal(expected.begin(), expected.end(), std::as_bytes(std::span{encoded}).begin()));
+    // padding that is longer than 7 bits, or that is not the prefix of EOS, is an error
+    std::string ignored;
+    CHECK(!hpack::huffman_decode(from_hex("ffff ffff"), ignored));
+    CHECK(!hpack::huffman_decode(from_hex("18"), ignored));      // "a" with zero bits as padding
+}
+
+// C.2, header fields on their own
+auto literal_fields() -> void {
+    hpack::decoder with_indexing;
+    CHECK(decodes(with_indexing, "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572",
+                  {{"custom-key", "custom-header"}}, 55));
+    hpack::decoder without_indexing;
+    CHECK(decodes(without_indexing, "040c 2f73 616d 706c 652f 7061 7468", {{":path", "/sample/path"}}, 0));
+    hpack::decoder never_indexed;
+    CHECK(decodes(never_indexed, "1008 7061 7373 776f 7264 0673 6563 7265 74", {{"password", "secret"}}, 0));
+    hpack::decoder indexed;
+    CHECK(decodes(indexed, "82", {{":method", "GET"}}, 0));
+}
+
+// C.3 without Huffman and C.4 with it, three requests that share the dynamic table
+auto requests() -> void {
+    const hpack::header_list first{{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}};
+    const hpack::header_list second{{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"},
+        {"cache-control", "no-cache"}};
+    const hpack::header_list third{{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"},
+        {":authority", "www.example.com"}, {"custom-key", "custom-value"}};
+
+    hpack::decoder plain;
+    CHECK(decodes(plain, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d", first, 57));
+    CHECK(decodes(plain, "8286 84be 5808 6e6f 2d63 6163 6865", second, 110));
+    CHECK(decodes(plain, "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65", third, 164));
+
+    hpack::decoder huffman;
+    CHECK(decodes(huffman, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff", first, 57));
+    CHECK(decodes(huffman, "8286 84be 5886 a8eb 1064 9cbf", second, 110));
+    CHECK(decodes(huffman, "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf", third, 164));
+}
+
+// C.5 without Huffman and C.6 with it, with a table of 256 bytes, so entries are evicted
+auto responses() -> void {
+    const hpack::header_list first{{":status", "302"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:21 GMT"}, {"location", "https://www.example.com"}};
+    const hpack::header_list second{{":status", "307"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:21 GMT"}, {"location", "https://www.example.com"}};
+    const hpack::header_list third{{":status", "200"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:22 GMT"}, {"location", "https://www.example.com"},
+        {"content-encoding", "gzip"}, {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}};
+
+    hpack::decoder plain{256};
+    CHECK(decodes(plain, "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a "
+                         "3133 3a32 3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d", first, 222));
+    CHECK(decodes(plain, "4803 3330 37c1 c0bf", second, 222));
+    CHECK(decodes(plain, "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d 54c0 5a04 "
+                         "677a 6970 7738 666f 6f3d 4153 444a 4b48 514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49 "
+                         "553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e 3d31", third, 215));
+
+    hpack::decoder huffman{256};
+    CHECK(decodes(huffman, "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6 2d1b ff6e "
+                           "919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3", first, 222));
+    CHECK(decodes(huffman, "4883 640e ffc1 c0bf", second, 222));
+    CHECK(decodes(huffman, "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab 77ad 94e7 "
+                           "821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed "
+                           "4ee5 b106 3d50 07", third, 215));
+}
+
+auto table_size_updates() -> void {
+    hpack::decoder d;
+    CHECK(decodes(d, "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572", {{"custom-key", "custom-header"}}, 55));
+    // a size update to 0 empties the table, and then the entry that was in it is gone
+    CHECK(decodes(d, "20", {}, 0));
+    CHECK(!d.decode(from_hex("be")));
+    // an update above what we announced is an error
+    hpack::decoder small{100};
+    CHECK(!small.decode(from_hex("3fe1 1f")));
+}
+
+auto malformed() -> void {
+    hpack::decoder d;
+    CHECK(!d.decode(from_hex("80")));               // index 0
+    CHECK(!d.decode(from_hex("ff00")));             // past the end of the tables
+    CHECK(!d.decode(from_hex("400a 6375 7374")));   // a string that is cut
+    CHECK(!d.decode(from_hex("3f")));               // an integer that is cut
+}
+
+auto encoder_round_trip() -> void {
+    const hpack::header_list headers{{":method", "GET"}, {":scheme", "http"}, {":path", "/index.html?q=1"},
+        {":authority", "localhost:8080"}, {"accept", "*/*"}, {"accept-encoding", "gzip, deflate"},
+        {"user-agent", "comm-client"}, {"x-empty", ""}, {"x-binary", std::string{"\x01\x7f\xff", 3}}};
+    std::string block;
+    hpack::encoder{}.encode(headers, block);
+    hpack::decoder d;
+    const auto decoded{d.decode(std::as_bytes(std::span{block}))};
+    CHECK(decoded && same(*decoded, headers));
+    // the encoder never adds to the dynamic table of the peer
+    CHECK(d.table_size() == 0);
+}
+
+}		// end of local namespace
+
+auto main() -> int {
+    huffman_round_trip();
+    literal_fields();
+    requests();
+    responses();
+    table_size_updates();
+    malformed();
+    encoder_round_trip();
+    return test::result("hpack");
+}
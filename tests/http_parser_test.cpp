@@ -0,0 +1,103 @@
+#include "check.hh"
+#include "http_parser.hh"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace comm;
+
+namespace {
+
+// feed the head in pieces of this size, with all that was received so far
+template<typename Parser>
+auto parse(Parser& parser, std::string_view head, std::size_t piece) -> message_parser::result {
+    auto result{message_parser::result::incomplete};
+    for (std::size_t size = piece; result == message_parser::result::incomplete; size += piece) {
+        result = parser.parse(head.substr(0, size));
+        if (size >= head.size()) {
+            break;
+        }
+    }
+    return result;
+}
+
+template<typename Parser>
+auto parses(std::string_view head) -> bool {
+    for (std::size_t piece = 1; piece <= head.size(); ++piece) {
+        Parser parser;
+        if (parse(parser, head, piece) != message_parser::result::done || parser.header_size() != head.size()) {
+            std::cerr << "pieces of " << piece << " did not parse '" << head << "'" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+auto rejects(std::string_view head) -> bool {
+    request_parser parser;
+    return parser.parse(head) == message_parser::result::error;
+}
+
+auto requests() -> void {
+    constexpr std::string_view GET{"GET /index.html?q=1 HTTP/1.1\r\nHost: localhost\r\nAccept:  */* \r\n\r\n"};
+    CHECK(parses<request_parser>(GET));
+    request_parser get;
+    CHECK(get.parse(GET) == message_parser::result::done);
+    CHECK(get.method(GET) == "GET" && get.target(GET) == "/index.html?q=1" && get.version_minor() == 1);
+    CHECK(get.framing() == body_framing::none && get.keep_alive());
+    CHECK(get.find(GET, "accept") == "*/*" && !get.find(GET, "Content-Length"));
+
+    constexpr std::string_view POST{"POST /upload HTTP/1.0\r\nContent-Length: 5\r\ncontent-length: 5\r\nConnection: keep-alive\r\n\r\n"};
+    CHECK(parses<request_parser>(POST));
+    request_parser post;
+    post.parse(POST);
+    CHECK(post.framing() == body_framing::content_length && post.content_length() == 5);
+    CHECK(post.version_minor() == 0 && post.keep_alive());
+
+    constexpr std::string_view CHUNKED{"PUT /x HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\nConnection: close\r\n\r\n"};
+    request_parser chunked;
+    CHECK(chunked.parse(CHUNKED) == message_parser::result::done);
+    CHECK(chunked.framing() == body_framing::chunked && !chunked.keep_alive());
+
+    // the server does not know where the body ends with any of these
+    CHECK(rejects("POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n"));
+    CHECK(rejects("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n"));
+    CHECK(rejects("POST / HTTP/1.1\r\nContent-Length: 5, 6\r\n\r\n"));
+    CHECK(rejects("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n"));
+    CHECK(rejects("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n"));
+    CHECK(rejects("GET / HTTP/2.0\r\n\r\n"));
+    CHECK(rejects("GET  / HTTP/1.1\r\n\r\n"));
+    CHECK(rejects("GET / HTTP/1.1\r\n folded: header\r\n\r\n"));
+    CHECK(rejects("GET / HTTP/1.1\r\nno colon\r\n\r\n"));
+}
+
+auto responses() -> void {
+    constexpr std::string_view OK{"HTTP/1.1 200 OK\r\nContent-Length: 12\r\n\r\n"};
+    CHECK(parses<response_parser>(OK));
+    response_parser ok;
+    ok.parse(OK);
+    CHECK(ok.status_code() == 200 && ok.reason(OK) == "OK" && ok.framing() == body_framing::content_length);
+    CHECK(ok.content_length() == 12 && ok.keep_alive());
+
+    // without a length the body ends when the connection is closed
+    constexpr std::string_view CLOSE{"HTTP/1.1 200 OK\r\n\r\n"};
+    response_parser close;
+    close.parse(CLOSE);
+    CHECK(close.framing() == body_framing::close && !close.keep_alive());
+
+    constexpr std::string_view NOT_MODIFIED{"HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n"};
+    response_parser not_modified;
+    not_modified.parse(NOT_MODIFIED);
+    CHECK(not_modified.framing() == body_framing::none);
+
+    response_parser conflict;
+    CHECK(conflict.parse("HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n") == message_parser::result::error);
+}
+
+}		// end of local namespace
+
+auto main() -> int {
+    requests();
+    responses();
+    return test::result("http_parser");
+}
@@ -0,0 +1,127 @@
+#include "check.hh"
+#include "submission_queue.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace comm;
+
+namespace {
+
+auto capacity() -> void {
+    CHECK(mpsc_ring<int>{1}.capacity() == 2);
+    CHECK(mpsc_ring<int>{5}.capacity() == 8);
+    CHECK(mpsc_ring<int>{64}.capacity() == 64);
+}
+
+auto full() -> void {
+    mpsc_ring<std::string> ring{4};
+    CHECK(!ring.ready() && !ring.try_pop());
+    for (int i = 0; i < 4; ++i) {
+        std::string value{"value " + std::to_string(i)};
+        CHECK(ring.try_push(value) && value.empty());
+    }
+    // no room, and the value is left as it was, so it can be pushed again later
+    std::string extra{"extra"};
+    CHECK(!ring.try_push(extra) && extra == "extra");
+    CHECK(ring.ready());
+    CHECK(ring.try_pop() == "value 0");
+    CHECK(ring.try_push(extra) && extra.empty());
+    for (const auto expected : {"value 1", "value 2", "value 3", "extra"}) {
+        CHECK(ring.try_pop() == expected);
+    }
+    CHECK(!ring.ready() && !ring.try_pop());
+}
+
+auto wrap_around() -> void {
+    // many laps over the cells, with the ring a bit fuller on each step
+    mpsc_ring<int> ring{8};
+    int pushed{0};
+    int popped{0};
+    for (int round = 0; round < 1'000; ++round) {
+        for (int i = 0; i < 1 + round % 8; ++i) {
+            auto value{pushed};
+            if (!ring.try_push(value)) {
+                break;
+            }
+            ++pushed;
+        }
+        for (int i = 0; i < 1 + round % 5; ++i) {
+            const auto value{ring.try_pop()};
+            if (!value) {
+                break;
+            }
+            if (!CHECK(*value == popped)) {
+                return;
+            }
+            ++popped;
+        }
+    }
+    while (const auto value = ring.try_pop()) {
+        CHECK(*value == popped++);
+    }
+    CHECK(pushed == popped && pushed > 1'000);
+}
+
+// the producers push their own sequence of values, into a ring that is much smaller than
+// what they push, so they keep finding it full. The consumer must see each sequence in order
+auto producers() -> void {
+    constexpr std::size_t PRODUCERS{4};
+    constexpr std::uint32_t VALUES{100'000};
+    using value = std::pair<std::size_t, std::uint32_t>;
+    mpsc_ring<value> ring{64};
+    std::vector<std::thread> threads;
+    std::vector<std::uint64_t> full_counts(PRODUCERS, 0);
+    for (std::size_t p = 0; p < PRODUCERS; ++p) {
+        threads.emplace_back([&ring, &full_counts, p]() {
+            for (std::uint32_t i = 1; i <= VALUES; ++i) {
+                value v{p, i};
+                while (!ring.try_push(v)) {
+                    ++full_counts[p];
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::vector<std::uint32_t> last(PRODUCERS, 0);
+    std::size_t received{0};
+    bool ordered{true};
+    while (received < PRODUCERS * VALUES) {
+        const auto v{ring.try_pop()};
+        if (!v) {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && v->first < PRODUCERS && v->second == last[v->first] + 1;
+        if (v->first < PRODUCERS) {
+            last[v->first] = v->second;
+        }
+        ++received;
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    std::uint64_t times_full{0};
+    for (const auto f : full_counts) {
+        times_full += f;
+    }
+    CHECK(ordered);
+    CHECK(!ring.try_pop());
+    for (const auto l : last) {
+        CHECK(l == VALUES);
+    }
+    std::cout << "producers found the ring full " << times_full << " times" << std::endl;
+}
+
+}		// end of local namespace
+
+auto main() -> int {
+    capacity();
+    full();
+    wrap_around();
+    producers();
+    return test::result("mpsc_ring");
+}